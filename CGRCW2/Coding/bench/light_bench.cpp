@@ -0,0 +1,115 @@
+// Many-light benchmark: renders a scene lit by a growing number of point lights, once shading
+// every light at every hit and once picking lights from the light tree, and reports render time,
+// shadow rays and how far the light tree image is from the all-lights one.
+//
+// Build (from this folder):
+//   g++ -O2 -march=native -std=c++11 -pthread -I../src/Code light_bench.cpp -o light_bench
+//
+// Run:
+//   ./light_bench [--spp N] [--width N] [--threads N] [--light-samples N] [--max-lights N]
+#include "camera.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+// Spheres on a large ground sphere, under a grid of lights of random color spread over the whole floor
+void makeScene(Scene& scene, int light_count) {
+    seed_random(7);
+    scene.add(std::make_shared<Sphere>(Point3D(0, -1000, 0), 1000, std::make_shared<Lambertian>(Color(0.6, 0.6, 0.6))));
+    for (int a = -6; a < 6; ++a) {
+        for (int b = -6; b < 6; ++b) {
+            auto material = std::make_shared<Blinn_Phong>(Color::random(0.2, 1), Color(1, 1, 1), 0.8, 0.2, 50);
+            scene.add(std::make_shared<Sphere>(Point3D(2 * a + random_double(), 0.5, 2 * b + random_double()), 0.5, material));
+        }
+    }
+
+    int side = static_cast<int>(std::ceil(std::sqrt(static_cast<double>(light_count))));
+    for (int i = 0; i < light_count; ++i) {
+        double x = -12 + 24 * (i % side + random_double()) / side;
+        double z = -12 + 24 * (i / side + random_double()) / side;
+        scene.add(std::make_shared<PointLight>(Point3D(x, 2 + random_double(), z), Color::random(0.5, 1) * (200.0 / light_count)));
+    }
+    scene.build_bvh();
+}
+
+struct Result {
+    Framebuffer image;
+    double seconds;
+    std::uint64_t shadow_rays;
+};
+
+Result render(Scene& scene, LightSampling sampling, int light_samples, int spp, int width, int threads) {
+    scene.set_light_sampling(sampling, light_samples);
+    Camera camera;
+    camera.image_width = width;
+    camera.aspect_ratio = 16.0 / 9.0;
+    camera.samples_per_pixel = spp;
+    camera.max_depth = 1;   // Direct lighting only, so the images differ only in how lights are sampled
+    camera.vfov = 50;
+    camera.lookfrom = Point3D(0, 9, 16);
+    camera.lookat = Point3D(0, 0, 0);
+    camera.num_threads = threads;
+    camera.seed = 1;
+
+    auto start = std::chrono::steady_clock::now();
+    Framebuffer image = camera.render(scene, Color(0.7, 0.8, 1.0), RENDER_PHONG);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    Result result = {image, elapsed.count(), camera.ray_counts.shadow};
+    return result;
+}
+
+double meanLuminance(const Framebuffer& image) {
+    double sum = 0;
+    for (const Color& pixel : image.getPixels()) sum += luminance(pixel);
+    return sum / image.getPixels().size();
+}
+
+// Root mean square difference of the pixel luminances, relative to the mean luminance of the reference
+double relativeRMSE(const Framebuffer& image, const Framebuffer& reference) {
+    double sum = 0;
+    for (size_t p = 0; p < image.getPixels().size(); ++p) {
+        double d = luminance(image.getPixels()[p]) - luminance(reference.getPixels()[p]);
+        sum += d * d;
+    }
+    return std::sqrt(sum / image.getPixels().size()) / meanLuminance(reference);
+}
+
+int main(int argc, char* argv[]) {
+    int spp = 8;
+    int width = 160;
+    int threads = 0;
+    int light_samples = 1;
+    int max_lights = 1024;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--spp" && i + 1 < argc) {
+            spp = std::atoi(argv[++i]);
+        } else if (arg == "--width" && i + 1 < argc) {
+            width = std::atoi(argv[++i]);
+        } else if (arg == "--threads" && i + 1 < argc) {
+            threads = std::atoi(argv[++i]);
+        } else if (arg == "--light-samples" && i + 1 < argc) {
+            light_samples = std::atoi(argv[++i]);
+        } else if (arg == "--max-lights" && i + 1 < argc) {
+            max_lights = std::atoi(argv[++i]);
+        } else {
+            std::cerr << "Error: unknown or incomplete option '" << arg << "'" << std::endl;
+            return 1;
+        }
+    }
+
+    std::cout << "lights  all_s     tree_s    speedup  all_shadow_rays  tree_shadow_rays  mean_all  mean_tree  rel_rmse\n";
+    for (int lights = 4; lights <= max_lights; lights *= 4) {
+        Scene scene;
+        makeScene(scene, lights);
+        Result all = render(scene, LIGHT_SAMPLING_ALL, 1, spp, width, threads);
+        Result tree = render(scene, LIGHT_SAMPLING_TREE, light_samples, spp, width, threads);
+        std::printf("%6d  %-8.3f  %-8.3f  %-7.1f  %-15llu  %-16llu  %-8.4f  %-9.4f  %.4f\n", lights, all.seconds, tree.seconds,
+                    all.seconds / tree.seconds, static_cast<unsigned long long>(all.shadow_rays), static_cast<unsigned long long>(tree.shadow_rays),
+                    meanLuminance(all.image), meanLuminance(tree.image), relativeRMSE(tree.image, all.image));
+    }
+    return 0;
+}
@@ -0,0 +1,213 @@
+// Primary-ray throughput of packet tracing (RayPacket, BVH::hit_packet) against one ray at a time,
+// on full 1080p and 4K frames of a random-spheres scene at one sample per pixel.
+//
+// For every frame size it measures
+//   - intersect: the camera rays of the frame, in 16x16 tiles, through Scene::hit one by one and
+//     through Scene::hit_packet in packets of 4, 8 and 16 rays, nothing else;
+//   - binary, normal, phong: Camera::render in the mode, with the same packet sizes. Only the camera
+//     rays go in packets, so the phong numbers include the per-ray bounces and shadow rays.
+// Rates are camera rays per second, the best of --repeat runs; the speedups are against the single-ray
+// run of the same row.
+//
+// Build (from this folder), optionally with -DRT_FLOAT:
+//   g++ -O2 -march=native -std=c++11 -pthread -I../src/Code packet_bench.cpp -o packet_bench
+//
+// Run:
+//   ./packet_bench [--threads N] [--depth N] [--spheres-scale K] [--repeat N] [--small]
+// --small renders 480x270 and 960x540 instead, for a quick check.
+#include "camera.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Ground, a grid of small spheres with random materials and three large ones, as in render_bench
+Scene makeRandomSpheres(int scale) {
+    seed_random(42);
+    Scene scene;
+    scene.add(std::make_shared<Sphere>(Point3D(0, -1000, 0), 1000, std::make_shared<Lambertian>(Color(0.5, 0.5, 0.5))));
+    int extent = 11 * scale;
+    for (int a = -extent; a < extent; a++) {
+        for (int b = -extent; b < extent; b++) {
+            Point3D center(a + 0.9 * random_double(), 0.2, b + 0.9 * random_double());
+            if (random_double() < 0.8) {
+                scene.add(std::make_shared<Sphere>(center, 0.2, std::make_shared<Lambertian>(Color::random() * Color::random())));
+            } else {
+                scene.add(std::make_shared<Sphere>(center, 0.2, std::make_shared<Blinn_Phong>(Color::random(0.5, 1), Color(1, 1, 1), 0.8, 0.2, 100)));
+            }
+        }
+    }
+    scene.add(std::make_shared<Sphere>(Point3D(0, 1, 0), 1.0, std::make_shared<Blinn_Phong>(Color(0.7, 0.6, 0.5), Color(1, 1, 1), 0.8, 0.2, 100, true, 1.0)));
+    scene.add(std::make_shared<Sphere>(Point3D(-4, 1, 0), 1.0, std::make_shared<Lambertian>(Color(0.4, 0.2, 0.1))));
+    scene.add(std::make_shared<Sphere>(Point3D(4, 1, 0), 1.0, std::make_shared<Blinn_Phong>(Color(0.2, 0.3, 0.7), Color(1, 1, 1), 0.8, 0.2, 100)));
+    scene.add(std::make_shared<PointLight>(Point3D(10, 10, 5), Color(150, 150, 150)));
+    scene.build_bvh();
+    return scene;
+}
+
+Camera makeCamera(int width, int height) {
+    Camera camera;
+    camera.image_width = width;
+    camera.aspect_ratio = static_cast<double>(width) / height;
+    camera.samples_per_pixel = 1;
+    camera.vfov = 20;
+    camera.lookfrom = Point3D(13, 2, 3);
+    camera.lookat = Point3D(0, 0, 0);
+    camera.vup = Vector3D(0, 1, 0);
+    return camera;
+}
+
+// Rays through the pixel centers of the camera above, tile by tile in the order Camera::render traces them
+std::vector<Ray> makeCameraRays(int width, int height) {
+    Point3D lookfrom(13, 2, 3);
+    Vector3D w = normalize(lookfrom - Point3D(0, 0, 0));
+    Vector3D u = normalize(crossProduct(Vector3D(0, 1, 0), w));
+    Vector3D v = crossProduct(w, u);
+    double viewport_height = 2 * std::tan(degrees_to_radians(20.0) / 2);
+    double viewport_width = viewport_height * width / height;
+
+    const int tile = 16;
+    std::vector<Ray> rays;
+    rays.reserve(static_cast<size_t>(width) * height);
+    for (int ty = 0; ty < height; ty += tile) {
+        for (int tx = 0; tx < width; tx += tile) {
+            for (int j = ty; j < std::min(ty + tile, height); ++j) {
+                for (int i = tx; i < std::min(tx + tile, width); ++i) {
+                    double s = ((i + 0.5) / width - 0.5) * viewport_width;
+                    double t = (0.5 - (j + 0.5) / height) * viewport_height;
+                    rays.push_back(Ray(lookfrom, s * u + t * v - w));
+                }
+            }
+        }
+    }
+    return rays;
+}
+
+// Camera rays per second through Scene::hit (packet_size 0) or Scene::hit_packet; counts the hits
+double measureIntersect(const Scene& scene, const std::vector<Ray>& rays, int packet_size, long& hits) {
+    Interval ray_t[RayPacket::max_size];
+    Hit_record records[RayPacket::max_size];
+    bool found[RayPacket::max_size];
+    for (int k = 0; k < RayPacket::max_size; ++k) ray_t[k] = Interval(0.001, infinity);
+
+    auto start = std::chrono::steady_clock::now();
+    long count = 0;
+    if (packet_size == 0) {
+        for (const Ray& ray : rays) {
+            count += scene.hit(ray, ray_t[0], records[0]);
+        }
+    } else {
+        for (size_t first = 0; first < rays.size(); first += packet_size) {
+            int n = static_cast<int>(std::min(rays.size() - first, static_cast<size_t>(packet_size)));
+            scene.hit_packet(&rays[first], ray_t, n, records, found);
+            for (int k = 0; k < n; ++k) count += found[k];
+        }
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    hits = count;
+    return rays.size() / elapsed.count();
+}
+
+// Camera rays per second of a whole render; image is the result, for the identity check
+double measureRender(const Scene& scene, int width, int height, RenderMode mode, int packet_size, const Camera& settings, Framebuffer& image) {
+    Camera camera = makeCamera(width, height);
+    camera.num_threads = settings.num_threads;
+    camera.max_depth = settings.max_depth;
+    camera.packet_size = packet_size;
+    auto start = std::chrono::steady_clock::now();
+    image = camera.render(scene, Color(0.5, 0.7, 1.0), mode);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return camera.ray_counts.primary / elapsed.count();
+}
+
+bool sameImage(const Framebuffer& a, const Framebuffer& b) {
+    for (int j = 0; j < a.getHeight(); ++j) {
+        for (int i = 0; i < a.getWidth(); ++i) {
+            if (!(a.at(i, j) == b.at(i, j))) return false;
+        }
+    }
+    return true;
+}
+
+void printRow(const std::string& name, const std::vector<double>& rates, bool identical) {
+    std::cout << "  " << std::left << std::setw(10) << name << std::right << std::fixed;
+    for (size_t k = 0; k < rates.size(); ++k) {
+        std::cout << std::setprecision(2) << std::setw(8) << rates[k] / 1e6;
+        if (k > 0) std::cout << " (" << std::setprecision(2) << rates[k] / rates[0] << "x)";
+        else std::cout << "        ";
+    }
+    std::cout << (identical ? "" : "  (RESULTS DIFFER)") << "\n";
+}
+
+int main(int argc, char* argv[]) {
+    Camera settings;
+    settings.num_threads = 1;
+    settings.max_depth = 4;
+    int spheres_scale = 2;
+    int repeat = 3;
+    bool small = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--threads" && i + 1 < argc) {
+            settings.num_threads = std::atoi(argv[++i]);
+        } else if (arg == "--depth" && i + 1 < argc) {
+            settings.max_depth = std::atoi(argv[++i]);
+        } else if (arg == "--spheres-scale" && i + 1 < argc) {
+            spheres_scale = std::atoi(argv[++i]);
+        } else if (arg == "--repeat" && i + 1 < argc) {
+            repeat = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--small") {
+            small = true;
+        } else {
+            std::cerr << "Error: unknown or incomplete option '" << arg << "'" << std::endl;
+            return 1;
+        }
+    }
+
+    Scene scene = makeRandomSpheres(spheres_scale);
+    const int packet_sizes[] = {0, 4, 8, 16};
+    const int frames[2][2] = {{1920, 1080}, {3840, 2160}};
+    std::cout << "Primary rays, " << scene.getShapes().size() << " shapes, " << settings.num_threads << " thread(s), max depth "
+              << settings.max_depth << ", " << (sizeof(real) == sizeof(float) ? "float" : "double") << ", "
+              << PacketLanes::width << " lanes per slab test\n";
+
+    for (const auto& frame : frames) {
+        int width = small ? frame[0] / 4 : frame[0];
+        int height = small ? frame[1] / 4 : frame[1];
+        std::cout << width << "x" << height << ", Mrays/s for packets of 1, 4, 8, 16\n";
+
+        std::vector<Ray> rays = makeCameraRays(width, height);
+        std::vector<double> rates;
+        bool identical = true;
+        long single_hits = 0;
+        for (int packet_size : packet_sizes) {
+            long hits = 0;
+            double best = 0;
+            for (int r = 0; r < repeat; ++r) best = std::max(best, measureIntersect(scene, rays, packet_size, hits));
+            rates.push_back(best);
+            if (packet_size == 0) single_hits = hits;
+            identical = identical && hits == single_hits;
+        }
+        printRow("intersect", rates, identical);
+
+        RenderMode modes[] = {RENDER_BINARY, RENDER_NORMAL, RENDER_PHONG};
+        for (RenderMode mode : modes) {
+            rates.clear();
+            identical = true;
+            Framebuffer single, image;
+            for (int packet_size : packet_sizes) {
+                double best = 0;
+                for (int r = 0; r < repeat; ++r) {
+                    best = std::max(best, measureRender(scene, width, height, mode, packet_size, settings, packet_size == 0 ? single : image));
+                }
+                rates.push_back(best);
+                if (packet_size != 0) identical = identical && sameImage(single, image);
+            }
+            printRow(renderModeName(mode), rates, identical);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,94 @@
+// Microbenchmark of the per-primitive intersection routines the scene calls: SpherePrimitive,
+// TrianglePrimitive and CylinderPrimitive hit() and occluded(), each over an array of records and
+// a set of random rays aimed near them. Records come from Shape::primitive(), as in Scene::add().
+//
+// Build (from this folder), optionally with -DRT_FLOAT or -DRT_SIMD_VECTOR:
+//   g++ -O2 -march=native -std=c++11 -pthread -I../src/Code primitive_bench.cpp -o primitive_bench
+//
+// Run:
+//   ./primitive_bench [--count N] [--rays N]
+#include "scene.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Rays from random points of a box towards random points near the origin, which hit about half of the records
+std::vector<Ray> makeRays(int count) {
+    std::vector<Ray> rays;
+    for (int i = 0; i < count; ++i) {
+        Point3D origin = Vector3D::random(-4, 4) + Vector3D(0, 0, 6);
+        Point3D target = Vector3D::random(-1, 1);
+        rays.push_back(Ray(origin, target - origin));
+    }
+    return rays;
+}
+
+// Tests every ray against every record with test(record, ray); returns nanoseconds per test and counts the hits
+template <typename Record, typename Test>
+double measure(const std::vector<Record>& records, const std::vector<Ray>& rays, Test&& test, long& hits) {
+    auto start = std::chrono::steady_clock::now();
+    long found = 0;
+    for (const Ray& ray : rays) {
+        for (const Record& record : records) {
+            found += test(record, ray);
+        }
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    hits = found;
+    return elapsed.count() * 1e9 / (static_cast<double>(records.size()) * rays.size());
+}
+
+template <typename Record>
+void run(const char* name, const std::vector<Record>& records, const std::vector<Ray>& rays) {
+    Interval ray_t(0.001, infinity);
+    long hits = 0, blocked = 0;
+    double hit_ns = measure(records, rays, [&](const Record& record, const Ray& ray) {
+        Hit_record rec;
+        return record.hit(ray, ray_t, rec);
+    }, hits);
+    double occluded_ns = measure(records, rays, [&](const Record& record, const Ray& ray) {
+        return record.occluded(ray, ray_t);
+    }, blocked);
+    std::cout << "  " << std::left << std::setw(10) << name << std::right << std::fixed << std::setprecision(2)
+              << "hit " << std::setw(7) << hit_ns << " ns   occluded " << std::setw(7) << occluded_ns << " ns"
+              << "   (" << hits << " hits, " << blocked << " blocked)\n";
+}
+
+int main(int argc, char* argv[]) {
+    int count = 256;
+    int ray_count = 4096;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--count" && i + 1 < argc) {
+            count = std::atoi(argv[++i]);
+        } else if (arg == "--rays" && i + 1 < argc) {
+            ray_count = std::atoi(argv[++i]);
+        } else {
+            std::cerr << "Error: unknown or incomplete option '" << arg << "'" << std::endl;
+            return 1;
+        }
+    }
+
+    seed_random(2024);
+    std::vector<SpherePrimitive> spheres;
+    std::vector<TrianglePrimitive> triangles;
+    std::vector<CylinderPrimitive> cylinders;
+    for (int i = 0; i < count; ++i) {
+        Point3D p = Vector3D::random(-1, 1);
+        spheres.push_back(Sphere(p, random_double(0.05, 0.3), nullptr).primitive());
+        triangles.push_back(Triangle(p, p + Vector3D::random(-0.5, 0.5), p + Vector3D::random(-0.5, 0.5), nullptr).primitive());
+        cylinders.push_back(Cylinder(p, Vector3D::random(-1, 1), random_double(0.05, 0.3), random_double(0.1, 0.5), nullptr).primitive());
+    }
+    std::vector<Ray> rays = makeRays(ray_count);
+
+    std::cout << "Primitive intersection, " << count << " records x " << ray_count << " rays, "
+              << (sizeof(real) == sizeof(float) ? "float" : "double") << ", " << vector_kernel_name() << "\n";
+    run("sphere", spheres, rays);
+    run("triangle", triangles, rays);
+    run("cylinder", cylinders, rays);
+    return 0;
+}
@@ -0,0 +1,322 @@
+// End-to-end render benchmark: renders a fixed set of scenes at a fixed seed and sample count
+// and reports wall time, primary/secondary/shadow rays per second and peak RSS as JSON.
+//
+// Build (from this folder):
+//   g++ -O2 -march=native -std=c++11 -pthread -I../src/Code render_bench.cpp -o render_bench
+//
+// Run from this folder (the scene paths are relative to it, see --root):
+//   ./render_bench [--spp N] [--scale F] [--threads N] [--seed N] [--spheres-scale K]
+//                  [--integrator recursive|wavefront] [--roulette-depth N] [--mode phong|pbr]
+//                  [--mis power|balance|light|bsdf] [--root <CGRCW2 folder>] [--output results.json]
+//                  [--save-images <folder>] [--reference <folder>]
+//
+// --mode pbr renders the scenes that use phong mode in pbr mode instead, with the strategies --mis selects.
+// --save-images writes the radiance of every scene as <folder>/<name>.pfm; --reference compares each
+// image with the one saved there by another run and reports the difference. To compare the float
+// build with the double one, build a second binary with -DRT_FLOAT, then run
+//   ./render_bench --save-images double && ./render_bench_float --reference double
+#include "camera.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+// Peak resident set size of the whole process so far, in kilobytes
+long peakRSSKilobytes() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+    return static_cast<long>(counters.PeakWorkingSetSize / 1024);
+#else
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024;  // Bytes on macOS
+#else
+    return usage.ru_maxrss;
+#endif
+#endif
+}
+
+struct BenchSettings {
+    int spp = 4;
+    double scale = 0.25;        // Resolution relative to the scene file
+    int threads = 0;
+    std::uint64_t seed = 1;
+    int spheres_scale = 2;      // The random-spheres grid spans spheres_scale times the original 22 x 22 cells per side
+    bool wavefront = false;
+    int roulette_depth = 3;     // As Camera::roulette_depth, 0 = every path runs to the scene's bounce limit
+    RenderMode phong_mode = RENDER_PHONG;   // Render mode of the scenes that use phong
+    MISHeuristic mis = MIS_POWER;           // Strategies of pbr mode
+    std::string root = "../..";
+    std::string save_images;    // Folder to write the images to, empty = none
+    std::string reference;      // Folder of images to compare with, empty = none
+};
+
+// Radiance as a PFM: a text header, then little-endian float RGB per pixel, bottom row first
+bool savePFM(const std::string& filename, const Framebuffer& image) {
+    std::ofstream file(filename, std::ios::out | std::ios::binary);
+    file << "PF\n" << image.getWidth() << ' ' << image.getHeight() << "\n-1.0\n";
+    for (int j = image.getHeight() - 1; j >= 0; --j) {
+        for (int i = 0; i < image.getWidth(); ++i) {
+            const Color& pixel = image.at(i, j);
+            float rgb[3] = {static_cast<float>(pixel.x), static_cast<float>(pixel.y), static_cast<float>(pixel.z)};
+            file.write(reinterpret_cast<const char*>(rgb), sizeof(rgb));
+        }
+    }
+    return static_cast<bool>(file);
+}
+
+// Read a PFM written by savePFM. Returns false if it is missing or not of the given size
+bool loadPFM(const std::string& filename, int width, int height, Framebuffer& image) {
+    std::ifstream file(filename, std::ios::in | std::ios::binary);
+    std::string magic;
+    int file_width = 0, file_height = 0;
+    double scale = 0;
+    file >> magic >> file_width >> file_height >> scale;
+    file.get();
+    if (!file || magic != "PF" || file_width != width || file_height != height || scale >= 0) return false;
+    image = Framebuffer(width, height);
+    for (int j = height - 1; j >= 0; --j) {
+        for (int i = 0; i < width; ++i) {
+            float rgb[3];
+            file.read(reinterpret_cast<char*>(rgb), sizeof(rgb));
+            image.at(i, j) = Color(rgb[0], rgb[1], rgb[2]);
+        }
+    }
+    return static_cast<bool>(file);
+}
+
+// Root mean square difference of the pixel luminances relative to the mean luminance of the reference,
+// and the root mean square and largest difference of an 8-bit channel once both images are tone mapped.
+// The tone mapped error is what the eye sees: a few pixels of a light seen directly can dominate the first
+nlohmann::ordered_json compareImages(const Framebuffer& image, const Framebuffer& reference) {
+    double squared = 0, mean = 0;
+    for (size_t p = 0; p < image.getPixels().size(); ++p) {
+        double l = luminance(reference.getPixels()[p]);
+        double d = luminance(image.getPixels()[p]) - l;
+        squared += d * d;
+        mean += l;
+    }
+    size_t count = image.getPixels().size();
+    std::vector<unsigned char> a = image.toneMap(), b = reference.toneMap();
+    int max_difference = 0;
+    double squared_8bit = 0;
+    for (size_t k = 0; k < a.size(); ++k) {
+        max_difference = std::max(max_difference, std::abs(a[k] - b[k]));
+        squared_8bit += (a[k] - b[k]) * (a[k] - b[k]);
+    }
+    return {{"relative_rmse", mean > 0 ? std::sqrt(squared / count) / (mean / count) : 0.0},
+            {"rmse_8bit", std::sqrt(squared_8bit / a.size())}, {"max_8bit_difference", max_difference}};
+}
+
+// The final scene of Coding_Weekend.cpp with this renderer's materials (metal becomes a reflective
+// Blinn-Phong, glass a refractive one), over a grid scaled up by 'scale' per side, lit by two point lights
+Scene makeRandomSpheres(int scale, std::uint64_t seed) {
+    seed_random(seed);
+    Scene scene;
+    scene.add(std::make_shared<Sphere>(Point3D(0, -1000, 0), 1000, std::make_shared<Lambertian>(Color(0.5, 0.5, 0.5))));
+
+    auto glass = std::make_shared<Blinn_Phong>(Color(1, 1, 1), Color(1, 1, 1), 0.1, 0.5, 200, false, 0.0, true, 1.5);
+    int extent = 11 * scale;
+    for (int a = -extent; a < extent; a++) {
+        for (int b = -extent; b < extent; b++) {
+            double choose_mat = random_double();
+            Point3D center(a + 0.9 * random_double(), 0.2, b + 0.9 * random_double());
+            if (getLength(center - Point3D(4, 0.2, 0)) <= 0.9) continue;
+
+            std::shared_ptr<Material> material;
+            if (choose_mat < 0.8) {
+                material = std::make_shared<Lambertian>(Color::random() * Color::random());
+            } else if (choose_mat < 0.95) {
+                material = std::make_shared<Blinn_Phong>(Color::random(0.5, 1), Color(1, 1, 1), 0.8, 0.2, 100, true, random_double(0.5, 1.0));
+            } else {
+                material = glass;
+            }
+            scene.add(std::make_shared<Sphere>(center, 0.2, material));
+        }
+    }
+
+    scene.add(std::make_shared<Sphere>(Point3D(0, 1, 0), 1.0, glass));
+    scene.add(std::make_shared<Sphere>(Point3D(-4, 1, 0), 1.0, std::make_shared<Lambertian>(Color(0.4, 0.2, 0.1))));
+    scene.add(std::make_shared<Sphere>(Point3D(4, 1, 0), 1.0, std::make_shared<Blinn_Phong>(Color(0.7, 0.6, 0.5), Color(1, 1, 1), 0.8, 0.2, 100, true, 1.0)));
+
+    scene.add(std::make_shared<PointLight>(Point3D(10, 10, 5), Color(150, 150, 150)));
+    scene.add(std::make_shared<PointLight>(Point3D(-5, 8, 10), Color(80, 80, 100)));
+    return scene;
+}
+
+nlohmann::ordered_json runScene(const std::string& name, Scene& scene, Camera& camera, const Color& background, RenderMode mode, const BenchSettings& settings) {
+    scene.build_bvh();
+    camera.image_width = std::max(1, static_cast<int>(camera.image_width * settings.scale + 0.5));
+    camera.samples_per_pixel = settings.spp;
+    camera.adaptive = false;
+    camera.num_threads = settings.threads;
+    camera.seed = settings.seed;
+    camera.wavefront = settings.wavefront;
+    camera.roulette_depth = settings.roulette_depth;
+    if (mode == RENDER_PHONG) mode = settings.phong_mode;
+    scene.set_mis_heuristic(settings.mis);
+
+    auto start = std::chrono::steady_clock::now();
+    Framebuffer image = camera.render(scene, background, mode);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    double seconds = elapsed.count();
+    const RayCounters& rays = camera.ray_counts;
+
+    nlohmann::ordered_json result;
+    result["name"] = name;
+    result["width"] = image.getWidth();
+    result["height"] = image.getHeight();
+    result["spp"] = settings.spp;
+    result["shapes"] = scene.getShapes().size();
+    result["render_mode"] = renderModeName(mode);
+    result["wall_seconds"] = seconds;
+    result["rays"] = {
+        {"primary", rays.primary}, {"secondary", rays.secondary()}, {"shadow", rays.shadow}, {"total", rays.total()}
+    };
+    result["mrays_per_second"] = {
+        {"primary", rays.primary / seconds / 1e6}, {"secondary", rays.secondary() / seconds / 1e6},
+        {"shadow", rays.shadow / seconds / 1e6}, {"total", rays.total() / seconds / 1e6}
+    };
+    result["peak_rss_kb"] = peakRSSKilobytes();
+
+    if (!settings.save_images.empty() && !savePFM(settings.save_images + "/" + name + ".pfm", image)) {
+        std::cerr << "Error: could not write " << settings.save_images << "/" << name << ".pfm" << std::endl;
+    }
+    if (!settings.reference.empty()) {
+        Framebuffer reference;
+        if (loadPFM(settings.reference + "/" + name + ".pfm", image.getWidth(), image.getHeight(), reference)) {
+            result["reference"] = compareImages(image, reference);
+        } else {
+            std::cerr << "Error: no reference image " << settings.reference << "/" << name << ".pfm of this size" << std::endl;
+        }
+    }
+
+    std::clog << name << ": " << seconds << " s, " << rays.total() / seconds / 1e6 << " Mrays/s\n";
+    return result;
+}
+
+nlohmann::ordered_json runSceneFile(const std::string& name, const std::string& path, const BenchSettings& settings) {
+    SceneReader scene_reader(path);
+    Scene scene = scene_reader.buildScene();
+
+    RenderMode mode;
+    if (!parseRenderMode(scene_reader.getRenderMode(), mode)) {
+        throw std::runtime_error("Invalid render mode in " + path);
+    }
+    auto background = scene_reader.getSceneBackgroundColor();
+
+    Camera camera;
+    camera.modifyCamera(scene_reader);
+    return runScene(name, scene, camera, Color(background[0], background[1], background[2]), mode, settings);
+}
+
+// Names of --mis, in the order of MISHeuristic
+const char* mis_names[] = {"power", "balance", "light", "bsdf"};
+
+int main(int argc, char* argv[]) {
+    BenchSettings settings;
+    std::string output_file;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--spp" && i + 1 < argc) {
+            settings.spp = std::atoi(argv[++i]);
+        } else if (arg == "--scale" && i + 1 < argc) {
+            settings.scale = std::atof(argv[++i]);
+        } else if (arg == "--threads" && i + 1 < argc) {
+            settings.threads = std::atoi(argv[++i]);
+        } else if (arg == "--seed" && i + 1 < argc) {
+            settings.seed = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--spheres-scale" && i + 1 < argc) {
+            settings.spheres_scale = std::atoi(argv[++i]);
+        } else if (arg == "--integrator" && i + 1 < argc) {
+            settings.wavefront = std::string(argv[++i]) == "wavefront";
+        } else if (arg == "--roulette-depth" && i + 1 < argc) {
+            settings.roulette_depth = std::atoi(argv[++i]);
+        } else if (arg == "--mode" && i + 1 < argc) {
+            std::string name = argv[++i];
+            if (name != "phong" && name != "pbr") {
+                std::cerr << "Error: --mode must be phong or pbr" << std::endl;
+                return 1;
+            }
+            parseRenderMode(name, settings.phong_mode);
+        } else if (arg == "--mis" && i + 1 < argc) {
+            std::string name = argv[++i];
+            int h = 0;
+            while (h < 4 && name != mis_names[h]) ++h;
+            if (h == 4) {
+                std::cerr << "Error: --mis must be power, balance, light or bsdf" << std::endl;
+                return 1;
+            }
+            settings.mis = static_cast<MISHeuristic>(h);
+        } else if (arg == "--root" && i + 1 < argc) {
+            settings.root = argv[++i];
+        } else if (arg == "--output" && i + 1 < argc) {
+            output_file = argv[++i];
+        } else if (arg == "--save-images" && i + 1 < argc) {
+            settings.save_images = argv[++i];
+        } else if (arg == "--reference" && i + 1 < argc) {
+            settings.reference = argv[++i];
+        } else {
+            std::cerr << "Error: unknown or incomplete option '" << arg << "'" << std::endl;
+            return 1;
+        }
+    }
+
+    nlohmann::ordered_json report;
+    report["config"] = {
+        {"spp", settings.spp}, {"scale", settings.scale}, {"threads", settings.threads}, {"seed", settings.seed},
+        {"spheres_scale", settings.spheres_scale}, {"integrator", settings.wavefront ? "wavefront" : "recursive"},
+        {"roulette_depth", settings.roulette_depth}, {"phong_mode", renderModeName(settings.phong_mode)},
+        {"mis", mis_names[settings.mis]},
+        {"precision", sizeof(real) == sizeof(float) ? "float" : "double"}
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    nlohmann::ordered_json scenes = nlohmann::ordered_json::array();
+    const char* scene_files[][2] = {
+        {"scene", "/scene.json"},
+        {"simple_phong", "/simple_phong.json"},
+        {"binary_primitives", "/binary_primitives.json"},
+        {"default", "/Coding/src/Code/default.json"}
+    };
+    for (const auto& scene_file : scene_files) {
+        scenes.push_back(runSceneFile(scene_file[0], settings.root + scene_file[1], settings));
+    }
+
+    Scene spheres = makeRandomSpheres(settings.spheres_scale, settings.seed);
+    Camera camera;
+    camera.aspect_ratio = 16.0 / 9.0;
+    camera.image_width = 1200;
+    camera.max_depth = 8;
+    camera.vfov = 20;
+    camera.lookfrom = Point3D(13, 2, 3);
+    camera.lookat = Point3D(0, 0, 0);
+    camera.vup = Vector3D(0, 1, 0);
+    scenes.push_back(runScene("random_spheres", spheres, camera, Color(0.7, 0.8, 1.0), RENDER_PHONG, settings));
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    report["scenes"] = scenes;
+    report["total_wall_seconds"] = elapsed.count();
+    report["peak_rss_kb"] = peakRSSKilobytes();
+
+    if (output_file.empty()) {
+        std::cout << report.dump(2) << std::endl;
+    } else {
+        std::ofstream out(output_file);
+        out << report.dump(2) << std::endl;
+    }
+    return 0;
+}
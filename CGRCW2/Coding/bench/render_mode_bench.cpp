@@ -0,0 +1,132 @@
+// Per-mode throughput of the recursive integrator: the old per-bounce render_mode string
+// compares (kept below as a replica) against RecursiveIntegrator, specialized per mode.
+//
+// Build (from this folder):
+//   g++ -O2 -march=native -std=c++11 -pthread -I../src/Code render_mode_bench.cpp -o render_mode_bench
+#include "integrator.h"
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Replica of Camera::ray_color before the render mode was resolved at startup:
+// the mode string is passed by value and compared at every bounce.
+Color string_ray_color(const Ray& r, int depth, const Scene& scene, const Color background, const std::string render_mode) {
+    Hit_record rec;
+
+    double diffuseFactor = 0.5;
+
+    if (depth <= 0) {
+        return background;
+    }
+
+    if (scene.hit(r, Interval(0.001, infinity), rec)) {
+        if(render_mode == "binary") {
+            return Color(1, 0, 0);
+        } else if (render_mode == "normal") {
+            return 0.5 * (rec.normal + Color(1,1,1));
+        } else if (render_mode == "diffuse") {
+            Vector3D direction = random_in_hemisphere(rec.normal);
+            return diffuseFactor * string_ray_color(Ray(rec.p, direction), depth-1, scene, background, render_mode);
+        } else if (render_mode == "phong") {
+            Ray scattered;
+            Color attenuation;
+            Color light_contribution = scene.calculateLightingForHitPoint(r, rec);
+            if (scene.getMaterial(rec.material).scatter(r, rec.normal, rec.p, rec.front_face, attenuation, scattered, light_contribution)) {
+                return attenuation * string_ray_color(scattered, depth-1, scene, background, render_mode);
+            }
+            return Color(0, 1, 0);
+        } else {
+            std::cerr << "Error: Invalid render mode '" << render_mode << "'" << std::endl;
+            exit(1);
+        }
+    } else {
+        return background;
+    }
+}
+
+// A handful of spheres and triangles with every material kind over a ground sphere, two lights
+Scene makeScene() {
+    Scene scene;
+    std::shared_ptr<Material> materials[] = {
+        std::make_shared<Lambertian>(Color(0.8, 0.3, 0.3)),
+        std::make_shared<Blinn_Phong>(Color(0.2, 0.7, 0.2), Color(1, 1, 1), 0.8, 0.3, 20),
+        std::make_shared<Blinn_Phong>(Color(0.5, 0.5, 0.5), Color(1, 1, 1), 1.0, 0.2, 500, true, 0.8),
+        std::make_shared<Blinn_Phong>(Color(0.5, 0.5, 0.5), Color(1, 1, 1), 1.0, 0.2, 500, false, 0.0, true, 1.5)
+    };
+    scene.add(std::make_shared<Sphere>(Point3D(0, -100.5, -1), 100, materials[0]));
+    for (int i = 0; i < 16; ++i) {
+        Point3D center(-3 + (i % 4) * 2, 0, -2 - (i / 4) * 2);
+        scene.add(std::make_shared<Sphere>(center, 0.45, materials[i % 4]));
+        scene.add(std::make_shared<Triangle>(center + Vector3D(-0.5, 0.6, 0), center + Vector3D(0.5, 0.6, 0), center + Vector3D(0, 1.4, 0), materials[(i + 1) % 4]));
+    }
+    scene.add(std::make_shared<PointLight>(Point3D(0, 3, 0), Color(6, 6, 6)));
+    scene.add(std::make_shared<PointLight>(Point3D(-3, 2, -1), Color(3, 3, 4)));
+    scene.build_bvh();
+    return scene;
+}
+
+// Pinhole camera rays over a 90 degree field of view, each with its own random stream
+void makeRays(int width, int height, std::vector<Ray>& rays, std::vector<Sampler>& samplers) {
+    for (int j = 0; j < height; ++j) {
+        for (int i = 0; i < width; ++i) {
+            start_sample(7, static_cast<std::uint64_t>(j) * width + i, 0);
+            double u = (i + random_double()) / width * 2 - 1;
+            double v = 1 - (j + random_double()) / height * 2;
+            rays.push_back(Ray(Point3D(0, 0.5, 2), Vector3D(u * 1.5, v, -1)));
+            samplers.push_back(thread_sampler());
+        }
+    }
+}
+
+// Returns samples per second
+template <typename TraceFn>
+double measure(int repetitions, size_t samples, TraceFn&& trace) {
+    auto start = std::chrono::steady_clock::now();
+    for (int rep = 0; rep < repetitions; ++rep) {
+        trace();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return repetitions * samples / elapsed.count();
+}
+
+int main() {
+    Scene scene = makeScene();
+    Color background(0.2, 0.3, 0.5);
+    const int max_depth = 8;
+
+    std::vector<Ray> rays;
+    std::vector<Sampler> samplers;
+    makeRays(320, 180, rays, samplers);
+    std::cout << rays.size() << " samples per repetition, max depth " << max_depth << "\n";
+
+    RenderMode modes[] = {RENDER_BINARY, RENDER_NORMAL, RENDER_DIFFUSE, RENDER_PHONG};
+    for (RenderMode mode : modes) {
+        std::string name = renderModeName(mode);
+        int repetitions = mode == RENDER_PHONG ? 3 : 20;
+        std::vector<Color> colors(rays.size());
+
+        double before = measure(repetitions, rays.size(), [&]() {
+            for (size_t k = 0; k < rays.size(); ++k) {
+                thread_sampler() = samplers[k];
+                colors[k] = string_ray_color(rays[k], max_depth, scene, background, name);
+            }
+        });
+        Color check_before = colors[rays.size() / 2];
+
+        RecursiveIntegrator integrator(scene, background, mode, max_depth);
+        double after = measure(repetitions, rays.size(), [&]() {
+            integrator.trace(rays, samplers, colors);
+        });
+        Color check_after = colors[rays.size() / 2];
+
+        std::cout << std::left << std::setw(8) << name << std::right << std::fixed << std::setprecision(3)
+                  << "  string compares " << std::setw(8) << before / 1e6 << " Msamples/s"
+                  << "  specialized " << std::setw(8) << after / 1e6 << " Msamples/s"
+                  << std::setprecision(2) << "  " << after / before << "x"
+                  << (check_before == check_after ? "" : "  (RESULTS DIFFER)") << "\n";
+    }
+    return 0;
+}
@@ -0,0 +1,103 @@
+// Microbenchmark of the sphere intersection paths: virtual Sphere::hit calls against the
+// SoA sphere batch, both with its scalar loop and the SIMD kernel, with and without a BVH.
+//
+// Build (from this folder):
+//   g++ -O2 -march=native -std=c++11 -pthread -I../src/Code sphere_kernel_bench.cpp -o sphere_kernel_bench
+#include "scene.h"
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+// Random-spheres layout in the spirit of Coding_Weekend.cpp, scaled to the requested count
+Scene makeSpheres(int count) {
+    Scene scene;
+    auto material = std::make_shared<Lambertian>(Color(0.5, 0.5, 0.5));
+    double extent = sqrt(static_cast<double>(count));
+    for (int i = 0; i < count; ++i) {
+        Point3D center(random_double(-extent, extent), random_double(0, 2), random_double(-extent, extent));
+        scene.add(std::make_shared<Sphere>(center, 0.2, material));
+    }
+    return scene;
+}
+
+std::vector<Ray> makeRays(int count, double extent) {
+    std::vector<Ray> rays;
+    for (int i = 0; i < count; ++i) {
+        Point3D origin(random_double(-extent, extent), 5, random_double(-extent, extent));
+        Point3D target(random_double(-extent, extent), 0, random_double(-extent, extent));
+        rays.push_back(Ray(origin, target - origin));
+    }
+    return rays;
+}
+
+// Returns rays per second; the hit count is printed so the work cannot be optimised away
+template <typename TraceFn>
+double measure(const std::vector<Ray>& rays, TraceFn&& trace, long& hits) {
+    auto start = std::chrono::steady_clock::now();
+    hits = 0;
+    for (const Ray& ray : rays) {
+        hits += trace(ray);
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return rays.size() / elapsed.count();
+}
+
+void report(const char* name, double rays_per_second, double baseline, long hits) {
+    std::cout << "  " << std::left << std::setw(28) << name << std::right
+              << std::setw(10) << std::fixed << std::setprecision(2) << rays_per_second / 1e6 << " Mrays/s"
+              << std::setw(8) << std::setprecision(2) << rays_per_second / baseline << "x"
+              << "   (" << hits << " hits)\n";
+}
+
+int main() {
+    seed_random(2024);
+    std::cout << "Sphere kernel: " << SphereBatch().kernel_name() << " (" << SphereBatch::lanes << " lanes)\n";
+
+    int counts[] = {8, 64, 512, 4096};
+    for (int count : counts) {
+        Scene shapes = makeSpheres(count);
+        Scene packed = shapes;
+        packed.pack_spheres();
+        const SphereBatch& batch = packed.getSphereBatch();
+
+        int ray_count = std::max(20000, 4000000 / count);
+        std::vector<Ray> rays = makeRays(ray_count, sqrt(static_cast<double>(count)));
+        std::cout << count << " spheres, " << ray_count << " rays\n";
+
+        long hits;
+        Hit_record rec;
+        double baseline = measure(rays, [&](const Ray& r) {
+            return shapes.hit(r, Interval(0.001, infinity), rec);
+        }, hits);
+        report("linear, Sphere::hit", baseline, baseline, hits);
+
+        double soa_scalar = measure(rays, [&](const Ray& r) {
+            Interval t(0.001, infinity);
+            int index;
+            return batch.hit_scalar(r, 0, batch.size(), t, index);
+        }, hits);
+        report("linear, SoA scalar", soa_scalar, baseline, hits);
+
+        double soa_simd = measure(rays, [&](const Ray& r) {
+            Interval t(0.001, infinity);
+            int index;
+            return batch.hit(r, 0, batch.size(), t, index);
+        }, hits);
+        report("linear, SoA SIMD", soa_simd, baseline, hits);
+
+        shapes.build_bvh();
+        packed.build_bvh();
+        double bvh_scalar = measure(rays, [&](const Ray& r) {
+            return shapes.hit(r, Interval(0.001, infinity), rec);
+        }, hits);
+        report("BVH, Sphere::hit", bvh_scalar, baseline, hits);
+
+        double bvh_simd = measure(rays, [&](const Ray& r) {
+            return packed.hit(r, Interval(0.001, infinity), rec);
+        }, hits);
+        report("BVH, SoA SIMD leaves", bvh_simd, baseline, hits);
+    }
+    return 0;
+}
@@ -0,0 +1,81 @@
+// Microbenchmark of the core Vector3D operations over arrays of random vectors, for comparing the
+// scalar layout with the SIMD one of vector_simd.h.
+//
+// Build (from this folder), once per layout and optionally with -DRT_FLOAT:
+//   g++ -O2 -march=native -std=c++11 -I../src/Code vector_bench.cpp -o vector_bench
+//   g++ -O2 -march=native -std=c++11 -DRT_SIMD_VECTOR -I../src/Code vector_bench.cpp -o vector_bench_simd
+//
+// Run:
+//   ./vector_bench [--count N] [--repeats N]
+#include "math_utils.h"
+#include "vector.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Runs op over every index repeats times; returns nanoseconds per operation and adds the results to checksum
+// so that the work cannot be optimised away
+template <typename Op>
+double measure(int count, int repeats, Op&& op, double& checksum) {
+    auto start = std::chrono::steady_clock::now();
+    real sum = 0;
+    for (int r = 0; r < repeats; ++r) {
+        for (int i = 0; i < count; ++i) {
+            sum += op(i);
+        }
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    checksum += sum;
+    return elapsed.count() * 1e9 / (static_cast<double>(count) * repeats);
+}
+
+void report(const char* name, double nanoseconds) {
+    std::cout << "  " << std::left << std::setw(22) << name << std::right
+              << std::setw(8) << std::fixed << std::setprecision(2) << nanoseconds << " ns/op\n";
+}
+
+int main(int argc, char* argv[]) {
+    int count = 4096;
+    int repeats = 2000;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--count" && i + 1 < argc) {
+            count = std::atoi(argv[++i]);
+        } else if (arg == "--repeats" && i + 1 < argc) {
+            repeats = std::atoi(argv[++i]);
+        } else {
+            std::cerr << "Error: unknown or incomplete option '" << arg << "'" << std::endl;
+            return 1;
+        }
+    }
+
+    seed_random(2024);
+    std::vector<Vector3D> a, b, out(count);
+    std::vector<real> s;
+    for (int i = 0; i < count; ++i) {
+        a.push_back(Vector3D::random(-1, 1));
+        b.push_back(normalize(Vector3D::random(-1, 1)));
+        s.push_back(static_cast<real>(random_double(0.5, 2)));
+    }
+
+    std::cout << "Vector3D: " << vector_kernel_name() << ", " << sizeof(Vector3D) << " bytes, "
+              << (sizeof(real) == sizeof(float) ? "float" : "double") << "\n";
+    double checksum = 0;
+    // The vector results go through out[] and are summed by one component, which keeps the stores
+    // without turning the loop into a reduction over all three
+    report("a + b", measure(count, repeats, [&](int i) {out[i] = a[i] + b[i]; return out[i].x;}, checksum));
+    report("a * s", measure(count, repeats, [&](int i) {out[i] = a[i] * s[i]; return out[i].y;}, checksum));
+    report("a * b (Hadamard)", measure(count, repeats, [&](int i) {out[i] = a[i] * b[i]; return out[i].z;}, checksum));
+    report("dotProduct", measure(count, repeats, [&](int i) {return dotProduct(a[i], b[i]);}, checksum));
+    report("crossProduct", measure(count, repeats, [&](int i) {out[i] = crossProduct(a[i], b[i]); return out[i].x;}, checksum));
+    report("getLength", measure(count, repeats, [&](int i) {return getLength(a[i]);}, checksum));
+    report("normalize", measure(count, repeats, [&](int i) {out[i] = normalize(a[i]); return out[i].y;}, checksum));
+    report("reflect", measure(count, repeats, [&](int i) {out[i] = reflect(a[i], b[i]); return out[i].z;}, checksum));
+    report("a * s + b (axpy)", measure(count, repeats, [&](int i) {out[i] = a[i] * s[i] + b[i]; return out[i].x;}, checksum));
+    std::cout << "checksum " << checksum << "\n";
+    return 0;
+}
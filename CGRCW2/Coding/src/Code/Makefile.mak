@@ -2,7 +2,22 @@
 CXX = g++
 
 # Compiler flags
-CXXFLAGS = -Wall -std=c++11
+CXXFLAGS = -Wall -std=c++11 -O2 -march=native -pthread
+
+# Render statistics (--stats <file.json>): make STATS=1
+ifdef STATS
+CXXFLAGS += -DRT_STATS
+endif
+
+# Single precision geometry: make FLOAT=1
+ifdef FLOAT
+CXXFLAGS += -DRT_FLOAT
+endif
+
+# SIMD Vector3D (SSE lanes, see vector_simd.h): make SIMD_VECTOR=1
+ifdef SIMD_VECTOR
+CXXFLAGS += -DRT_SIMD_VECTOR
+endif
 
 # Target executable
 TARGET = raytracer
@@ -0,0 +1,97 @@
+#ifndef AABB_H
+#define AABB_H
+
+#include "math_utils.h"
+
+#include <algorithm>
+#include <limits>
+
+// Axis-aligned bounding box, stored as one interval per axis
+class AABB {
+    public:
+        Interval x, y, z;
+
+        // The default box is empty, so it can be grown with the union constructor
+        AABB() {}
+
+        AABB(const Interval& _x, const Interval& _y, const Interval& _z) : x(_x), y(_y), z(_z) {
+            pad_to_minimums();
+        }
+
+        // Box spanning two corner points, in any order
+        AABB(const Point3D& a, const Point3D& b) {
+            x = Interval(std::min(a.x, b.x), std::max(a.x, b.x));
+            y = Interval(std::min(a.y, b.y), std::max(a.y, b.y));
+            z = Interval(std::min(a.z, b.z), std::max(a.z, b.z));
+            pad_to_minimums();
+        }
+
+        // Smallest box enclosing both boxes
+        AABB(const AABB& box0, const AABB& box1) : x(box0.x, box1.x), y(box0.y, box1.y), z(box0.z, box1.z) {}
+
+        const Interval& axis(int n) const {
+            if (n == 1) return y;
+            if (n == 2) return z;
+            return x;
+        }
+
+        bool is_empty() const {
+            return x.min > x.max || y.min > y.max || z.min > z.max;
+        }
+
+        Point3D centroid() const {
+            return Point3D(0.5 * (x.min + x.max), 0.5 * (y.min + y.max), 0.5 * (z.min + z.max));
+        }
+
+        // Index of the axis along which the box is widest
+        int longest_axis() const {
+            if (x.size() > y.size()) {
+                return x.size() > z.size() ? 0 : 2;
+            }
+            return y.size() > z.size() ? 1 : 2;
+        }
+
+        // Used as the hit probability estimate by the SAH builder
+        double surface_area() const {
+            if (is_empty()) return 0;
+            double dx = x.size(), dy = y.size(), dz = z.size();
+            return 2 * (dx * dy + dy * dz + dz * dx);
+        }
+
+        // Slab test. inv_direction holds 1/direction per axis so the hot loop has no divisions.
+        // Written with min/max and a single final compare: traversal feeds this essentially random
+        // boxes, and per-axis early outs cost more in branch mispredictions than they save
+        bool hit(const Point3D& origin, const Vector3D& inv_direction, Interval ray_t) const {
+            slab(x, origin.x, inv_direction.x, ray_t);
+            slab(y, origin.y, inv_direction.y, ray_t);
+            slab(z, origin.z, inv_direction.z, ray_t);
+            return ray_t.max >= ray_t.min;
+        }
+
+        // The far distance of a slab is scaled up by 1 + 2 gamma(3), the bound on its rounding error, so that
+        // a ray grazing the box is not rejected by rounding (Pharr et al., PBR 3rd ed., 3.9.2).
+        // Without it, float builds show holes along the edges of boxes
+        static real far_scale() {
+            const real e = std::numeric_limits<real>::epsilon() / 2;
+            return 1 + 2 * (3 * e / (1 - 3 * e));
+        }
+
+    private:
+        // A NaN (origin on a slab plane of a zero direction component) leaves the interval untouched
+        static void slab(const Interval& ax, real origin, real inv_direction, Interval& ray_t) {
+            real t0 = (ax.min - origin) * inv_direction;
+            real t1 = (ax.max - origin) * inv_direction;
+            ray_t.min = std::max(ray_t.min, std::min(t0, t1));
+            ray_t.max = std::min(ray_t.max, std::max(t0, t1) * far_scale());
+        }
+
+        // Flat primitives (axis-aligned triangles) would otherwise give zero-width slabs
+        void pad_to_minimums() {
+            real delta = 0.0001;
+            if (x.size() < delta) x = x.expand(delta);
+            if (y.size() < delta) y = y.expand(delta);
+            if (z.size() < delta) z = z.expand(delta);
+        }
+};
+
+#endif // AABB_H
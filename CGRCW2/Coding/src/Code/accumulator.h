@@ -0,0 +1,160 @@
+#ifndef ACCUMULATOR_H
+#define ACCUMULATOR_H
+
+#include "color.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+// Running per-pixel sums of a render, kept across the passes of a progressive render and
+// saved to / restored from a checkpoint file so an interrupted render can be continued.
+class Accumulator {
+    public:
+        struct Pixel {
+            Vector3T<double> sum;           // Sum of the sample colors, before exposure, in double even in float builds
+            double mean = 0.0;              // Mean of the sample luminance (Welford, adaptive sampling only)
+            double m2 = 0.0;                // Sum of squared deviations from the mean (Welford)
+            int count = 0;                  // Samples taken so far
+        };
+
+        Accumulator() : width(0), height(0) {}
+        Accumulator(int width, int height) : width(width), height(height), pixels(width * height) {}
+
+        int getWidth() const {return width;}
+        int getHeight() const {return height;}
+
+        Pixel& at(int i, int j) {return pixels[j * width + i];}
+        const Pixel& at(int i, int j) const {return pixels[j * width + i];}
+
+        int minSamples() const {
+            int least = pixels.empty() ? 0 : pixels[0].count;
+            for (const Pixel& pixel : pixels) least = std::min(least, pixel.count);
+            return least;
+        }
+
+        long long totalSamples() const {
+            long long total = 0;
+            for (const Pixel& pixel : pixels) total += pixel.count;
+            return total;
+        }
+
+        // Checkpoint file: a header (magic, version, size, seed, scene key) followed by one record
+        // of five doubles and a 64-bit count per pixel, in native byte order. The sums are stored
+        // in double precision so that a resumed render adds up to exactly what an uninterrupted one would.
+        // The file is written under a temporary name and renamed, so a render killed while
+        // checkpointing still leaves the previous checkpoint intact.
+        bool save(const std::string& filename, std::uint64_t seed, std::uint64_t scene_key) const {
+            std::vector<char> bytes;
+            bytes.reserve(header_size + pixels.size() * record_size);
+            bytes.insert(bytes.end(), magic(), magic() + magic_size);
+            append(bytes, version);
+            append(bytes, static_cast<std::int32_t>(width));
+            append(bytes, static_cast<std::int32_t>(height));
+            append(bytes, seed);
+            append(bytes, scene_key);
+            for (const Pixel& pixel : pixels) {
+                append(bytes, pixel.sum.x);
+                append(bytes, pixel.sum.y);
+                append(bytes, pixel.sum.z);
+                append(bytes, pixel.mean);
+                append(bytes, pixel.m2);
+                append(bytes, static_cast<std::int64_t>(pixel.count));
+            }
+
+            std::string temporary = filename + ".tmp";
+            {
+                std::ofstream file(temporary, std::ios::out | std::ios::binary);
+                if (!file.is_open() || !file.write(bytes.data(), bytes.size())) {
+                    std::cerr << "Error: Could not write checkpoint file " << temporary << std::endl;
+                    return false;
+                }
+            }
+#ifdef _WIN32
+            std::remove(filename.c_str());     // rename() does not replace existing files on Windows
+#endif
+            if (std::rename(temporary.c_str(), filename.c_str()) != 0) {
+                std::cerr << "Error: Could not rename " << temporary << " to " << filename << std::endl;
+                return false;
+            }
+            return true;
+        }
+
+        // Restore the sums from a checkpoint written by save() for the same image size, seed and scene.
+        // Returns false, leaving the accumulator untouched, if the file is missing or does not match
+        bool load(const std::string& filename, std::uint64_t seed, std::uint64_t scene_key) {
+            std::ifstream file(filename, std::ios::in | std::ios::binary);
+            if (!file.is_open()) {
+                std::cerr << "Error: Could not open checkpoint file " << filename << std::endl;
+                return false;
+            }
+            std::vector<char> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+            if (bytes.size() < header_size || std::memcmp(bytes.data(), magic(), magic_size) != 0) {
+                std::cerr << "Error: " << filename << " is not a checkpoint file" << std::endl;
+                return false;
+            }
+
+            size_t offset = magic_size;
+            std::uint32_t file_version = read<std::uint32_t>(bytes, offset);
+            std::int32_t file_width = read<std::int32_t>(bytes, offset);
+            std::int32_t file_height = read<std::int32_t>(bytes, offset);
+            std::uint64_t file_seed = read<std::uint64_t>(bytes, offset);
+            std::uint64_t file_scene_key = read<std::uint64_t>(bytes, offset);
+            if (file_version != version) {
+                std::cerr << "Error: Checkpoint " << filename << " has version " << file_version << ", expected " << version << std::endl;
+                return false;
+            }
+            if (file_width != width || file_height != height || file_seed != seed || file_scene_key != scene_key) {
+                std::cerr << "Error: Checkpoint " << filename << " was rendered from another scene, settings, size or seed" << std::endl;
+                return false;
+            }
+            if (bytes.size() != header_size + pixels.size() * record_size) {
+                std::cerr << "Error: Checkpoint " << filename << " is truncated" << std::endl;
+                return false;
+            }
+
+            for (Pixel& pixel : pixels) {
+                pixel.sum.x = read<double>(bytes, offset);
+                pixel.sum.y = read<double>(bytes, offset);
+                pixel.sum.z = read<double>(bytes, offset);
+                pixel.mean = read<double>(bytes, offset);
+                pixel.m2 = read<double>(bytes, offset);
+                pixel.count = static_cast<int>(read<std::int64_t>(bytes, offset));
+            }
+            return true;
+        }
+
+    private:
+        static const char* magic() {return "RTCKPT1";}    // Eight bytes with the terminating zero
+        static const size_t magic_size = 8;
+        static const std::uint32_t version = 1;
+        static const size_t header_size = 8 + 4 + 4 + 4 + 8 + 8;
+        static const size_t record_size = 5 * sizeof(double) + sizeof(std::int64_t);
+
+        int width;
+        int height;
+        std::vector<Pixel> pixels;
+
+        template <typename T>
+        static void append(std::vector<char>& bytes, T value) {
+            char raw[sizeof(T)];
+            std::memcpy(raw, &value, sizeof(T));
+            bytes.insert(bytes.end(), raw, raw + sizeof(T));
+        }
+
+        template <typename T>
+        static T read(const std::vector<char>& bytes, size_t& offset) {
+            T value;
+            std::memcpy(&value, bytes.data() + offset, sizeof(T));
+            offset += sizeof(T);
+            return value;
+        }
+};
+
+#endif // ACCUMULATOR_H
@@ -0,0 +1,380 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include "aabb.h"
+#include "ray_packet.h"
+#include "stats.h"
+
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+// Bounding volume hierarchy over an indexed set of primitives.
+// The tree only knows primitive bounding boxes; the caller supplies the actual
+// intersection routine at traversal time, so the same tree works for the scene
+// shapes as well as for any other list of primitives.
+class BVH {
+    public:
+        // Nodes are stored depth first in one flat array. The left child of an
+        // interior node always directly follows it, so only the right child index is kept.
+        struct Node {
+            AABB box;
+            int  offset;    // Leaf: first entry in prim_indices. Interior: index of the right child
+            int  count;     // Number of primitives in a leaf, 0 for interior nodes
+            int  axis;      // Split axis of an interior node, used to visit the nearer child first
+        };
+
+        BVH() {}
+
+        bool empty() const {return nodes.empty();}
+        const std::vector<Node>& getNodes() const {return nodes;}
+        const std::vector<int>& getPrimIndices() const {return prim_indices;}
+
+        // Build the tree with the binned surface area heuristic (SAH).
+        // leaf_batch is the number of primitives the caller tests at once in a leaf (the SIMD width
+        // of a batched kernel); the SAH then counts intersection cost in batches and allows larger leaves.
+        void build(const std::vector<AABB>& prim_boxes, int leaf_batch = 1) {
+            nodes.clear();
+            prim_indices.clear();
+            if (prim_boxes.empty()) return;
+
+            boxes = &prim_boxes;
+            batch = std::max(1, leaf_batch);
+            max_leaf_size = std::max(8, 4 * batch);
+            centroids.resize(prim_boxes.size());
+            prim_indices.resize(prim_boxes.size());
+            for (size_t i = 0; i < prim_boxes.size(); ++i) {
+                centroids[i] = prim_boxes[i].centroid();
+                prim_indices[i] = static_cast<int>(i);
+            }
+
+            nodes.reserve(2 * prim_boxes.size());
+            build_node(0, static_cast<int>(prim_boxes.size()), 0);
+            nodes.shrink_to_fit();  // The reservation above is the worst case of one primitive per leaf
+
+            boxes = nullptr;
+            centroids.clear();
+            centroids.shrink_to_fit();
+        }
+
+        // Take over a tree built earlier by build() over prim_count primitives, e.g. one read back from a
+        // scene cache. Throws std::invalid_argument if a node refers outside the arrays
+        void assign(std::vector<Node> tree_nodes, std::vector<int> tree_prim_indices, size_t prim_count) {
+            int node_count = static_cast<int>(tree_nodes.size());
+            int index_count = static_cast<int>(tree_prim_indices.size());
+            std::vector<int> depth(tree_nodes.size(), 0);   // Children follow their parent, so one forward pass sees every parent first
+            for (int i = 0; i < node_count; ++i) {
+                const Node& node = tree_nodes[i];
+                bool valid = node.count > 0
+                    ? node.offset >= 0 && node.count <= index_count - node.offset
+                    : node.count == 0 && node.offset > i + 1 && node.offset < node_count && node.axis >= 0 && node.axis < 3;
+                if (!valid || depth[i] >= max_stack_size) {
+                    throw std::invalid_argument("BVH node out of range");
+                }
+                if (node.count == 0) {
+                    depth[i + 1] = depth[node.offset] = depth[i] + 1;
+                }
+            }
+            for (int prim : tree_prim_indices) {
+                if (prim < 0 || static_cast<size_t>(prim) >= prim_count) {
+                    throw std::invalid_argument("BVH primitive index out of range");
+                }
+            }
+            nodes = std::move(tree_nodes);
+            prim_indices = std::move(tree_prim_indices);
+        }
+
+        // Closest-hit traversal.
+        // intersect_prim(prim, ray_t) tests one primitive; on a hit it must return true and
+        // shrink ray_t.max to the hit distance, so that farther nodes get culled.
+        template <typename IntersectFn>
+        bool hit(const Ray& r, Interval ray_t, IntersectFn&& intersect_prim) const {
+            return hit_leaves(r, ray_t, [&](int first, int count, Interval& t) {
+                bool hit_anything = false;
+                for (int i = 0; i < count; ++i) {
+                    if (intersect_prim(prim_indices[first + i], t)) {
+                        hit_anything = true;
+                    }
+                }
+                return hit_anything;
+            });
+        }
+
+        // Same traversal, but every leaf is handed over whole as the range [first, first + count)
+        // of prim_indices, for callers that store their primitives in tree order and test them in batches.
+        template <typename LeafFn>
+        bool hit_leaves(const Ray& r, Interval ray_t, LeafFn&& intersect_leaf) const {
+            if (nodes.empty()) return false;
+
+            Point3D origin = r.getOrigin();
+            Vector3D direction = r.getDirection();
+            Vector3D inv_direction(1.0 / direction.x, 1.0 / direction.y, 1.0 / direction.z);
+            bool dir_is_negative[3] = {direction.x < 0, direction.y < 0, direction.z < 0};
+
+            bool hit_anything = false;
+            int stack[max_stack_size];
+            int stack_size = 0;
+            int current = 0;
+
+            while (true) {
+                const Node& node = nodes[current];
+                RT_STATS_TEST(PRIM_BVH_NODE);
+                if (node.box.hit(origin, inv_direction, ray_t)) {
+                    if (node.count > 0) {
+                        if (intersect_leaf(node.offset, node.count, ray_t)) {
+                            hit_anything = true;
+                        }
+                    } else if (dir_is_negative[node.axis]) {
+                        // Ray travels towards the right child first
+                        stack[stack_size++] = current + 1;
+                        current = node.offset;
+                        continue;
+                    } else {
+                        stack[stack_size++] = node.offset;
+                        current = current + 1;
+                        continue;
+                    }
+                }
+                if (stack_size == 0) break;
+                current = stack[--stack_size];
+            }
+
+            return hit_anything;
+        }
+
+        // Closest-hit traversal of a coherent packet of rays, visiting the nodes in the order every one of
+        // its rays would visit them alone. A node is skipped if the packet's frustum misses its box,
+        // otherwise the rays that hit it are found with one SIMD slab test per lane group.
+        // intersect_leaf(first, count, mask) tests the leaf's range of prim_indices against the rays of the
+        // lanes set in mask and must shrink their packet.t_max to their closest hits
+        template <typename LeafFn>
+        void hit_packet(RayPacket& packet, LeafFn&& intersect_leaf) const {
+            if (nodes.empty()) return;
+
+            int stack[max_stack_size];
+            int stack_size = 0;
+            int current = 0;
+
+            while (true) {
+                const Node& node = nodes[current];
+                RT_STATS_TEST(PRIM_BVH_NODE);
+                unsigned mask = packet.frustum_misses(node.box) ? 0 : packet.slab_mask(node.box);
+                if (mask != 0) {
+                    if (node.count > 0) {
+                        intersect_leaf(node.offset, node.count, mask);
+                        packet.update_far_bound();
+                    } else if (packet.dir_is_negative[node.axis]) {
+                        stack[stack_size++] = current + 1;
+                        current = node.offset;
+                        continue;
+                    } else {
+                        stack[stack_size++] = node.offset;
+                        current = current + 1;
+                        continue;
+                    }
+                }
+                if (stack_size == 0) break;
+                current = stack[--stack_size];
+            }
+        }
+
+        // Any-hit traversal for shadow rays. Children are visited in storage order and the
+        // traversal stops as soon as occluded_prim(prim) returns true for any primitive in range.
+        template <typename OccludedFn>
+        bool any_hit(const Ray& r, Interval ray_t, OccludedFn&& occluded_prim) const {
+            return any_hit_leaves(r, ray_t, [&](int first, int count) {
+                for (int i = 0; i < count; ++i) {
+                    if (occluded_prim(prim_indices[first + i])) {
+                        return true;
+                    }
+                }
+                return false;
+            });
+        }
+
+        // Any-hit traversal handing over whole leaves, see hit_leaves()
+        template <typename LeafFn>
+        bool any_hit_leaves(const Ray& r, Interval ray_t, LeafFn&& occluded_leaf) const {
+            if (nodes.empty()) return false;
+
+            Point3D origin = r.getOrigin();
+            Vector3D direction = r.getDirection();
+            Vector3D inv_direction(1.0 / direction.x, 1.0 / direction.y, 1.0 / direction.z);
+
+            int stack[max_stack_size];
+            int stack_size = 0;
+            int current = 0;
+
+            while (true) {
+                const Node& node = nodes[current];
+                RT_STATS_TEST(PRIM_BVH_NODE);
+                if (node.box.hit(origin, inv_direction, ray_t)) {
+                    if (node.count > 0) {
+                        if (occluded_leaf(node.offset, node.count)) {
+                            return true;
+                        }
+                    } else {
+                        stack[stack_size++] = node.offset;
+                        current = current + 1;
+                        continue;
+                    }
+                }
+                if (stack_size == 0) break;
+                current = stack[--stack_size];
+            }
+
+            return false;
+        }
+
+    private:
+        static const int num_bins = 16;
+        static const int max_sah_depth = 48;    // Deeper subtrees fall back to median splits, which bounds the stack depth
+        static const int max_stack_size = 128;
+
+        std::vector<Node> nodes;
+        std::vector<int> prim_indices;
+
+        // Only valid while building
+        const std::vector<AABB>* boxes = nullptr;
+        int batch = 1;
+        int max_leaf_size = 8;
+        std::vector<Point3D> centroids;
+
+        struct Bin {
+            AABB box;
+            int count = 0;
+        };
+
+        static double component(const Point3D& p, int axis) {
+            return axis == 0 ? p.x : (axis == 1 ? p.y : p.z);
+        }
+
+        void make_leaf(int node_index, const AABB& box, int start, int end) {
+            nodes[node_index].box = box;
+            nodes[node_index].offset = start;
+            nodes[node_index].count = end - start;
+            nodes[node_index].axis = 0;
+        }
+
+        // Build the subtree over prim_indices[start, end) and return the index of its root
+        int build_node(int start, int end, int depth) {
+            int node_index = static_cast<int>(nodes.size());
+            nodes.push_back(Node());
+
+            AABB box;
+            Interval centroid_bounds[3];
+            for (int i = start; i < end; ++i) {
+                box = AABB(box, (*boxes)[prim_indices[i]]);
+                const Point3D& c = centroids[prim_indices[i]];
+                for (int axis = 0; axis < 3; ++axis) {
+                    double value = component(c, axis);
+                    centroid_bounds[axis] = Interval(centroid_bounds[axis], Interval(value, value));
+                }
+            }
+
+            int count = end - start;
+            if (count <= std::max(2, batch)) {
+                make_leaf(node_index, box, start, end);
+                return node_index;
+            }
+
+            // Evaluate every bin boundary on every axis and keep the cheapest split
+            int best_axis = -1;
+            int best_split = -1;
+            double best_cost = infinity;
+
+            for (int axis = 0; axis < 3 && depth < max_sah_depth; ++axis) {
+                const Interval& extent = centroid_bounds[axis];
+                if (extent.size() <= 0) continue;   // All centroids coincide along this axis
+
+                Bin bins[num_bins];
+                double scale = num_bins / extent.size();
+                for (int i = start; i < end; ++i) {
+                    int b = bin_index(centroids[prim_indices[i]], axis, extent.min, scale);
+                    bins[b].count++;
+                    bins[b].box = AABB(bins[b].box, (*boxes)[prim_indices[i]]);
+                }
+
+                // Sweep from the right to get the area and count of every right-hand side
+                double right_area[num_bins];
+                int right_count[num_bins];
+                AABB right_box;
+                int right_total = 0;
+                for (int b = num_bins - 1; b > 0; --b) {
+                    right_box = AABB(right_box, bins[b].box);
+                    right_total += bins[b].count;
+                    right_area[b] = right_box.surface_area();
+                    right_count[b] = right_total;
+                }
+
+                AABB left_box;
+                int left_total = 0;
+                for (int b = 0; b < num_bins - 1; ++b) {
+                    left_box = AABB(left_box, bins[b].box);
+                    left_total += bins[b].count;
+                    if (left_total == 0 || right_count[b + 1] == 0) continue;
+
+                    double cost = batches(left_total) * left_box.surface_area() + batches(right_count[b + 1]) * right_area[b + 1];
+                    if (cost < best_cost) {
+                        best_cost = cost;
+                        best_axis = axis;
+                        best_split = b + 1;
+                    }
+                }
+            }
+
+            // Cost of a leaf vs. one traversal step plus the expected child intersections
+            double parent_area = box.surface_area();
+            double leaf_cost = batches(count);
+            double split_cost = parent_area > 0 ? 1.0 + best_cost / parent_area : infinity;
+
+            int mid;
+            if (best_axis < 0) {
+                // Either the centroids coincide or the tree got too deep: split at the median
+                if (count <= max_leaf_size) {
+                    make_leaf(node_index, box, start, end);
+                    return node_index;
+                }
+                best_axis = box.longest_axis();
+                mid = start + count / 2;
+                std::nth_element(prim_indices.data() + start, prim_indices.data() + mid, prim_indices.data() + end, [&](int a, int b) {
+                    return component(centroids[a], best_axis) < component(centroids[b], best_axis);
+                });
+            } else {
+                if (count <= max_leaf_size && leaf_cost <= split_cost) {
+                    make_leaf(node_index, box, start, end);
+                    return node_index;
+                }
+
+                const Interval& extent = centroid_bounds[best_axis];
+                double scale = num_bins / extent.size();
+                int* first = prim_indices.data() + start;
+                int* last = prim_indices.data() + end;
+                int* split = std::partition(first, last, [&](int prim) {
+                    return bin_index(centroids[prim], best_axis, extent.min, scale) < best_split;
+                });
+                mid = static_cast<int>(split - prim_indices.data());
+            }
+
+            build_node(start, mid, depth + 1);
+            int right = build_node(mid, end, depth + 1);
+
+            nodes[node_index].box = box;
+            nodes[node_index].offset = right;
+            nodes[node_index].count = 0;
+            nodes[node_index].axis = best_axis;
+            return node_index;
+        }
+
+        // Intersection cost of n primitives, in units of one batched test
+        int batches(int n) const {
+            return (n + batch - 1) / batch;
+        }
+
+        int bin_index(const Point3D& centroid, int axis, double min, double scale) const {
+            int b = static_cast<int>((component(centroid, axis) - min) * scale);
+            return std::max(0, std::min(num_bins - 1, b));
+        }
+};
+
+#endif // BVH_H
@@ -3,11 +3,23 @@
 
 #include "math_utils.h"
 
+#include "accumulator.h"
 #include "color.h"
+#include "framebuffer.h"
 #include "scene_reader.h"
 #include "material.h"
-
+#include "integrator.h"
+#include "ray_counters.h"
+#include "render_mode.h"
+#include "stats.h"
+#include "wavefront.h"
+
+#include <algorithm>
+#include <atomic>
 #include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 class Camera {
   public:
@@ -24,6 +36,32 @@ class Camera {
     Point3D     lookat      = Point3D(0,0,0);   // Point camera is looking at
     Vector3D    vup         = Vector3D(0,1,0);     // Camera-relative "up" direction
 
+    int          num_threads = 0;    // Worker threads used to render (0 = one per hardware thread)
+    int          tile_size   = 16;   // Width and height in pixels of the tiles handed to the workers
+    std::uint64_t seed       = 0;    // Base seed of the per-pixel, per-sample random streams (see sampler.h)
+
+    // Adaptive sampling: every pixel takes min_samples, then keeps taking batches of min_samples
+    // until the relative standard error of its luminance drops below error_threshold or it reaches max_samples
+    bool        adaptive        = false;
+    int         min_samples     = 8;
+    int         max_samples     = 256;
+    double      error_threshold = 0.02;
+
+    bool        wavefront = false;  // Trace the samples of a tile breadth first with WavefrontIntegrator instead of recursing
+    int         packet_size = 16;   // Intersect camera rays in packets of this many (4, 8 or 16) consecutive rays, 0 = one at a time
+    int         roulette_depth = 3; // Bounces before Russian roulette may end a path (0 = never); max_depth stays the hard cap
+
+    // Progressive rendering: the image is rendered in passes of pass_samples samples per pixel
+    // (0 = a single pass) and the running sums are written to checkpoint_file after every pass.
+    // With resume, render() first restores the sums from checkpoint_file and only adds the samples
+    // still missing, continuing each pixel's sample sequence where the checkpoint left off.
+    int         pass_samples = 0;
+    std::string checkpoint_file;
+    bool        resume = false;
+    std::uint64_t scene_key = 0;    // Identifies the scene; with the estimator's settings (see checkpointKey) it keys the checkpoint
+
+    RayCounters ray_counts;         // Rays traced by the last render() call, summed over all threads
+
 
     void modifyCamera(SceneReader& scene_reader) {
         image_width = scene_reader.getCameraWidth();
@@ -39,29 +77,68 @@ class Camera {
         auto cameraUp = scene_reader.getCameraUp();
         vup = Vector3D(cameraUp[0], cameraUp[1], cameraUp[2]);
 
+        adaptive = scene_reader.getCameraAdaptive();
+        min_samples = scene_reader.getCameraMinSamples();
+        max_samples = scene_reader.getCameraMaxSamples();
+        error_threshold = scene_reader.getCameraErrorThreshold();
+        if (min_samples < 2) {
+            std::cerr << "Error: 'minSamples' must be at least 2. Using 2" << std::endl;
+            min_samples = 2;
+        }
+        if (max_samples < min_samples) {
+            std::cerr << "Error: 'maxSamples' is smaller than 'minSamples'. Using " << min_samples << std::endl;
+            max_samples = min_samples;
+        }
+
         //Later, we will add more parameters here*/
         // Functions to do: getMaxDepth, getSamplesPerPixel, getAspectRatio, getImageWidth
     }
 
-    void render(const Scene& scene, const Color&background, const std::string& render_mode) {
+    // Render the scene into a framebuffer holding the average radiance of every pixel
+    Framebuffer render(const Scene& scene, const Color&background, RenderMode render_mode) {
+        RT_STATS_TIMER(STAGE_RENDER);
         initialize();
 
-        std::cout << "P3\n" << image_width << ' ' << image_height << "\n255\n";
+        Accumulator accumulator(image_width, image_height);
+        std::uint64_t key = checkpointKey(scene, render_mode);
+        if (resume && !checkpoint_file.empty()) {
+            if (accumulator.load(checkpoint_file, seed, key)) {
+                std::clog << "Resuming from " << checkpoint_file << ": "
+                          << static_cast<double>(accumulator.totalSamples()) / (image_width * image_height) << " samples per pixel so far\n";
+            } else {
+                std::clog << "Starting over\n";
+            }
+        }
+
+        // Every pass raises the per-pixel sample limit by pass_samples, up to the total
+        int total_samples = adaptive ? max_samples : samples_per_pixel;
+        int step = pass_samples > 0 ? pass_samples : total_samples;
+        ray_counts = RayCounters();
+        for (int limit = std::min(accumulator.minSamples() + step, total_samples); ; limit = std::min(limit + step, total_samples)) {
+            if (pass_samples > 0) {
+                std::clog << "Pass up to " << limit << " of " << total_samples << " samples per pixel\n";
+            }
+            render_pass(scene, background, render_mode, accumulator, limit);
+            if (!checkpoint_file.empty()) {
+                accumulator.save(checkpoint_file, seed, key);
+            }
+            if (limit >= total_samples) break;
+        }
 
+        Framebuffer framebuffer(image_width, image_height);
         for (int j = 0; j < image_height; ++j) {
-            std::clog << "\rScanlines remaining: " << (image_height - j) << ' ' << std::flush;
             for (int i = 0; i < image_width; ++i) {
-                Color pixel_color(0, 0, 0);
-                for (int sample = 0; sample < samples_per_pixel; ++sample) {
-                    Ray r = get_ray(i, j);
-                    pixel_color += ray_color(r, max_depth, scene, background, render_mode);
-                }
-                pixel_color = exposure * pixel_color;
-                writeColor(std::cout, pixel_color, samples_per_pixel);
+                const Accumulator::Pixel& pixel = accumulator.at(i, j);
+                framebuffer.at(i, j) = pixel.count > 0 ? Color((exposure * pixel.sum) * (1.0 / pixel.count)) : Color(0, 0, 0);
+                framebuffer.sampleCount(i, j) = pixel.count;
             }
         }
 
-        std::clog << "\rDone.                 \n";
+        if (adaptive) {
+            std::clog << "Adaptive sampling: " << static_cast<double>(accumulator.totalSamples()) / (image_width * image_height)
+                      << " samples per pixel on average (min " << min_samples << ", max " << max_samples << ")\n";
+        }
+        return framebuffer;
     }
 
   private:
@@ -76,6 +153,157 @@ class Camera {
     /*double      viewport_height;//
     double      viewport_width;*/
 
+    // Key of the checkpoint: scene_key and every setting that changes what a sample estimates, so that
+    // --resume does not mix in samples of another render mode, depth, roulette or light sampling
+    std::uint64_t checkpointKey(const Scene& scene, RenderMode render_mode) const {
+        std::uint64_t key = hash_combine(scene_key, scene.samplingKey());
+        key = hash_combine(key, static_cast<std::uint64_t>(render_mode));
+        key = hash_combine(key, static_cast<std::uint64_t>(max_depth));
+        return hash_combine(key, static_cast<std::uint64_t>(roulette_depth));
+    }
+
+    // Add samples to every pixel of the image until it has limit samples (or, with adaptive sampling, has converged)
+    void render_pass(const Scene& scene, const Color& background, RenderMode render_mode, Accumulator& accumulator, int limit) {
+        // The image is split into tiles that the workers pull from a shared counter.
+        int tiles_x = (image_width + tile_size - 1) / tile_size;
+        int tiles_y = (image_height + tile_size - 1) / tile_size;
+        int tile_count = tiles_x * tiles_y;
+
+        std::atomic<int> next_tile(0);
+        std::atomic<int> tiles_done(0);
+        std::mutex log_mutex;
+
+        auto worker = [&]() {
+            // Per-thread integrators; the wavefront one keeps its queues across tiles
+            RecursiveIntegrator recursive(scene, background, render_mode, max_depth, packet_size, roulette_depth);
+            WavefrontIntegrator breadth_first(scene, background, render_mode, max_depth, packet_size, roulette_depth);
+            RayCounters counted_before = thread_ray_counters();
+            for (int tile = next_tile++; tile < tile_count; tile = next_tile++) {
+                if (wavefront) {
+                    render_tile(tile, tiles_x, breadth_first, accumulator, limit);
+                } else {
+                    render_tile(tile, tiles_x, recursive, accumulator, limit);
+                }
+
+                int done = ++tiles_done;
+                std::lock_guard<std::mutex> lock(log_mutex);
+                std::clog << "\rTiles remaining: " << (tile_count - done) << ' ' << std::flush;
+            }
+
+            // Add this thread's rays to the render's total
+            RT_STATS_MERGE();
+            std::lock_guard<std::mutex> lock(log_mutex);
+            ray_counts += thread_ray_counters() - counted_before;
+        };
+
+        int thread_count = num_threads > 0 ? num_threads : static_cast<int>(std::thread::hardware_concurrency());
+        thread_count = std::max(1, std::min(thread_count, tile_count));
+
+        std::vector<std::thread> workers;
+        for (int t = 1; t < thread_count; ++t) {
+            workers.emplace_back(worker);
+        }
+        worker();   // The calling thread renders tiles as well
+        for (auto& thread : workers) {
+            thread.join();
+        }
+
+        std::clog << "\rDone.                 \n";
+    }
+
+    // True if a pixel still needs samples in a pass that ends at limit samples
+    bool needs_samples(const Accumulator::Pixel& pixel, int limit) const {
+        return pixel.count < limit && !(adaptive && converged(pixel));
+    }
+
+    // Samples a pixel should have at the end of its next round
+    int next_target(const Accumulator::Pixel& pixel, int limit) const {
+        return adaptive ? std::min(limit, pixel.count + min_samples) : limit;
+    }
+
+    // Add samples to every pixel of one tile of the accumulator, up to limit samples per pixel.
+    // Each sample draws from its own (seed, pixel, sample) stream, so the image does not depend on which thread renders which tile,
+    // nor on how the samples are split into passes.
+    // The tile is sampled in rounds: the first round takes every pixel up to the limit (or up to min_samples more samples),
+    // with adaptive sampling the pixels whose error is still too large get further rounds of min_samples.
+    template <typename Integrator>
+    void render_tile(int tile, int tiles_x, Integrator& integrator, Accumulator& accumulator, int limit) const {
+        int x0 = (tile % tiles_x) * tile_size;
+        int y0 = (tile / tiles_x) * tile_size;
+        int x1 = std::min(x0 + tile_size, image_width);
+        int y1 = std::min(y0 + tile_size, image_height);
+        int tile_width = x1 - x0;
+
+        std::vector<int> targets((x1 - x0) * (y1 - y0));
+        std::vector<int> active;
+        for (size_t p = 0; p < targets.size(); ++p) {
+            const Accumulator::Pixel& pixel = accumulator.at(x0 + static_cast<int>(p) % tile_width, y0 + static_cast<int>(p) / tile_width);
+            if (needs_samples(pixel, limit)) {
+                targets[p] = next_target(pixel, limit);
+                active.push_back(static_cast<int>(p));
+            }
+        }
+
+        std::vector<Ray> rays;
+        std::vector<Sampler> samplers;
+        std::vector<Color> colors;
+        while (!active.empty()) {
+            // Generate the camera rays of this round
+            rays.clear();
+            samplers.clear();
+            {
+                RT_STATS_TIMER(STAGE_CAMERA_RAYS);
+                for (int p : active) {
+                    int i = x0 + p % tile_width;
+                    int j = y0 + p / tile_width;
+                    for (int sample = accumulator.at(i, j).count; sample < targets[p]; ++sample) {
+                        start_sample(seed, static_cast<std::uint64_t>(j) * image_width + i, sample);
+                        rays.push_back(get_ray(i, j));
+                        samplers.push_back(thread_sampler());
+                    }
+                }
+            }
+
+            thread_ray_counters().primary += rays.size();
+            integrator.trace(rays, samplers, colors);
+
+            // Fold the samples in per pixel, in sample order, and keep the pixels that need another round
+            size_t k = 0;
+            size_t still_active = 0;
+            for (int p : active) {
+                Accumulator::Pixel& pixel = accumulator.at(x0 + p % tile_width, y0 + p / tile_width);
+                for (; pixel.count < targets[p]; ++k) {
+                    add_sample(pixel, colors[k]);
+                }
+                if (adaptive && needs_samples(pixel, limit)) {
+                    targets[p] = next_target(pixel, limit);
+                    active[still_active++] = p;
+                }
+            }
+            active.resize(still_active);
+        }
+    }
+
+    void add_sample(Accumulator::Pixel& estimate, const Color& sample_color) const {
+        estimate.sum += Vector3T<double>(sample_color);
+        estimate.count++;
+        if (adaptive) {
+            double l = luminance(exposure * sample_color);
+            double delta = l - estimate.mean;
+            estimate.mean += delta / estimate.count;
+            estimate.m2 += delta * (l - estimate.mean);
+        }
+    }
+
+    // True once the relative standard error of the pixel's luminance is below error_threshold, or it has max_samples
+    bool converged(const Accumulator::Pixel& estimate) const {
+        const double min_luminance = 0.01;  // Keeps the relative error of near-black pixels finite
+        if (estimate.count >= max_samples) return true;
+        if (estimate.count < 2) return false;
+        double standard_error = std::sqrt(estimate.m2 / (estimate.count - 1) / estimate.count);
+        return standard_error <= error_threshold * std::max(estimate.mean, min_luminance);
+    }
+
     void initialize() {
       image_height = static_cast<int>(image_width / aspect_ratio);
       image_height = (image_height < 1) ? 1 : image_height;
@@ -131,43 +359,6 @@ class Camera {
         auto py = -0.5 + random_double();
         return (px * pixel_delta_u) + (py * pixel_delta_v);
     }
-
-    Color ray_color(const Ray& r, int depth, const Scene& scene, const Color background, const std::string render_mode) const {
-        Hit_record rec;
-
-        double diffuseFactor = 0.5;
-
-        // If we've exceeded the ray bounce limit, no more light is gathered.
-        if (depth <= 0) {
-            return background;          // Might change to black
-        }
-
-
-        // binary returns red if hit, normal returns normal as color, diffuse returns random diffuse color
-        if (scene.hit(r, Interval(0.001, infinity), rec)) {
-            if(render_mode == "binary") {
-                return Color(1, 0, 0);
-            } else if (render_mode == "normal") {
-                return 0.5 * (rec.normal + Color(1,1,1));
-            } else if (render_mode == "diffuse") {
-                Vector3D direction = random_in_hemisphere(rec.normal);
-                return diffuseFactor * ray_color(Ray(rec.p, direction), depth-1, scene, background, render_mode);
-            } else if (render_mode == "phong") {
-                Ray scattered;
-                Color attenuation;
-                Color light_contribution = scene.calculateLightingForHitPoint(r, rec);
-                if (rec.mat_ptr->scatter(r, rec.normal, rec.p, rec.front_face, attenuation, scattered, light_contribution)) {
-                    return attenuation * ray_color(scattered, depth-1, scene, background, render_mode);
-                }
-                return Color(0, 1, 0);
-            } else {
-                std::cerr << "Error: Invalid render mode '" << render_mode << "'" << std::endl;
-                exit(1);
-            }
-        } else {
-            return background;
-        }
-    }
 };
 
 #endif
\ No newline at end of file
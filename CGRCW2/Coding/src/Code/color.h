@@ -11,6 +11,11 @@ Color reinhard_tone_mapping(const Color& color) {
     return color / (color + Color(1.0, 1.0, 1.0));
 }
 
+// Relative luminance (Rec. 709 weights)
+double luminance(const Color& color) {
+    return 0.2126 * color.x + 0.7152 * color.y + 0.0722 * color.z;
+}
+
 // Function to scale the color values from 0-1 to 0-255
 void writeColor(std::ostream &out, const Color& color, int samples_per_pixel) {
     // Write the translated [0,255] value of each color component
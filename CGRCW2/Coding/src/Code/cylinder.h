@@ -2,135 +2,179 @@
 #define CYLINDER_H
 
 #include "shape.h"
+#include "stats.h"
 #include <algorithm>
 
+// Plain cylinder record: what the scene stores per cylinder and intersects without a virtual call.
+// Cylinder::primitive() normalizes the axis and places the top cap once; Cylinder::validate() rejects a zero axis
+struct CylinderPrimitive {
+    Point3D center;             // Center of the bottom cap
+    Vector3D axis;              // Unit axis
+    Point3D top;                // Center of the top cap, center + height * axis
+    real radius;
+    real radius_squared;
+    real height;
+    std::uint32_t material;     // Index into the scene's material table
+
+    // Check if ray intersects cylinder, update the hit record if it does
+    bool hit(const Ray& ray, Interval ray_t, Hit_record& record) const {
+        RT_STATS_TEST(PRIM_CYLINDER);
+        real epsilon = 0.00001;
+        Vector3D oc = ray.getOrigin() - center;
+        Vector3D direction = ray.getDirection();
+        real oc_axial = dotProduct(oc, axis);
+        real direction_axial = dotProduct(direction, axis);
+
+        // Calculate the discriminant for the intersection with the infinite cylinder
+        Vector3D oc_perp = oc - oc_axial * axis;
+        Vector3D direction_perp = direction - direction_axial * axis;
+        real half_b = dotProduct(oc_perp, direction_perp);
+        real a = dotProduct(direction_perp, direction_perp);
+        real c = dotProduct(oc_perp, oc_perp) - radius_squared;
+        real discriminant = half_b*half_b - a*c;
+
+        // If the discriminant is less than zero, the ray does not intersect the infinite cylinder
+        if (discriminant < 0) {
+            return false;
+        }
+
+        // Calculate the t values for the intersection points with the infinite cylinder
+        real sqrt_discriminant = std::sqrt(discriminant);
+        real t1 = (-half_b - sqrt_discriminant) / a;
+        real t2 = (-half_b + sqrt_discriminant) / a;
+
+        // Check if the intersection points are within the height of the cylinder
+        Vector3D p1 = ray.at(t1);
+        Vector3D p2 = ray.at(t2);
+        real p1_proj_length = dotProduct(p1 - center, axis);
+        real p2_proj_length = dotProduct(p2 - center, axis);
+
+        // Check if ray intersects cylinder caps: the bottom one through center, the top one through top
+        real t3 = -oc_axial / direction_axial - epsilon;
+        real t4 = dotProduct(top - ray.getOrigin(), axis) / direction_axial + epsilon;
+        Vector3D p3 = ray.at(t3);
+        Vector3D p4 = ray.at(t4);
+
+        bool intersectsCap1 = ray_t.contains(t3) && getLengthSquared(p3 - center) <= radius_squared;
+        bool intersectsCap2 = ray_t.contains(t4) && getLengthSquared(p4 - top) <= radius_squared;
+
+        bool intersectsBody = (Interval(0, height).contains(p1_proj_length))|| (Interval(0, height).contains(p2_proj_length));
+
+        // Initialize closest valid intersection
+        real tmin = std::numeric_limits<real>::max();
+        Vector3D normal;
+        Vector3D intersection;
+
+        // Check intersections with caps
+        if (intersectsCap1) {
+            tmin = t3;
+            intersection = p3;
+        }
+        if (intersectsCap2 && t4 < tmin) {
+            tmin = t4;
+            intersection = p4;
+        }
+
+        // Check intersections with body
+        if (intersectsBody) {
+            if (ray_t.contains(t1) && t1 < tmin && Interval(0, height).contains(p1_proj_length)) {
+                tmin = t1;
+                intersection = p1;
+            }
+            if (ray_t.contains(t2) && t2 < tmin && Interval(0, height).contains(p2_proj_length)) {
+                tmin = t2;
+                intersection = p2;
+            }
+        }
+
+        // Calculate normal
+        if (tmin == t1 || tmin == t2) {
+            Vector3D v = intersection - center;
+            Vector3D projection = dotProduct(v, axis) * axis;
+            normal = normalize(v - projection);
+        } else if (tmin == t3) {
+            normal = -axis;
+        } else if (tmin == t4) {
+            normal = axis;
+        }
+
+        // If the ray does not intersect the cylinder, return false
+        if (tmin < std::numeric_limits<real>::max()) {
+            // Update the hit record
+            record.set_face_normal(ray, normal);
+            record.t = tmin;
+            record.p = intersection;
+            record.material = material;
+
+            return true;
+        }
+
+        return false;
+    }
+
+    // Shadow ray test: returns at the first body or cap root inside ray_t, no normal or closest hit is worked out
+    bool occluded(const Ray& ray, Interval ray_t) const {
+        RT_STATS_TEST(PRIM_CYLINDER);
+        real epsilon = 0.00001;
+        Vector3D oc = ray.getOrigin() - center;
+        Vector3D direction = ray.getDirection();
+
+        real oc_axial = dotProduct(oc, axis);
+        real direction_axial = dotProduct(direction, axis);
+        Interval body(0, height);
+
+        // Body of the infinite cylinder, clipped to the height
+        Vector3D oc_perp = oc - oc_axial * axis;
+        Vector3D direction_perp = direction - direction_axial * axis;
+        real a = dotProduct(direction_perp, direction_perp);
+        real half_b = dotProduct(oc_perp, direction_perp);
+        real c = dotProduct(oc_perp, oc_perp) - radius_squared;
+        real discriminant = half_b * half_b - a * c;
+        if (discriminant >= 0) {
+            real sqrt_discriminant = std::sqrt(discriminant);
+            real t1 = (-half_b - sqrt_discriminant) / a;
+            real t2 = (-half_b + sqrt_discriminant) / a;
+            if (ray_t.contains(t1) && body.contains(oc_axial + t1 * direction_axial)) return true;
+            if (ray_t.contains(t2) && body.contains(oc_axial + t2 * direction_axial)) return true;
+        }
+
+        // Caps, with the same epsilon offsets as hit()
+        real t3 = -oc_axial / direction_axial - epsilon;
+        if (ray_t.contains(t3) && getLengthSquared(ray.at(t3) - center) <= radius_squared) return true;
+        real t4 = (height - oc_axial) / direction_axial + epsilon;
+        if (ray_t.contains(t4) && getLengthSquared(ray.at(t4) - top) <= radius_squared) return true;
+
+        return false;
+    }
+};
+
 class Cylinder : public Shape
 {
     public:
         Cylinder(Point3D _center, Vector3D _axis, double _radius, double _height, std::shared_ptr<Material> _material) : center(_center), axis(_axis), radius(_radius), height(_height), mat(_material) {}
-        // Check if ray intersects cylinder, update the hit record if it does
-        virtual bool hit(const Ray& ray, Interval ray_t, Hit_record& record, const Point3D* check_point) const override{
-            auto epsilon = 0.00001;
-            Vector3D oc = ray.getOrigin() - center;
-            Vector3D direction = ray.getDirection();
-            if (axis == Vector3D(0,0,0)) {
-                throw std::invalid_argument("Invalid axis (0,0,0) for Cylinder");
-            }
-            Vector3D normalized_cylinder_axis = normalize(axis);
-
-            // Project oc and direction onto the normalized cylinder axis
-            Vector3D oc_proj = dotProduct(oc, normalized_cylinder_axis) * normalized_cylinder_axis;
-            Vector3D direction_proj = dotProduct(direction, normalized_cylinder_axis) * normalized_cylinder_axis;
-
-            // Calculate the discriminant for the intersection with the infinite cylinder
-            Vector3D oc_perp = oc - oc_proj;
-            Vector3D direction_perp = direction - direction_proj;
-            double half_b = dotProduct(oc_perp, direction_perp);
-            double a = dotProduct(direction_perp, direction_perp);
-            double c = dotProduct(oc_perp, oc_perp) - radius * radius;
-            double discriminant = half_b*half_b - a*c;
-
-            // If the discriminant is less than zero, the ray does not intersect the infinite cylinder
-            if (discriminant < 0) {
-                return false;
-            }
-
-            // Calculate the t values for the intersection points with the infinite cylinder
-            double sqrt_discriminant = sqrt(discriminant);
-            double t1 = (-half_b - sqrt_discriminant) / a;
-            double t2 = (-half_b + sqrt_discriminant) / a;
-
-            // Check if the intersection points are within the height of the cylinder
-            Vector3D p1 = ray.at(t1);
-            Vector3D p2 = ray.at(t2);
-            double p1_proj_length = dotProduct(p1 - center, normalized_cylinder_axis);
-            double p2_proj_length = dotProduct(p2 - center, normalized_cylinder_axis);
-
-            // Check if ray intersects cylinder caps
-            Vector3D cap1_center = center; // bottom cap
-            Vector3D cap2_center = center + height * normalized_cylinder_axis; // top cap
-            double t3 = dotProduct(cap1_center - ray.getOrigin(), normalized_cylinder_axis) / dotProduct(ray.getDirection(), normalized_cylinder_axis) - epsilon;
-            double t4 = dotProduct(cap2_center - ray.getOrigin(), normalized_cylinder_axis) / dotProduct(ray.getDirection(), normalized_cylinder_axis) + epsilon;
-            Vector3D p3 = ray.at(t3);
-            Vector3D p4 = ray.at(t4);
-
-            double radiusSquared = radius * radius;
-            bool intersectsCap1 = t3 >= 0 && getLengthSquared(p3 - cap1_center) <= radiusSquared;
-            bool intersectsCap2 = t4 >= 0 && getLengthSquared(p4 - cap2_center) <= radiusSquared;
-
-            bool intersectsBody = (Interval(0, height).contains(p1_proj_length))|| (Interval(0, height).contains(p2_proj_length));
-
-            // Initialize closest valid intersection
-            double tmin = std::numeric_limits<double>::max();
-            Vector3D normal;
-            Vector3D intersection;
-
-            // Check intersections with caps
-            if (intersectsCap1) {
-                tmin = t3;
-                intersection = p3;
-            }
-            if (intersectsCap2 && t4 < tmin) {
-                tmin = t4;
-                intersection = p4;
-            }
 
-            // Check intersections with body
-            if (intersectsBody) {
-                if (t1 >= 0 && t1 < tmin && Interval(0, height).contains(p1_proj_length)) {
-                    tmin = t1;
-                    intersection = p1;
-                }
-                if (t2 >= 0 && t2 < tmin && Interval(0, height).contains(p2_proj_length)) {
-                    tmin = t2;
-                    intersection = p2;
-                }
-            }
+        // The record the scene intersects this cylinder through
+        CylinderPrimitive primitive() const {
+            Vector3D unit_axis = normalize(axis);
+            CylinderPrimitive p = {center, unit_axis, center + height * unit_axis, radius, radius * radius, height, material_id};
+            return p;
+        }
 
-            // Calculate normal
-            if (tmin == t1 || tmin == t2) {
-                Vector3D v = intersection - center;
-                Vector3D projection = dotProduct(v, normalized_cylinder_axis) * normalized_cylinder_axis;
-                normal = normalize(v - projection);
-            } else if (tmin == t3) {
-                normal = -normalized_cylinder_axis;
-            } else if (tmin == t4) {
-                normal = normalized_cylinder_axis;
+        virtual void validate() const override {
+            if (axis == Vector3D(0,0,0)) {
+                throw std::invalid_argument("Invalid axis (0,0,0) for Cylinder");
             }
-
-            // If the ray does not intersect the cylinder, return false
-            if (tmin < std::numeric_limits<double>::max()) {
-                // If a check_point was provided, check if the closest intersection point is the same as *check_point, otherwise, skip this step
-                if (check_point != nullptr) {  
-                    // If the intersection point is not the same as the check_point, return true
-                    if (intersection != *check_point) {
-                        // This means there was some other shape that was closer to the light source than this cylinder
-                        return true;
-                    } else {
-                        return false;
-                    }
-                }
-                // Update the hit record
-                record.set_face_normal(ray, normal);
-                record.t = tmin;
-                record.p = intersection;
-                record.mat_ptr = mat;
-
-                return true;
+            if (!(radius > 0) || !std::isfinite(radius)) {
+                throw std::invalid_argument("Cylinder radius must be positive and finite");
             }
+        }
 
-            return false;
+        virtual bool hit(const Ray& ray, Interval ray_t, Hit_record& record) const override {
+            return primitive().hit(ray, ray_t, record);
         }
 
-        // Checks if a shadow ray from intersection point can be traced back to the light source. If ray is traceable, it shouldn't hit any other shapes in the scene.
-        virtual bool is_light_source_obstructed(const Ray& ray, Interval ray_t, const Point3D& light_position) const {
-            Hit_record temp_rec;
-            // Check if shadow ray intersects any of the shapes in the scene
-            if (hit(ray, ray_t, temp_rec, &light_position)) {
-                return true;
-            } else {
-                return false;
-            }
+        virtual bool occluded(const Ray& ray, Interval ray_t) const override {
+            return primitive().occluded(ray, ray_t);
         }
 
         virtual Point3D getCenter() const {return center;}
@@ -139,6 +183,22 @@ class Cylinder : public Shape
         virtual double getHeight() const override {return height;}
         virtual std::shared_ptr<Material> getMaterial() const override {return mat;}
 
+        // Union of the boxes around both cap disks. A disk with unit normal n extends
+        // radius * std::sqrt(1 - n_i^2) along axis i
+        virtual AABB bounding_box() const override {
+            if (axis == Vector3D(0,0,0)) {
+                throw std::invalid_argument("Invalid axis (0,0,0) for Cylinder");
+            }
+            Vector3D n = normalize(axis);
+            Vector3D extent(radius * std::sqrt(std::max(real(0), 1 - n.x * n.x)),
+                            radius * std::sqrt(std::max(real(0), 1 - n.y * n.y)),
+                            radius * std::sqrt(std::max(real(0), 1 - n.z * n.z)));
+            Point3D top = center + height * n;
+            AABB box(AABB(center - extent, center + extent), AABB(top - extent, top + extent));
+            // Cap hits are offset by a small epsilon along the ray, keep them inside the box
+            return AABB(box.x.expand(0.001), box.y.expand(0.001), box.z.expand(0.001));
+        }
+
         virtual bool is_sphere() const {return false;}
         virtual bool is_triangle() const {return false;}
         virtual bool is_cylinder() const {return true;}
@@ -154,8 +214,8 @@ class Cylinder : public Shape
     private:
         Point3D center;
         Vector3D axis;
-        double radius;
-        double height;
+        real radius;
+        real height;
         std::shared_ptr<Material> mat;
     
 };
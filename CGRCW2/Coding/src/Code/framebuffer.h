@@ -0,0 +1,122 @@
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include "color.h"
+#include "stats.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// In-memory image the camera renders into.
+// Pixels hold the average radiance of their samples; tone mapping and quantization
+// only happen when the image is written, in one pass over the whole buffer.
+class Framebuffer {
+    public:
+        enum Format {
+            PPM_ASCII,  // P3, one text line per pixel
+            PPM_BINARY  // P6, three bytes per pixel
+        };
+
+        Framebuffer() : width(0), height(0) {}
+        Framebuffer(int width, int height) : width(width), height(height), pixels(width * height), sample_counts(width * height, 0) {}
+
+        int getWidth() const {return width;}
+        int getHeight() const {return height;}
+
+        Color& at(int i, int j) {return pixels[j * width + i];}
+        const Color& at(int i, int j) const {return pixels[j * width + i];}
+        std::vector<Color>& getPixels() {return pixels;}
+        const std::vector<Color>& getPixels() const {return pixels;}
+
+        // Number of samples that went into every pixel
+        int& sampleCount(int i, int j) {return sample_counts[j * width + i];}
+        const std::vector<int>& getSampleCounts() const {return sample_counts;}
+
+        // Reinhard tone mapping and gamma 2 over the whole buffer, as 8-bit RGB triplets
+        std::vector<unsigned char> toneMap() const {
+            std::vector<unsigned char> bytes(pixels.size() * 3);
+            static const Interval intensity(0.000, 0.999);
+            for (size_t p = 0; p < pixels.size(); ++p) {
+                Color mapped = reinhard_tone_mapping(pixels[p]);
+                bytes[3 * p + 0] = static_cast<unsigned char>(256 * intensity.clamp(std::sqrt(mapped.x)));
+                bytes[3 * p + 1] = static_cast<unsigned char>(256 * intensity.clamp(std::sqrt(mapped.y)));
+                bytes[3 * p + 2] = static_cast<unsigned char>(256 * intensity.clamp(std::sqrt(mapped.z)));
+            }
+            return bytes;
+        }
+
+        // Grey image of the per-pixel sample counts, scaled so the most sampled pixel is white
+        std::vector<unsigned char> sampleMap() const {
+            int max_count = 1;
+            for (int count : sample_counts) max_count = std::max(max_count, count);
+            std::vector<unsigned char> bytes(sample_counts.size() * 3);
+            for (size_t p = 0; p < sample_counts.size(); ++p) {
+                unsigned char grey = static_cast<unsigned char>(255.0 * sample_counts[p] / max_count + 0.5);
+                bytes[3 * p + 0] = bytes[3 * p + 1] = bytes[3 * p + 2] = grey;
+            }
+            return bytes;
+        }
+
+        // Write the image as a PPM
+        void write(std::ostream& out, Format format) const {
+            RT_STATS_TIMER(STAGE_OUTPUT);
+            writePPM(out, toneMap(), format);
+        }
+
+        // Write the image to a file, returns false if the file could not be written
+        bool save(const std::string& filename, Format format) const {
+            RT_STATS_TIMER(STAGE_OUTPUT);
+            return savePPM(filename, toneMap(), format);
+        }
+
+        // Write the sample count image to a file
+        bool saveSampleMap(const std::string& filename, Format format) const {
+            RT_STATS_TIMER(STAGE_OUTPUT);
+            return savePPM(filename, sampleMap(), format);
+        }
+
+    private:
+        int width;
+        int height;
+        std::vector<Color> pixels;
+        std::vector<int> sample_counts;
+
+        // The PPM body is formatted into memory first and handed to the stream in a single write
+        void writePPM(std::ostream& out, const std::vector<unsigned char>& bytes, Format format) const {
+            std::string header = std::string(format == PPM_BINARY ? "P6" : "P3") + "\n"
+                + std::to_string(width) + ' ' + std::to_string(height) + "\n255\n";
+            out.write(header.data(), header.size());
+
+            if (format == PPM_BINARY) {
+                out.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+            } else {
+                std::string body;
+                body.reserve(bytes.size() * 4);
+                for (size_t p = 0; p < bytes.size(); p += 3) {
+                    body += std::to_string(bytes[p]) + ' ' + std::to_string(bytes[p + 1]) + ' ' + std::to_string(bytes[p + 2]) + '\n';
+                }
+                out.write(body.data(), body.size());
+            }
+            out.flush();
+        }
+
+        bool savePPM(const std::string& filename, const std::vector<unsigned char>& bytes, Format format) const {
+            std::ofstream file(filename, std::ios::out | std::ios::binary);
+            if (!file) {
+                std::cerr << "Error: could not open '" << filename << "' for writing" << std::endl;
+                return false;
+            }
+            writePPM(file, bytes, format);
+            if (!file) {
+                std::cerr << "Error: failed to write image to '" << filename << "'" << std::endl;
+                return false;
+            }
+            return true;
+        }
+};
+
+#endif // FRAMEBUFFER_H
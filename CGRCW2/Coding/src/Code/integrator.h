@@ -0,0 +1,225 @@
+#ifndef INTEGRATOR_H
+#define INTEGRATOR_H
+
+#include "scene.h"
+#include "material.h"
+#include "render_mode.h"
+#include "roulette.h"
+#include "sampler.h"
+#include "stats.h"
+
+#include <algorithm>
+#include <vector>
+
+// Depth-first path tracer: every sample follows its whole path before the next one starts.
+// ray_color is instantiated once per render mode and trace() picks the instance once per batch,
+// so each mode's bounce loop is compiled without any mode checks.
+// The bounces run in a loop that carries the product of the attenuations so far, so the stack does
+// not grow with max_depth. After roulette_depth bounces, paths that carry little of it are ended
+// by Russian roulette (see roulette.h) and max_depth is only a hard cap.
+// With a packet_size of 4 to 16, the camera rays are intersected in packets of that many consecutive
+// rays (Scene::hit_packet) and only the paths that continue from there are traced one by one.
+class RecursiveIntegrator {
+    public:
+        RecursiveIntegrator(const Scene& scene, const Color& background, RenderMode mode, int max_depth, int packet_size = 0, int roulette_depth = 0)
+            : scene(scene), background(background), mode(mode), max_depth(max_depth),
+              packet_size(std::min(packet_size, RayPacket::max_size)), roulette_depth(roulette_depth) {}
+
+        // Same interface as WavefrontIntegrator::trace: samplers[k] is the random stream of
+        // path k, positioned after the draws that generated rays[k]
+        void trace(const std::vector<Ray>& rays, const std::vector<Sampler>& samplers, std::vector<Color>& colors) const {
+            switch (mode) {
+                case RENDER_BINARY:  trace_all<RENDER_BINARY>(rays, samplers, colors); break;
+                case RENDER_NORMAL:  trace_all<RENDER_NORMAL>(rays, samplers, colors); break;
+                case RENDER_DIFFUSE: trace_all<RENDER_DIFFUSE>(rays, samplers, colors); break;
+                case RENDER_PHONG:   trace_all<RENDER_PHONG>(rays, samplers, colors); break;
+                case RENDER_PBR:     trace_all<RENDER_PBR>(rays, samplers, colors); break;
+            }
+        }
+
+        template <RenderMode Mode>
+        Color ray_color(const Ray& r, int depth) const {
+            Hit_record rec;
+
+            // If we've exceeded the ray bounce limit, no more light is gathered.
+            if (depth <= 0) {
+                return background;          // Might change to black
+            }
+            bool found = intersect(r, depth, rec);
+            if (Mode == RENDER_PBR) {
+                return follow_pbr_path(r, found, rec, depth);
+            }
+            if (!found) {
+                return background;
+            }
+            return follow_path<Mode>(r, rec, depth);
+        }
+
+        // Color of the pbr path whose camera ray r, with depth bounces left, hit rec if found is true.
+        // At every hit, light samples towards the lights are added, then a BSDF sample continues the
+        // path; lights the path runs into are added with the weight MIS leaves to the BSDF sample.
+        // Unlike the other modes, a path that runs out of bounces gathers nothing more
+        Color follow_pbr_path(Ray r, bool found, Hit_record rec, int depth) const {
+            Color radiance(0, 0, 0);
+            Color throughput(1, 1, 1);
+            double bsdf_pdf = 0;
+            int slots = scene.getShadowLightCount();
+            while (true) {
+                Color emitted;
+                if (scene.lightAlongRay(r, found ? rec.t : infinity, bsdf_pdf, emitted)) {
+                    return radiance + throughput * emitted;
+                }
+                if (!found) {
+                    return radiance + throughput * background;
+                }
+
+                Vector3D wo = -normalize(r.getDirection());
+                for (int slot = 0; slot < slots; ++slot) {
+                    RT_STATS_TIMER(STAGE_SHADOW_RAYS);
+                    Scene::DirectLightSample light_sample;
+                    if (scene.sampleDirectLight(rec, wo, slot, light_sample)) {
+                        bool shadowed = scene.occluded(light_sample.shadow_ray, Interval(ray_epsilon(rec.p), light_sample.distance));
+                        Scene::countShadowRay(shadowed);
+                        if (!shadowed) radiance += throughput * light_sample.contribution;
+                    }
+                }
+
+                BSDFSample bsdf_sample;
+                {
+                    RT_STATS_TIMER(STAGE_SCATTER);
+                    if (!scene.getMaterial(rec.material).sample(wo, rec.normal, rec.front_face, bsdf_sample)) {
+                        return radiance;
+                    }
+                }
+                throughput = throughput * bsdf_sample.weight;
+                r = Ray(rec.p, bsdf_sample.wi);
+                bsdf_pdf = bsdf_sample.pdf;
+
+                // Out of bounces, the BSDF sample still looks for a light, as the light samples above left it its share
+                if (--depth <= 0) {
+                    RT_STATS_TIMER(STAGE_SHADOW_RAYS);
+                    return radiance + throughput * scene.lightBeyondPath(r, bsdf_pdf);
+                }
+                if (!survives_roulette(throughput, max_depth - depth, roulette_depth)) {
+                    return radiance;
+                }
+                found = intersect(r, depth, rec);
+            }
+        }
+
+        // Color of the path whose ray r, with depth bounces left, hit rec
+        template <RenderMode Mode>
+        Color follow_path(Ray r, Hit_record rec, int depth) const {
+            Color throughput(1, 1, 1);
+            while (true) {
+                Color color;
+                Ray scattered;
+                if (!shade_hit<Mode>(r, rec, color, scattered)) {
+                    return throughput * color;
+                }
+                throughput = throughput * color;
+
+                // The hard cap; otherwise roulette decides whether the path goes on
+                if (--depth <= 0) {
+                    return throughput * background;
+                }
+                if (!survives_roulette(throughput, max_depth - depth, roulette_depth)) {
+                    return Color(0, 0, 0);
+                }
+                r = scattered;
+                if (!intersect(r, depth, rec)) {
+                    return throughput * background;
+                }
+            }
+        }
+
+        // One bounce at the hit rec of ray r. Returns false if the path ends here with the given color,
+        // true if it continues with the ray scattered and color is the attenuation along it.
+        // binary returns red if hit, normal returns normal as color, diffuse returns random diffuse color
+        template <RenderMode Mode>
+        bool shade_hit(const Ray& r, const Hit_record& rec, Color& color, Ray& scattered) const {
+            double diffuseFactor = 0.5;
+
+            // Mode is a template parameter, so only one of these branches survives in each instance
+            if (Mode == RENDER_BINARY) {
+                color = Color(1, 0, 0);
+                return false;
+            } else if (Mode == RENDER_NORMAL) {
+                color = 0.5 * (rec.normal + Color(1,1,1));
+                return false;
+            } else if (Mode == RENDER_DIFFUSE) {
+                Vector3D direction = random_in_hemisphere(rec.normal);
+                scattered = Ray(rec.p, direction);
+                color = Color(diffuseFactor, diffuseFactor, diffuseFactor);
+                return true;
+            } else {
+                Color light_contribution = scene.calculateLightingForHitPoint(r, rec);
+                bool scatters;
+                {
+                    RT_STATS_TIMER(STAGE_SCATTER);
+                    scatters = scene.getMaterial(rec.material).scatter(r, rec.normal, rec.p, rec.front_face, color, scattered, light_contribution);
+                }
+                if (!scatters) {
+                    color = Color(0, 1, 0);
+                }
+                return scatters;
+            }
+        }
+
+    private:
+        const Scene& scene;
+        Color background;
+        RenderMode mode;
+        int max_depth;
+        int packet_size;
+        int roulette_depth;
+
+        // Closest hit of the ray r of a path with depth bounces left
+        bool intersect(const Ray& r, int depth, Hit_record& rec) const {
+            RT_STATS_DEPTH(max_depth - depth, 1);
+            RT_STATS_TIMER(STAGE_INTERSECT);
+            return scene.hit(r, Interval(ray_epsilon(r.getOrigin()), infinity), rec);
+        }
+
+        template <RenderMode Mode>
+        void trace_all(const std::vector<Ray>& rays, const std::vector<Sampler>& samplers, std::vector<Color>& colors) const {
+            colors.resize(rays.size());
+            if (packet_size > 1 && max_depth > 0) {
+                trace_packets<Mode>(rays, samplers, colors);
+                return;
+            }
+            for (size_t k = 0; k < rays.size(); ++k) {
+                thread_sampler() = samplers[k];
+                colors[k] = ray_color<Mode>(rays[k], max_depth);
+            }
+        }
+
+        // Same colors as the loop above: the packet only replaces the first scene.hit of every path
+        template <RenderMode Mode>
+        void trace_packets(const std::vector<Ray>& rays, const std::vector<Sampler>& samplers, std::vector<Color>& colors) const {
+            Interval ray_t[RayPacket::max_size];
+            Hit_record records[RayPacket::max_size];
+            bool found[RayPacket::max_size];
+            for (size_t first = 0; first < rays.size(); first += packet_size) {
+                int count = static_cast<int>(std::min(rays.size() - first, static_cast<size_t>(packet_size)));
+                for (int k = 0; k < count; ++k) {
+                    ray_t[k] = Interval(ray_epsilon(rays[first + k].getOrigin()), infinity);
+                }
+                RT_STATS_DEPTH(0, count);
+                {
+                    RT_STATS_TIMER(STAGE_INTERSECT);
+                    scene.hit_packet(&rays[first], ray_t, count, records, found);
+                }
+                for (int k = 0; k < count; ++k) {
+                    thread_sampler() = samplers[first + k];
+                    if (Mode == RENDER_PBR) {
+                        colors[first + k] = follow_pbr_path(rays[first + k], found[k], records[k], max_depth);
+                    } else {
+                        colors[first + k] = found[k] ? follow_path<Mode>(rays[first + k], records[k], max_depth) : background;
+                    }
+                }
+            }
+        }
+};
+
+#endif // INTEGRATOR_H
@@ -1,33 +1,50 @@
 #ifndef INTERVAL_H
 #define INTERVAL_H
 
-class Interval {            // Interval class
+#include <algorithm>
+
+template <typename T>
+class IntervalT {           // Interval class
     public:
-        double min, max;    // Minimum and maximum values
+        T min, max;         // Minimum and maximum values
+
+        IntervalT() : min(+infinity), max(-infinity) {}
+
+        IntervalT(T _min, T _max) : min(_min), max(_max) {}
+
+        // Smallest interval enclosing both intervals
+        IntervalT(const IntervalT& a, const IntervalT& b) : min(a.min <= b.min ? a.min : b.min), max(a.max >= b.max ? a.max : b.max) {}
 
-        Interval() : min(+infinity), max(-infinity) {}
+        T size() const {
+            return max - min;
+        }
 
-        Interval(double _min, double _max) : min(_min), max(_max) {}
+        // Pad the interval by delta, split evenly between both ends
+        IntervalT expand(T delta) const {
+            auto padding = delta / 2;
+            return IntervalT(min - padding, max + padding);
+        }
 
         // Check if interval contains a value. Can be min, max, or in between
-        bool contains(double x) const {
+        bool contains(T x) const {
             return min <= x && x <= max;
         }
 
         // Check if interval surrounds a value. Must be in between min and max
-        bool surrounds(double x) const {
+        bool surrounds(T x) const {
             return min < x && x < max;
         }
 
         // Collapse value to the nearest bound
-        double clamp(double x) const {
+        T clamp(T x) const {
             return std::max(min, std::min(max, x));
         }
-
-        static const Interval empty, universe;
 };
 
+// Intervals in the scalar type of the geometry
+typedef IntervalT<real> Interval;
+
 const static Interval empty(+infinity, -infinity);
 const static Interval universe(-infinity, +infinity);
 
-#endif
\ No newline at end of file
+#endif
@@ -4,27 +4,142 @@
 #include "math_utils.h"
 #include "color.h"
 
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+// Radius of a point light's sphere when the scene does not give one
+const double default_light_radius = 0.1;
+
+// A direction towards a light drawn for next-event estimation from a shading point: the unit direction
+// wi, the distance to the sampled point, the radiance arriving along wi and the solid angle density of wi,
+// 0 for a point light, which only light sampling can reach
+struct LightSample {
+    Vector3D wi;
+    real distance;
+    Color radiance;
+    double pdf;
+};
+
 // Light base class
 class Light {
 public:
     virtual ~Light() = default;
     virtual Vector3D getPosition() const { return Vector3D(); }
     virtual Color getIntensity() const { return Color(); }
+    virtual double getRadius() const { return 0; }  // 0 for a true point, which casts hard shadows
+    // Point i of count spread over the light, for shadow rays; u0 and v0 in [0, 1) randomize the pattern
+    virtual Point3D samplePoint(int i, int count, double u0, double v0) const { return getPosition(); }
+
+    // Physically based interface of the pbr render mode. sampleLi draws a direction from p towards
+    // the light with u1, u2 in [0, 1) and returns false if there is none; pdfLi is its density for wi.
+    // A light with a surface is also hit by rays: hitLight gives the distance along r, and the radiance
+    // leaving the surface is emittedRadiance()
+    virtual bool sampleLi(const Point3D& p, double u1, double u2, LightSample& sample) const { return false; }
+    virtual double pdfLi(const Point3D& p, const Vector3D& wi) const { return 0; }
+    virtual bool hitLight(const Ray& r, const Interval& ray_t, real& t) const { return false; }
+    virtual Color emittedRadiance() const { return Color(); }
 
 };
 
 // PointLight class
+// A small sphere of light: shading uses its center, shadow rays end on its surface, so a radius
+// above 0 gives soft shadows. Throws std::invalid_argument for a negative radius
 class PointLight : public Light {
 public:
-    PointLight(const Point3D& position, const Color& intensity)
-        : position(position), intensity(intensity) {}
+    PointLight(const Point3D& position, const Color& intensity, double radius = default_light_radius)
+        : position(position), intensity(intensity), radius(radius) {
+        if (!(radius >= 0)) {
+            throw std::invalid_argument("Light radius must not be negative");
+        }
+    }
 
     Point3D getPosition() const { return position; }
     Color getIntensity() const { return intensity; }
+    double getRadius() const { return radius; }
+
+    // Point i of count on the light's sphere. The points form a Fibonacci lattice rotated by u0, v0
+    // in [0, 1): one point in each of count bands of equal area, at golden angle steps around the
+    // axis. With random offsets every point is uniform on the sphere, and together they cover it evenly
+    Point3D samplePoint(int i, int count, double u0, double v0) const {
+        const double golden_fraction = 0.6180339887498949;
+        double z = 1 - 2 * (i + u0) / count;
+        double v = i * golden_fraction + v0;
+        double phi = 2 * pi * (v - std::floor(v));
+        double r = std::sqrt(std::max(0.0, 1 - z * z));
+        return position + radius * Vector3D(r * std::cos(phi), r * std::sin(phi), z);
+    }
+
+    // In pbr mode a light with a radius is a sphere of uniform radiance intensity / radius^2, which gives
+    // the irradiance pi * intensity / d^2 at distance d. The factor pi over phong mode makes a white
+    // Lambertian surface facing the light (f = 1 / pi) exactly as bright as there. Radius 0 is a true point
+    Color emittedRadiance() const { return radius > 0 ? intensity * (1 / (radius * radius)) : Color(); }
+
+    // Uniform direction in the cone the sphere subtends from p (Pharr et al., PBR 3rd ed., 14.2.2), so
+    // every direction that reaches the light is drawn, with the same density. False from inside the sphere
+    bool sampleLi(const Point3D& p, double u1, double u2, LightSample& sample) const {
+        Vector3D to_center = position - p;
+        double distance_squared = getLengthSquared(to_center);
+        if (radius <= 0) {
+            if (!(distance_squared > 0)) return false;
+            sample.distance = std::sqrt(distance_squared);
+            sample.wi = to_center / sample.distance;
+            sample.radiance = intensity * (pi / distance_squared);
+            sample.pdf = 0;
+            return true;
+        }
+        double cone = coneSolidAngle(distance_squared);
+        if (cone <= 0) return false;
+        double distance = std::sqrt(distance_squared);
+        double cos_theta = 1 - u1 * cone / (2 * pi);
+        double sin_theta = std::sqrt(std::max(0.0, 1 - cos_theta * cos_theta));
+        sample.wi = direction_around(to_center / distance, sin_theta, cos_theta, 2 * pi * u2);
+
+        // Nearer intersection of p + t wi with the sphere; the direction is in the cone, so it exists up to rounding
+        double b = distance * cos_theta;
+        double c = b * b - (distance_squared - radius * radius);
+        sample.distance = b - std::sqrt(std::max(0.0, c));
+        sample.radiance = emittedRadiance();
+        sample.pdf = 1 / cone;
+        return true;
+    }
+
+    // Density of sampleLi for a direction wi from p that hits the light
+    double pdfLi(const Point3D& p, const Vector3D& wi) const {
+        double cone = coneSolidAngle(getLengthSquared(position - p));
+        return cone > 0 ? 1 / cone : 0;
+    }
+
+    bool hitLight(const Ray& r, const Interval& ray_t, real& t) const {
+        if (radius <= 0) return false;
+        Vector3D oc = position - r.getOrigin();
+        double a = getLengthSquared(r.getDirection());
+        double h = dotProduct(r.getDirection(), oc);
+        double c = getLengthSquared(oc) - radius * radius;
+        double discriminant = h * h - a * c;
+        if (discriminant < 0) return false;
+        double sqrtd = std::sqrt(discriminant);
+        double root = (h - sqrtd) / a;
+        if (!ray_t.surrounds(root)) {
+            root = (h + sqrtd) / a;
+            if (!ray_t.surrounds(root)) return false;
+        }
+        t = root;
+        return true;
+    }
 
 private:
+    // Solid angle 2 pi (1 - cos theta_max) of the cone the sphere subtends at squared distance distance_squared,
+    // 0 from inside it. 1 - cos is written as sin^2 / (1 + cos), which does not cancel for distant lights
+    double coneSolidAngle(double distance_squared) const {
+        if (!(distance_squared > radius * radius)) return 0;
+        double sin2_max = radius * radius / distance_squared;
+        return 2 * pi * sin2_max / (1 + std::sqrt(1 - sin2_max));
+    }
+
     Point3D position; // Position of the light
     Color intensity;   // Intensity of the light
+    double radius;     // Radius of the light's sphere
 };
 
 // AreaLight class
@@ -0,0 +1,160 @@
+#ifndef LIGHT_TREE_H
+#define LIGHT_TREE_H
+
+#include "aabb.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Binary tree over the scene's point lights, for picking one light at a shading point with a
+// probability that follows its expected contribution instead of shading every light.
+//
+// Every node stores the bounds of its lights' positions and their total power. Sampling walks
+// down from the root and takes each child with probability proportional to its importance:
+// power / distance^2, with the distance to the node's center clamped to the node's half diagonal
+// so that a point inside a cluster does not favour one side arbitrarily. The importance of a node
+// with any power is never zero, so every light that can contribute keeps a nonzero probability and
+// dividing by pdf() makes the estimate unbiased. Picking a light is O(depth) = O(log lights).
+class LightTree {
+    public:
+        LightTree() {}
+
+        bool empty() const {return nodes.empty();}
+
+        // Build over lights at the given positions; power is any nonnegative measure of their brightness
+        void build(const std::vector<Point3D>& positions, const std::vector<double>& powers) {
+            nodes.clear();
+            order.clear();
+            rank.clear();
+            if (positions.empty()) return;
+
+            order.resize(positions.size());
+            for (size_t i = 0; i < order.size(); ++i) {
+                order[i] = static_cast<int>(i);
+            }
+            nodes.reserve(2 * positions.size());
+            build_node(positions, powers, 0, static_cast<int>(order.size()));
+
+            rank.resize(order.size());
+            for (size_t i = 0; i < order.size(); ++i) {
+                rank[order[i]] = static_cast<int>(i);
+            }
+        }
+
+        // Pick a light for shading point p with the uniform random number u in [0, 1).
+        // Returns its index and sets pdf to its probability, or returns -1 if no light has any power
+        int sample(const Point3D& p, double u, double& pdf) const {
+            pdf = 0;
+            if (nodes.empty() || nodes[0].power <= 0) return -1;
+
+            pdf = 1;
+            int current = 0;
+            while (nodes[current].count > 1) {
+                int left = current + 1;
+                int right = nodes[current].right;
+                double p_left = left_probability(p, left, right);
+                if (u < p_left) {
+                    u /= p_left;
+                    pdf *= p_left;
+                    current = left;
+                } else {
+                    u = (u - p_left) / (1 - p_left);
+                    pdf *= 1 - p_left;
+                    current = right;
+                }
+                u = std::min(u, 1.0 - 1e-12);   // Rescaling may round up to 1
+            }
+            return order[nodes[current].first];
+        }
+
+        // Probability with which sample() picks light at shading point p
+        double pdf(const Point3D& p, int light) const {
+            if (nodes.empty() || nodes[0].power <= 0) return 0;
+            int position = rank[light];
+            double probability = 1;
+            int current = 0;
+            while (nodes[current].count > 1) {
+                if (nodes[current].power <= 0) return 0;    // sample() never enters a subtree without power
+                int left = current + 1;
+                int right = nodes[current].right;
+                double p_left = left_probability(p, left, right);
+                if (position < nodes[left].first + nodes[left].count) {
+                    probability *= p_left;
+                    current = left;
+                } else {
+                    probability *= 1 - p_left;
+                    current = right;
+                }
+            }
+            return probability;
+        }
+
+    private:
+        // Nodes are stored depth first; the left child of an interior node directly follows it
+        struct Node {
+            AABB bounds;
+            double power;   // Sum over the node's lights
+            int first;      // First entry in order
+            int count;      // Lights below the node, 1 for leaves
+            int right;      // Index of the right child of an interior node
+        };
+
+        std::vector<Node> nodes;
+        std::vector<int> order;     // Light indices, each node's lights contiguous
+        std::vector<int> rank;      // Position of every light in order
+
+        double importance(const Point3D& p, const Node& node) const {
+            if (node.power <= 0) return 0;
+            Point3D center = node.bounds.centroid();
+            Vector3D half_diagonal(0.5 * node.bounds.x.size(), 0.5 * node.bounds.y.size(), 0.5 * node.bounds.z.size());
+            Vector3D offset = p - center;
+            real distance2 = dotProduct(offset, offset);
+            return node.power / std::max(distance2, dotProduct(half_diagonal, half_diagonal));
+        }
+
+        double left_probability(const Point3D& p, int left, int right) const {
+            double w_left = importance(p, nodes[left]);
+            double w_right = importance(p, nodes[right]);
+            return w_left / (w_left + w_right);    // The parent has power, so at least one side does
+        }
+
+        static double component(const Point3D& p, int axis) {
+            return axis == 0 ? p.x : (axis == 1 ? p.y : p.z);
+        }
+
+        // Build the subtree over order[start, end) and return the index of its root.
+        // Lights are split at the median along the longest axis of their bounds, which keeps the depth at log2(lights)
+        int build_node(const std::vector<Point3D>& positions, const std::vector<double>& powers, int start, int end) {
+            int node_index = static_cast<int>(nodes.size());
+            nodes.push_back(Node());
+
+            AABB bounds;
+            double power = 0;
+            for (int i = start; i < end; ++i) {
+                bounds = AABB(bounds, AABB(positions[order[i]], positions[order[i]]));
+                power += powers[order[i]];
+            }
+
+            int right = 0;
+            if (end - start > 1) {
+                int axis = bounds.longest_axis();
+                int mid = start + (end - start) / 2;
+                std::nth_element(order.begin() + start, order.begin() + mid, order.begin() + end, [&](int a, int b) {
+                    return component(positions[a], axis) < component(positions[b], axis);
+                });
+                build_node(positions, powers, start, mid);
+                right = build_node(positions, powers, mid, end);
+            }
+
+            Node& node = nodes[node_index];
+            node.bounds = bounds;
+            node.power = power;
+            node.first = start;
+            node.count = end - start;
+            node.right = right;
+            return node_index;
+        }
+};
+
+#endif // LIGHT_TREE_H
@@ -2,27 +2,183 @@
 
 #include "camera.h"
 #include "color.h"
+#include "framebuffer.h"
+#include "render_mode.h"
+#include "scene_cache.h"
 #include "scene_reader.h"
+#include "stats.h"
 #include "material.h"
 
+#include <cstdlib>
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
 #include <iostream>
+#include <string>
+#include <utility>
 //#include <crtdbg.h>
 
 int main(int argc, char* argv[]) {
     //_CrtSetDbgFlag(_CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF);
     std:: string input_file;
+    int num_threads = 0;    // 0 = one worker per hardware thread
+    std::uint64_t seed = 0;
+    bool use_bvh = true;    // --accel linear falls back to testing every shape, for timing comparisons
+    bool pack_spheres = false;  // --sphere-kernel simd tests spheres from SoA storage with the SIMD kernel
+    bool wavefront = false;     // --integrator wavefront traces the samples of a tile breadth first
+    int packet_size = 16;       // --packets: camera rays intersected together in packets of 4, 8 or 16, 0 = one at a time
+    int roulette_depth = 3;     // --roulette-depth: bounces before Russian roulette may end a path, 0 = never
+    LightSampling light_sampling = LIGHT_SAMPLING_ALL;  // --light-sampling tree picks lights from a light tree
+    int light_samples = 1;      // --light-samples: lights picked per hit point with the light tree
+    int shadow_rays = 10;       // --shadow-rays: shadow rays per light and hit point, for lights with a radius
+    MISHeuristic mis_heuristic = MIS_POWER; // --mis: how pbr mode weights light and BSDF samples, see MISHeuristic
+    std::string output_file;    // Empty = write the image to stdout
+    std::string sample_map_file;    // Optional image of the number of samples taken per pixel
+    std::string stats_file;         // Optional JSON file for the RT_STATS counters and timers
+    int samples_per_pixel = 0;      // --spp overrides the scene's samples per pixel, 0 = keep
+    int pass_samples = 0;           // --pass-spp renders progressively in passes of this many samples per pixel
+    std::string checkpoint_file;    // --checkpoint saves the running sums after every pass
+    bool resume = false;            // --resume continues from the checkpoint
+    std::string scene_cache_file;   // --scene-cache loads the compiled scene from this file, or writes it there
+    Framebuffer::Format format = Framebuffer::PPM_BINARY;
 
-    if (argc < 2) {
-        std::cerr << "Usage: " << argv[0] << " <input_file>" << std::endl;
+    // Options start with "--", anything else is taken as the input file
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--threads" && i + 1 < argc) {
+            num_threads = std::atoi(argv[++i]);
+        } else if (arg == "--seed" && i + 1 < argc) {
+            seed = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--accel" && i + 1 < argc) {
+            std::string accel = argv[++i];
+            if (accel == "linear") {
+                use_bvh = false;
+            } else if (accel != "bvh") {
+                std::cerr << "Error: accelerator '" << accel << "' not recognized. Using default: bvh" << std::endl;
+            }
+        } else if (arg == "--sphere-kernel" && i + 1 < argc) {
+            std::string kernel = argv[++i];
+            if (kernel == "simd") {
+                pack_spheres = true;
+            } else if (kernel != "scalar") {
+                std::cerr << "Error: sphere kernel '" << kernel << "' not recognized. Using default: scalar" << std::endl;
+            }
+        } else if (arg == "--integrator" && i + 1 < argc) {
+            std::string integrator = argv[++i];
+            if (integrator == "wavefront") {
+                wavefront = true;
+            } else if (integrator != "recursive") {
+                std::cerr << "Error: integrator '" << integrator << "' not recognized. Using default: recursive" << std::endl;
+            }
+        } else if (arg == "--packets" && i + 1 < argc) {
+            int size = std::atoi(argv[++i]);
+            if (size == 0 || size == 4 || size == 8 || size == 16) {
+                packet_size = size;
+            } else {
+                std::cerr << "Error: --packets must be 0, 4, 8 or 16. Using default: 16" << std::endl;
+            }
+        } else if (arg == "--roulette-depth" && i + 1 < argc) {
+            roulette_depth = std::atoi(argv[++i]);
+            if (roulette_depth < 0) {
+                std::cerr << "Error: --roulette-depth must not be negative. Using 0" << std::endl;
+                roulette_depth = 0;
+            }
+        } else if (arg == "--light-sampling" && i + 1 < argc) {
+            std::string sampling = argv[++i];
+            if (sampling == "tree") {
+                light_sampling = LIGHT_SAMPLING_TREE;
+            } else if (sampling != "all") {
+                std::cerr << "Error: light sampling '" << sampling << "' not recognized. Using default: all" << std::endl;
+            }
+        } else if (arg == "--light-samples" && i + 1 < argc) {
+            light_samples = std::atoi(argv[++i]);
+            if (light_samples < 1) {
+                std::cerr << "Error: --light-samples must be at least 1. Using 1" << std::endl;
+                light_samples = 1;
+            }
+        } else if (arg == "--shadow-rays" && i + 1 < argc) {
+            shadow_rays = std::atoi(argv[++i]);
+            if (shadow_rays < 1 || shadow_rays > Scene::getMaxShadowRays()) {
+                shadow_rays = std::min(std::max(shadow_rays, 1), Scene::getMaxShadowRays());
+                std::cerr << "Error: --shadow-rays must be between 1 and " << Scene::getMaxShadowRays() << ". Using " << shadow_rays << std::endl;
+            }
+        } else if (arg == "--mis" && i + 1 < argc) {
+            std::string heuristic = argv[++i];
+            if (heuristic == "balance") {
+                mis_heuristic = MIS_BALANCE;
+            } else if (heuristic == "light") {
+                mis_heuristic = MIS_LIGHT;
+            } else if (heuristic == "bsdf") {
+                mis_heuristic = MIS_BSDF;
+            } else if (heuristic != "power") {
+                std::cerr << "Error: MIS heuristic '" << heuristic << "' not recognized. Using default: power" << std::endl;
+            }
+        } else if (arg == "--output" && i + 1 < argc) {
+            output_file = argv[++i];
+        } else if (arg == "--sample-map" && i + 1 < argc) {
+            sample_map_file = argv[++i];
+        } else if (arg == "--spp" && i + 1 < argc) {
+            samples_per_pixel = std::atoi(argv[++i]);
+        } else if (arg == "--pass-spp" && i + 1 < argc) {
+            pass_samples = std::atoi(argv[++i]);
+        } else if (arg == "--checkpoint" && i + 1 < argc) {
+            checkpoint_file = argv[++i];
+        } else if (arg == "--resume") {
+            resume = true;
+        } else if (arg == "--scene-cache" && i + 1 < argc) {
+            scene_cache_file = argv[++i];
+        } else if (arg == "--stats" && i + 1 < argc) {
+            stats_file = argv[++i];
+#ifndef RT_STATS
+            std::cerr << "Error: this build has no statistics, rebuild with -DRT_STATS. Ignoring --stats" << std::endl;
+            stats_file.clear();
+#endif
+        } else if (arg == "--format" && i + 1 < argc) {
+            std::string name = argv[++i];
+            if (name == "p3") {
+                format = Framebuffer::PPM_ASCII;
+            } else if (name != "p6") {
+                std::cerr << "Error: image format '" << name << "' not recognized. Using default: p6" << std::endl;
+            }
+        } else if (arg.rfind("--", 0) == 0) {
+            std::cerr << "Error: unknown or incomplete option '" << arg << "'. Ignoring it." << std::endl;
+        } else {
+            input_file = arg;
+        }
+    }
+
+    if (input_file.empty()) {
+        std::cerr << "Usage: " << argv[0] << " [--threads <count>] [--seed <n>] [--accel bvh|linear] [--sphere-kernel scalar|simd] [--integrator recursive|wavefront] [--packets 0|4|8|16] [--roulette-depth <n>] [--light-sampling all|tree] [--light-samples <n>] [--shadow-rays <n>] [--mis power|balance|light|bsdf] [--output <file.ppm>] [--format p6|p3] [--sample-map <file.ppm>] [--spp <n>] [--pass-spp <n>] [--checkpoint <file>] [--resume] [--scene-cache <file.rtscene>] [--stats <file.json>] <input_file>" << std::endl;
         input_file = "default.json"; // Replace with your default file name
-    } else {
-        input_file = argv[1];
     }
 
-    // Scene
-    SceneReader scene_reader(input_file);
+    // Scene, from the scene cache if it was compiled from this very file, otherwise from the file itself
+    Scene scene;
+    SceneDescription cached_settings;
+    std::uint64_t source_hash = scene_cache_file.empty() ? 0 : SceneCache::sourceHash(input_file);
+    bool cached = !scene_cache_file.empty() && SceneCache::load(scene_cache_file, source_hash, cached_settings, scene, use_bvh && !pack_spheres);
+    SceneReader scene_reader = cached ? SceneReader(std::move(cached_settings)) : SceneReader(input_file);
 
-    Scene scene = scene_reader.buildScene();
+    if (!cached) {
+        scene_reader.modifyScene(scene);
+        if (!scene_cache_file.empty()) {
+            if (use_bvh) {
+                scene.build_bvh();
+            }
+            SceneCache::save(scene_cache_file, source_hash, scene_reader.getDescription(), scene);
+        }
+    }
+    if (pack_spheres) {
+        scene.pack_spheres();
+        std::clog << "Packed " << scene.getSphereBatch().size() << " spheres for the " << scene.getSphereBatch().kernel_name() << " sphere kernel\n";
+    }
+    if (use_bvh && !scene.has_bvh()) {
+        scene.build_bvh();
+    }
+    scene.set_light_sampling(light_sampling, light_samples);
+    scene.set_shadow_rays(shadow_rays);
+    scene.set_mis_heuristic(mis_heuristic);
 
     // TODO: Add your code here to build the scene from the input file
     // The following code is just for testing the materials
@@ -56,14 +212,34 @@ int main(int argc, char* argv[]) {
 
     Color background = Color(vector_background_color[0], vector_background_color[1], vector_background_color[2]);
 
-    // Rendermode
-    std::string render_mode = scene_reader.getRenderMode();
+    // Rendermode, resolved once here; the integrators never look at the name again
+    RenderMode render_mode;
+    std::string render_mode_name = scene_reader.getRenderMode();
+    if (!parseRenderMode(render_mode_name, render_mode)) {
+        std::cerr << "Error: Invalid render mode '" << render_mode_name << "'" << std::endl;
+        exit(1);
+    }
 
     // Camera
 
     Camera camera;
 
     camera.modifyCamera(scene_reader);
+    camera.num_threads = num_threads;
+    camera.seed = seed;
+    camera.wavefront = wavefront;
+    camera.packet_size = packet_size;
+    camera.roulette_depth = roulette_depth;
+    if (samples_per_pixel > 0) {
+        camera.samples_per_pixel = samples_per_pixel;
+    }
+    camera.pass_samples = pass_samples;
+    camera.checkpoint_file = checkpoint_file;
+    camera.resume = resume;
+    camera.scene_key = scene_reader.contentHash();
+    if (resume && checkpoint_file.empty()) {
+        std::cerr << "Error: --resume needs --checkpoint <file>. Rendering from scratch" << std::endl;
+    }
 
     /*camera.vfov = 90;
     camera.lookfrom = Point3D(0, 0, 0);
@@ -73,5 +249,28 @@ int main(int argc, char* argv[]) {
 
     // Render
 
-    camera.render(scene, background, render_mode);
+    Framebuffer image = camera.render(scene, background, render_mode);
+
+    if (!sample_map_file.empty()) {
+        image.saveSampleMap(sample_map_file, format);
+    }
+
+    if (!output_file.empty()) {
+        if (!image.save(output_file, format)) {
+            return 1;
+        }
+    } else {
+#ifdef _WIN32
+        _setmode(_fileno(stdout), _O_BINARY);  // Keep P6 bytes from being newline-translated
+#endif
+        image.write(std::cout, format);
+    }
+
+#ifdef RT_STATS
+    if (!stats_file.empty()) {
+        RT_STATS_MERGE();
+        saveStats(stats_file, global_stats(), camera.ray_counts);
+    }
+#endif
+    return 0;
 }
\ No newline at end of file
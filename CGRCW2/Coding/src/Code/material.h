@@ -9,6 +9,25 @@
 
 class Hit_record;
 
+// Broad classes of materials that share the same scattering code,
+// used by the wavefront integrator to shade hits in groups
+enum MaterialKind {
+    MATERIAL_LAMBERTIAN,
+    MATERIAL_PHONG_DIFFUSE,
+    MATERIAL_PHONG_REFLECTIVE,
+    MATERIAL_PHONG_REFRACTIVE,
+    MATERIAL_KIND_COUNT
+};
+
+// A direction drawn by Material::sample. weight is f * cos / pdf, the factor the path throughput is
+// multiplied by, and pdf the solid angle density of wi, or 0 for a delta lobe (a mirror or a refraction),
+// which light sampling can never produce
+struct BSDFSample {
+    Vector3D wi;
+    Color weight;
+    double pdf;
+};
+
 class Material {
     public:
         virtual ~Material() = default;
@@ -16,6 +35,15 @@ class Material {
         virtual Color shade(const Hit_record& record, const Vector3D& light_direction, const Vector3D& view_direction, const Color& light_color, double disance_to_light) const = 0;
         virtual bool scatter(const Ray& r_in, const Vector3D& normal, const Vector3D& p, const bool frontFace, Color& attenuation, Ray& scattered, Color& light_contribution) const = 0;
         virtual bool is_refractive() const {return false;}
+        virtual MaterialKind getKind() const = 0;
+
+        // Physically based interface of the pbr render mode. wo points back along the incoming ray and wi
+        // away from the surface, both unit vectors; normal is the shading normal on the side of wo, as in
+        // Hit_record. eval is the BSDF f(wo, wi) without the cosine and without the delta lobes, pdf the
+        // density with which sample picks wi. sample returns false if the path ends at this surface
+        virtual Color eval(const Vector3D& wo, const Vector3D& wi, const Vector3D& normal) const = 0;
+        virtual double pdf(const Vector3D& wo, const Vector3D& wi, const Vector3D& normal) const = 0;
+        virtual bool sample(const Vector3D& wo, const Vector3D& normal, bool front_face, BSDFSample& sample) const = 0;
 };
 
 // Matte material
@@ -44,7 +72,7 @@ class Lambertian : public Material {
                 // Point is in shadow
                 return ambient;
             }
-            double cos_theta = std::max(0.0, dotProduct(record.normal, light_direction));
+            double cos_theta = std::max(real(0), dotProduct(record.normal, light_direction));
             double attenuation = 1.0 / (distance_to_light * distance_to_light);
 
             return ambient + light_color * albedo * cos_theta * attenuation;
@@ -53,6 +81,27 @@ class Lambertian : public Material {
         // Is refractive?
         virtual bool is_refractive() const override {return false;}
 
+        virtual MaterialKind getKind() const override {return MATERIAL_LAMBERTIAN;}
+
+        // f = albedo / pi, sampled in proportion to the cosine, which leaves albedo as the weight
+        virtual Color eval(const Vector3D& wo, const Vector3D& wi, const Vector3D& normal) const override {
+            if (dotProduct(wi, normal) <= 0) return Color(0, 0, 0);
+            return albedo * (1 / pi);
+        }
+
+        virtual double pdf(const Vector3D& wo, const Vector3D& wi, const Vector3D& normal) const override {
+            return std::max(0.0, static_cast<double>(dotProduct(wi, normal))) / pi;
+        }
+
+        virtual bool sample(const Vector3D& wo, const Vector3D& normal, bool front_face, BSDFSample& sample) const override {
+            sample.wi = random_cosine_direction(normal);
+            sample.pdf = pdf(wo, sample.wi, normal);
+            sample.weight = albedo;
+            return sample.pdf > 0;
+        }
+
+        Color getAlbedo() const {return albedo;}
+
     private:
         Color albedo;
 };
@@ -118,8 +167,8 @@ class Lambertian : public Material {
             }
             Vector3D halfway_vector = normalize(light_direction + view_direction);
 
-            double diffuse = std::max(dotProduct(light_direction, record.normal), 0.0);
-            double specular = pow(std::max(dotProduct(halfway_vector, record.normal), 0.0), specular_exponent);
+            double diffuse = std::max(dotProduct(light_direction, record.normal), real(0));
+            double specular = pow(std::max(dotProduct(halfway_vector, record.normal), real(0)), specular_exponent);
 
             double attenuation = 1.0 / (distance_to_light * distance_to_light);
 
@@ -129,6 +178,89 @@ class Lambertian : public Material {
         // Is refractive?
         virtual bool is_refractive() const override {return isRefractive;}
 
+        // The pbr mode reads the parameters as an energy conserving BSDF: a Lambertian lobe
+        // kd * diffuseColor / pi plus a normalized Blinn-Phong lobe ks * specularColor * (n + 8) / (8 pi) * cos^n
+        // of the half vector. A reflective material is a mirror with probability reflectivity and these
+        // lobes otherwise; a refractive one is a smooth dielectric with Schlick's Fresnel term, as in scatter()
+        virtual Color eval(const Vector3D& wo, const Vector3D& wi, const Vector3D& normal) const override {
+            double glossy = glossyWeight();
+            double cos_i = dotProduct(wi, normal);
+            double cos_o = dotProduct(wo, normal);
+            if (glossy <= 0 || cos_i <= 0 || cos_o <= 0) return Color(0, 0, 0);
+            Vector3D halfway_vector = normalize(wo + wi);
+            double cos_h = std::max(0.0, static_cast<double>(dotProduct(halfway_vector, normal)));
+            double specular = (specular_exponent + 8) / (8 * pi) * pow(cos_h, specular_exponent);
+            return (diffuseColor * (kd / pi) + specularColor * (ks * specular)) * glossy;
+        }
+
+        // Mixture of cosine sampling for the diffuse lobe and half vector sampling for the specular one
+        // (density (n + 1) / (2 pi) * cos^n of the half vector, / (4 wo.h) for wi)
+        virtual double pdf(const Vector3D& wo, const Vector3D& wi, const Vector3D& normal) const override {
+            double glossy = glossyWeight();
+            double cos_i = dotProduct(wi, normal);
+            double cos_o = dotProduct(wo, normal);
+            if (glossy <= 0 || cos_i <= 0 || cos_o <= 0) return 0;
+            Vector3D halfway_vector = normalize(wo + wi);
+            double cos_h = std::max(0.0, static_cast<double>(dotProduct(halfway_vector, normal)));
+            double wo_h = dotProduct(wo, halfway_vector);
+            double specular_pdf = wo_h > 0 ? (specular_exponent + 1) / (2 * pi) * pow(cos_h, specular_exponent) / (4 * wo_h) : 0;
+            double p_diffuse = diffuseProbability();
+            return glossy * (p_diffuse * cos_i / pi + (1 - p_diffuse) * specular_pdf);
+        }
+
+        virtual bool sample(const Vector3D& wo, const Vector3D& normal, bool front_face, BSDFSample& sample) const override {
+            if (isReflective && random_double() >= glossyWeight()) {
+                sample.wi = reflect(-wo, normal);
+                sample.weight = Color(1, 1, 1) * (reflectivity / (1 - glossyWeight()));
+                sample.pdf = 0;
+                return true;
+            }
+            if (!isReflective && isRefractive) {
+                double refraction_ratio = front_face ? (1.0 / refractiveIndex) : refractiveIndex;
+                double cos_theta = std::min(static_cast<double>(dotProduct(wo, normal)), 1.0);
+                double sin_theta = sqrt(1.0 - cos_theta*cos_theta);
+                bool cannot_refract = refraction_ratio * sin_theta > 1.0;
+                if (cannot_refract || reflectance(cos_theta, refraction_ratio) > random_double())
+                    sample.wi = reflect(-wo, normal);
+                else
+                    sample.wi = refract(-wo, normal, refraction_ratio);
+                sample.weight = Color(1, 1, 1);
+                sample.pdf = 0;
+                return true;
+            }
+
+            double u = random_double();
+            if (u < diffuseProbability()) {
+                sample.wi = random_cosine_direction(normal);
+            } else {
+                double cos_h = pow(random_double(), 1.0 / (specular_exponent + 1));
+                double sin_h = sqrt(std::max(0.0, 1 - cos_h * cos_h));
+                Vector3D halfway_vector = direction_around(normal, sin_h, cos_h, 2 * pi * random_double());
+                sample.wi = reflect(-wo, halfway_vector);
+            }
+            sample.pdf = pdf(wo, sample.wi, normal);
+            if (!(sample.pdf > 0)) return false;
+            sample.weight = eval(wo, sample.wi, normal) * (dotProduct(sample.wi, normal) / sample.pdf);
+            return true;
+        }
+
+        virtual MaterialKind getKind() const override {
+            // scatter() checks reflective before refractive
+            if (isReflective) return MATERIAL_PHONG_REFLECTIVE;
+            if (isRefractive) return MATERIAL_PHONG_REFRACTIVE;
+            return MATERIAL_PHONG_DIFFUSE;
+        }
+
+        // Parameters, in the order of the constructor
+        Color getDiffuseColor() const {return diffuseColor;}
+        Color getSpecularColor() const {return specularColor;}
+        double getKd() const {return kd;}
+        double getKs() const {return ks;}
+        int getSpecularExponent() const {return specular_exponent;}
+        bool is_reflective() const {return isReflective;}
+        double getReflectivity() const {return reflectivity;}
+        double getRefractiveIndex() const {return refractiveIndex;}
+
     private:
         Color diffuseColor;     // diffuse color also used for ambient
         Color specularColor;    // specular color
@@ -140,6 +272,21 @@ class Lambertian : public Material {
         bool isRefractive;      // is the material refractive?
         double refractiveIndex;    // refractive index
 
+        // Share of the light the diffuse and specular lobes reflect: all of it, less the mirror's share
+        // of a reflective material, and none for a refractive one
+        double glossyWeight() const {
+            if (isReflective) return 1 - std::min(std::max(reflectivity, 0.0), 1.0);
+            return isRefractive ? 0 : 1;
+        }
+
+        // Probability of sampling the diffuse lobe, in proportion to the lobes' brightness
+        double diffuseProbability() const {
+            double diffuse = kd * luminance(diffuseColor);
+            double specular = ks * luminance(specularColor);
+            if (!(diffuse + specular > 0)) return 1;
+            return diffuse / (diffuse + specular);
+        }
+
         static double reflectance(double cosine, double ref_idx) {
             // Use Schlick's approximation for reflectance.
             auto r0 = (1-ref_idx) / (1+ref_idx);
@@ -6,20 +6,45 @@
 #include <limits>
 #include <memory>
 
+#include "sampler.h"
+
 //Constants
 
 const double infinity = std::numeric_limits<double>::infinity();
 const double pi = 3.1415927;
 
+// Scalar type of the geometry: vectors, rays, intervals, shapes and BVH boxes. double by default,
+// float when built with -DRT_FLOAT. Scene loading and the per-pixel sums stay in double either way
+#ifdef RT_FLOAT
+typedef float real;
+#else
+typedef double real;
+#endif
+
+// Inline even past the compiler's size limits; for the per-primitive intersection routines the traversal
+// loops call once per candidate, where a call per primitive costs more than the test itself
+#if defined(__GNUC__)
+#define RT_FORCE_INLINE inline __attribute__((always_inline))
+#elif defined(_MSC_VER)
+#define RT_FORCE_INLINE __forceinline
+#else
+#define RT_FORCE_INLINE inline
+#endif
+
 //Utility Functions
 
 inline double degrees_to_radians(double degrees) {
     return degrees * pi / 180.0;
 }
 
+// Restart the calling thread's random sequence from the given seed (for code outside the per-sample render loop)
+inline void seed_random(std::uint64_t seed) {
+    start_sample(seed, 0, 0);
+}
+
 inline double random_double() {
-    // Returns a random real in [0,1)
-    return rand() / (RAND_MAX + 1.0);
+    // Returns a random real in [0,1), drawn from the calling thread's sample stream
+    return thread_sampler().next_double();
 }
 
 inline double random_double(double min, double max) {
@@ -27,6 +52,14 @@ inline double random_double(double min, double max) {
     return min + (max-min)*random_double();
 }
 
+// One 64-bit FNV-1a step over the eight bytes of value, lowest first, for keys built from several settings
+inline std::uint64_t hash_combine(std::uint64_t hash, std::uint64_t value) {
+    for (int i = 0; i < 8; ++i) {
+        hash = (hash ^ ((value >> (8 * i)) & 0xff)) * 1099511628211ULL;
+    }
+    return hash;
+}
+
 //Common Headers
 
 #include "ray.h"
@@ -0,0 +1,167 @@
+#ifndef MESH_H
+#define MESH_H
+
+#include "shape.h"
+#include "material.h"
+#include "bvh.h"
+
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+// Indexed triangle mesh.
+// All triangles share one vertex buffer and one index buffer, stored in single precision like
+// the OBJ/PLY files they come from, plus the two precomputed edges of every triangle. The mesh
+// has its own BVH and is a single shape (and a single leaf) in the scene BVH.
+class TriangleMesh : public Shape
+{
+    public:
+        // vertices holds x, y, z per vertex; indices holds three vertex indices per triangle
+        TriangleMesh(std::vector<float> _vertices, std::vector<std::uint32_t> _indices, std::shared_ptr<Material> _material)
+            : vertices(std::move(_vertices)), indices(std::move(_indices)), mat(_material) {
+            bvh.build(prepare());
+        }
+
+        // Same, with the per-mesh BVH built earlier over the same triangles (see getBVH()), e.g. one read from a scene cache
+        TriangleMesh(std::vector<float> _vertices, std::vector<std::uint32_t> _indices, std::shared_ptr<Material> _material, BVH _bvh)
+            : vertices(std::move(_vertices)), indices(std::move(_indices)), mat(_material), bvh(std::move(_bvh)) {
+            prepare();
+            if (bvh.getPrimIndices().size() != triangleCount()) {
+                throw std::invalid_argument("Mesh BVH does not cover the triangles of the mesh");
+            }
+        }
+
+        size_t triangleCount() const {return indices.size() / 3;}
+        size_t vertexCount() const {return vertices.size() / 3;}
+        const std::vector<float>& getVertices() const {return vertices;}
+        const std::vector<std::uint32_t>& getIndices() const {return indices;}
+        const BVH& getBVH() const {return bvh;}
+
+        // Bytes held by the mesh buffers and its BVH
+        size_t memoryUsage() const {
+            return vertices.capacity() * sizeof(float) + indices.capacity() * sizeof(std::uint32_t) + edges.capacity() * sizeof(float)
+                + bvh.getNodes().capacity() * sizeof(BVH::Node) + bvh.getPrimIndices().capacity() * sizeof(int);
+        }
+
+        virtual bool hit(const Ray& ray, Interval ray_t, Hit_record& record) const override {
+            int closest = -1;
+            real closest_t = 0;
+            bvh.hit(ray, ray_t, [&](int triangle, Interval& t) {
+                real hit_t;
+                if (intersect(ray, triangle, t, hit_t)) {
+                    t.max = hit_t;
+                    closest = triangle;
+                    closest_t = hit_t;
+                    return true;
+                }
+                return false;
+            });
+            if (closest < 0) return false;
+
+            Vector3D e1, e2;
+            load_edges(closest, e1, e2);
+            record.t = closest_t;
+            record.p = ray.at(closest_t);
+            record.material = material_id;
+            // Counter-clockwise winding faces outwards
+            record.set_face_normal(ray, normalize(crossProduct(e1, e2)));
+            return true;
+        }
+
+        virtual bool occluded(const Ray& ray, Interval ray_t) const override {
+            return bvh.any_hit(ray, ray_t, [&](int triangle) {
+                real t;
+                return intersect(ray, triangle, ray_t, t);
+            });
+        }
+
+        virtual Point3D getCenter() const override {return box.centroid();}
+        virtual double getRadius() const override {return -1;}
+        virtual std::shared_ptr<Material> getMaterial() const override {return mat;}
+        virtual double getHeight() const override {return -1;}
+
+        virtual AABB bounding_box() const override {return box;}
+
+        virtual void print() const override {
+            std::clog << "Triangle mesh: " << triangleCount() << " triangles, " << vertexCount() << " vertices" << std::endl;
+        }
+
+    private:
+        std::vector<float> vertices;            // x, y, z per vertex
+        std::vector<std::uint32_t> indices;     // Three vertex indices per triangle
+        std::vector<float> edges;               // v1 - v0 and v2 - v0 per triangle
+        std::shared_ptr<Material> mat;
+        AABB box;
+        BVH bvh;
+
+        // Check the buffers, precompute the edges and the bounds. Returns the triangle boxes for the BVH build
+        std::vector<AABB> prepare() {
+            if (indices.size() % 3 != 0) {
+                throw std::invalid_argument("Mesh index count must be a multiple of 3");
+            }
+            for (std::uint32_t index : indices) {
+                if (3 * static_cast<size_t>(index) + 2 >= vertices.size()) {
+                    throw std::invalid_argument("Mesh index out of range of the vertex buffer");
+                }
+            }
+
+            size_t count = triangleCount();
+            edges.resize(6 * count);
+            std::vector<AABB> boxes(count);
+            for (size_t i = 0; i < count; ++i) {
+                Point3D v0 = vertex(indices[3 * i]);
+                Point3D v1 = vertex(indices[3 * i + 1]);
+                Point3D v2 = vertex(indices[3 * i + 2]);
+                Vector3D e1 = v1 - v0;
+                Vector3D e2 = v2 - v0;
+                edges[6 * i + 0] = static_cast<float>(e1.x);
+                edges[6 * i + 1] = static_cast<float>(e1.y);
+                edges[6 * i + 2] = static_cast<float>(e1.z);
+                edges[6 * i + 3] = static_cast<float>(e2.x);
+                edges[6 * i + 4] = static_cast<float>(e2.y);
+                edges[6 * i + 5] = static_cast<float>(e2.z);
+                boxes[i] = AABB(AABB(v0, v1), AABB(v2, v2));
+                box = AABB(box, boxes[i]);
+            }
+            return boxes;
+        }
+
+        Point3D vertex(std::uint32_t index) const {
+            const float* p = &vertices[3 * static_cast<size_t>(index)];
+            return Point3D(p[0], p[1], p[2]);
+        }
+
+        void load_edges(int triangle, Vector3D& e1, Vector3D& e2) const {
+            const float* e = &edges[6 * static_cast<size_t>(triangle)];
+            e1 = Vector3D(e[0], e[1], e[2]);
+            e2 = Vector3D(e[3], e[4], e[5]);
+        }
+
+        // Moller-Trumbore with the stored edges. The determinant is compared relative to the edge and
+        // direction lengths, since mesh triangles are often far smaller than the scene's hand-placed ones
+        bool intersect(const Ray& ray, int triangle, const Interval& ray_t, real& t) const {
+            RT_STATS_TEST(PRIM_MESH_TRIANGLE);
+            Vector3D e1, e2;
+            load_edges(triangle, e1, e2);
+            Vector3D p = crossProduct(ray.getDirection(), e2);
+            real a = dotProduct(e1, p);
+            if (a * a <= 1e-24 * getLengthSquared(e1) * getLengthSquared(e2) * getLengthSquared(ray.getDirection())) {
+                return false;
+            }
+            real f = 1 / a;
+            Vector3D s = ray.getOrigin() - vertex(indices[3 * triangle]);
+            real u = f * dotProduct(s, p);
+            if (u < 0.0 || u > 1.0) {
+                return false;
+            }
+            Vector3D q = crossProduct(s, e1);
+            real v = f * dotProduct(ray.getDirection(), q);
+            if (v < 0.0 || u + v > 1.0) {
+                return false;
+            }
+            t = f * dotProduct(e2, q);
+            return ray_t.contains(t);
+        }
+};
+
+#endif // MESH_H
@@ -0,0 +1,310 @@
+#ifndef MESH_LOADER_H
+#define MESH_LOADER_H
+
+#include "mesh.h"
+
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Loaders for the mesh files referenced by "type":"mesh" scene entries.
+// Files are read into memory with one bulk read and parsed from the buffer;
+// errors are reported by throwing std::runtime_error.
+
+// Vertex and index buffers in the layout TriangleMesh takes
+struct MeshData {
+    std::vector<float> vertices;            // x, y, z per vertex
+    std::vector<std::uint32_t> indices;     // Three vertex indices per triangle
+};
+
+inline std::vector<char> readWholeFile(const std::string& filename) {
+    std::ifstream file(filename, std::ios::in | std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Could not open file: " + filename);
+    }
+    file.seekg(0, std::ios::end);
+    std::streamoff size = file.tellg();
+    file.seekg(0, std::ios::beg);
+    std::vector<char> buffer(static_cast<size_t>(size) + 1);   // One extra byte to terminate the text for strtod/strtol
+    if (size > 0 && !file.read(buffer.data(), size)) {
+        throw std::runtime_error("Could not read file: " + filename);
+    }
+    buffer[static_cast<size_t>(size)] = '\0';
+    return buffer;
+}
+
+// Wavefront OBJ: "v x y z" vertices and "f" faces with any of the v, v/vt, v//vn and v/vt/vn
+// index forms, negative (relative) indices included. Polygons are triangulated as fans;
+// texture coordinates, normals, groups and materials are ignored.
+inline MeshData loadOBJ(const std::string& filename) {
+    std::vector<char> buffer = readWholeFile(filename);
+    MeshData mesh;
+    std::vector<std::uint32_t> face;
+
+    const char* c = buffer.data();
+    const char* end = buffer.data() + buffer.size() - 1;
+    int line = 1;
+    while (c < end) {
+        while (*c == ' ' || *c == '\t') ++c;
+
+        if (c[0] == 'v' && (c[1] == ' ' || c[1] == '\t')) {
+            c += 2;
+            for (int axis = 0; axis < 3; ++axis) {
+                char* next;
+                double value = std::strtod(c, &next);
+                if (next == c) {
+                    throw std::runtime_error(filename + ":" + std::to_string(line) + ": vertex needs three coordinates");
+                }
+                mesh.vertices.push_back(static_cast<float>(value));
+                c = next;
+            }
+        } else if (c[0] == 'f' && (c[1] == ' ' || c[1] == '\t')) {
+            c += 2;
+            face.clear();
+            long vertex_count = static_cast<long>(mesh.vertices.size() / 3);
+            while (true) {
+                while (*c == ' ' || *c == '\t') ++c;
+                char* next;
+                long index = std::strtol(c, &next, 10);
+                if (next == c) break;
+                c = next;
+                while (*c == '/' || (*c >= '0' && *c <= '9') || *c == '-') ++c;   // Skip the texture and normal indices
+
+                long resolved = index > 0 ? index - 1 : vertex_count + index;   // OBJ indices are 1-based, negative ones count back
+                if (index == 0 || resolved < 0 || resolved >= vertex_count) {
+                    throw std::runtime_error(filename + ":" + std::to_string(line) + ": face index " + std::to_string(index) + " out of range");
+                }
+                face.push_back(static_cast<std::uint32_t>(resolved));
+            }
+            if (face.size() < 3) {
+                throw std::runtime_error(filename + ":" + std::to_string(line) + ": face needs at least three vertices");
+            }
+            for (size_t i = 1; i + 1 < face.size(); ++i) {
+                mesh.indices.push_back(face[0]);
+                mesh.indices.push_back(face[i]);
+                mesh.indices.push_back(face[i + 1]);
+            }
+        }
+
+        // On to the next line
+        while (c < end && *c != '\n') ++c;
+        if (c < end) ++c;
+        ++line;
+    }
+    return mesh;
+}
+
+// Binary PLY (little or big endian): the x, y, z properties of the "vertex" element and the
+// index list of the "face" element. Other elements and properties are skipped, faces with
+// more than three vertices are triangulated as fans.
+inline MeshData loadPLY(const std::string& filename) {
+    std::vector<char> buffer = readWholeFile(filename);
+    size_t file_size = buffer.size() - 1;
+
+    struct Property {
+        std::string name;
+        int size = 0;           // Size in bytes of the value, or of every list item
+        char kind = 'f';        // 'f' floating point, 'i' signed, 'u' unsigned
+        bool is_list = false;
+        int count_size = 0;     // Size in bytes of the list length
+    };
+    struct Element {
+        std::string name;
+        size_t count = 0;
+        std::vector<Property> properties;
+    };
+
+    auto parseType = [&](const std::string& type, Property& property) {
+        if (type == "char" || type == "int8") { property.size = 1; property.kind = 'i'; }
+        else if (type == "uchar" || type == "uint8") { property.size = 1; property.kind = 'u'; }
+        else if (type == "short" || type == "int16") { property.size = 2; property.kind = 'i'; }
+        else if (type == "ushort" || type == "uint16") { property.size = 2; property.kind = 'u'; }
+        else if (type == "int" || type == "int32") { property.size = 4; property.kind = 'i'; }
+        else if (type == "uint" || type == "uint32") { property.size = 4; property.kind = 'u'; }
+        else if (type == "float" || type == "float32") { property.size = 4; property.kind = 'f'; }
+        else if (type == "double" || type == "float64") { property.size = 8; property.kind = 'f'; }
+        else throw std::runtime_error(filename + ": unknown PLY property type '" + type + "'");
+    };
+
+    // Header
+    const char* header_end = std::strstr(buffer.data(), "end_header");
+    if (std::strncmp(buffer.data(), "ply", 3) != 0 || header_end == nullptr) {
+        throw std::runtime_error(filename + ": not a PLY file");
+    }
+    std::istringstream header(std::string(buffer.data(), static_cast<size_t>(header_end - buffer.data())));
+    std::vector<Element> elements;
+    bool big_endian = false;
+    std::string line;
+    while (std::getline(header, line)) {
+        std::istringstream words(line);
+        std::string keyword;
+        words >> keyword;
+        if (keyword == "format") {
+            std::string format;
+            words >> format;
+            if (format == "ascii") {
+                throw std::runtime_error(filename + ": ASCII PLY is not supported, convert it to binary");
+            }
+            big_endian = format == "binary_big_endian";
+        } else if (keyword == "element") {
+            Element element;
+            words >> element.name >> element.count;
+            elements.push_back(element);
+        } else if (keyword == "property") {
+            if (elements.empty()) {
+                throw std::runtime_error(filename + ": PLY property before any element");
+            }
+            Property property;
+            std::string type;
+            words >> type;
+            if (type == "list") {
+                std::string count_type, item_type;
+                words >> count_type >> item_type;
+                Property count_property;
+                parseType(count_type, count_property);
+                parseType(item_type, property);
+                property.is_list = true;
+                property.count_size = count_property.size;
+            } else {
+                parseType(type, property);
+            }
+            words >> property.name;
+            elements.back().properties.push_back(property);
+        }
+    }
+
+    // The body starts on the line after end_header
+    size_t offset = static_cast<size_t>(header_end - buffer.data());
+    while (offset < file_size && buffer[offset] != '\n') ++offset;
+    ++offset;
+
+    std::uint16_t probe = 1;
+    unsigned char low_byte;
+    std::memcpy(&low_byte, &probe, 1);
+    bool swap_bytes = big_endian != (low_byte == 0);
+
+    // One value of the given size and kind at byte offset 'at' of the body
+    auto readNumber = [&](size_t at, int size, char kind) -> double {
+        if (at + size > file_size) {
+            throw std::runtime_error(filename + ": PLY body is truncated");
+        }
+        unsigned char bytes[8];
+        std::memcpy(bytes, buffer.data() + at, size);
+        if (swap_bytes) {
+            for (int i = 0; i < size / 2; ++i) std::swap(bytes[i], bytes[size - 1 - i]);
+        }
+        if (kind == 'f') {
+            if (size == 4) { float value; std::memcpy(&value, bytes, 4); return value; }
+            double value; std::memcpy(&value, bytes, 8); return value;
+        }
+        if (kind == 'u') {
+            if (size == 1) return bytes[0];
+            if (size == 2) { std::uint16_t value; std::memcpy(&value, bytes, 2); return value; }
+            std::uint32_t value; std::memcpy(&value, bytes, 4); return value;
+        }
+        if (size == 1) { std::int8_t value; std::memcpy(&value, bytes, 1); return value; }
+        if (size == 2) { std::int16_t value; std::memcpy(&value, bytes, 2); return value; }
+        std::int32_t value; std::memcpy(&value, bytes, 4); return value;
+    };
+
+    MeshData mesh;
+    size_t vertex_count = 0;
+    for (const Element& element : elements) {
+        if (element.name == "vertex") {
+            // Fixed-size records: find the offsets of x, y and z once
+            int stride = 0;
+            int field_offset[3] = {-1, -1, -1};
+            const Property* field[3] = {nullptr, nullptr, nullptr};
+            for (const Property& property : element.properties) {
+                if (property.is_list) {
+                    throw std::runtime_error(filename + ": list properties on vertices are not supported");
+                }
+                int axis = property.name == "x" ? 0 : (property.name == "y" ? 1 : (property.name == "z" ? 2 : -1));
+                if (axis >= 0) {
+                    field_offset[axis] = stride;
+                    field[axis] = &property;
+                }
+                stride += property.size;
+            }
+            if (field[0] == nullptr || field[1] == nullptr || field[2] == nullptr) {
+                throw std::runtime_error(filename + ": PLY vertices need x, y and z properties");
+            }
+            if (offset + element.count * stride > file_size) {
+                throw std::runtime_error(filename + ": PLY body is truncated");
+            }
+
+            vertex_count = element.count;
+            mesh.vertices.resize(3 * element.count);
+            bool plain_floats = !swap_bytes && field[0]->kind == 'f' && field[0]->size == 4
+                && field[1]->kind == 'f' && field[1]->size == 4 && field[2]->kind == 'f' && field[2]->size == 4;
+            for (size_t v = 0; v < element.count; ++v) {
+                size_t record = offset + v * stride;
+                for (int axis = 0; axis < 3; ++axis) {
+                    if (plain_floats) {
+                        std::memcpy(&mesh.vertices[3 * v + axis], buffer.data() + record + field_offset[axis], 4);
+                    } else {
+                        mesh.vertices[3 * v + axis] = static_cast<float>(readNumber(record + field_offset[axis], field[axis]->size, field[axis]->kind));
+                    }
+                }
+            }
+            offset += element.count * stride;
+        } else {
+            bool is_face = element.name == "face";
+            mesh.indices.reserve(is_face ? 3 * element.count : 0);
+            std::vector<std::uint32_t> face;
+            for (size_t e = 0; e < element.count; ++e) {
+                for (const Property& property : element.properties) {
+                    if (!property.is_list) {
+                        offset += property.size;
+                        continue;
+                    }
+                    size_t count = static_cast<size_t>(readNumber(offset, property.count_size, 'u'));
+                    offset += property.count_size;
+                    bool is_indices = is_face && (property.name == "vertex_indices" || property.name == "vertex_index");
+                    if (!is_indices) {
+                        offset += count * property.size;
+                        continue;
+                    }
+                    face.clear();
+                    for (size_t i = 0; i < count; ++i, offset += property.size) {
+                        double index = readNumber(offset, property.size, property.kind);
+                        if (index < 0 || index >= static_cast<double>(vertex_count)) {
+                            throw std::runtime_error(filename + ": face index out of range");
+                        }
+                        face.push_back(static_cast<std::uint32_t>(index));
+                    }
+                    for (size_t i = 1; i + 1 < face.size(); ++i) {
+                        mesh.indices.push_back(face[0]);
+                        mesh.indices.push_back(face[i]);
+                        mesh.indices.push_back(face[i + 1]);
+                    }
+                }
+            }
+            if (offset > file_size) {
+                throw std::runtime_error(filename + ": PLY body is truncated");
+            }
+        }
+    }
+    return mesh;
+}
+
+// Picks the loader from the file extension
+inline MeshData loadMeshFile(const std::string& filename) {
+    std::string extension = filename.substr(filename.find_last_of('.') + 1);
+    for (char& ch : extension) ch = static_cast<char>(std::tolower(static_cast<unsigned char>(ch)));
+    if (extension == "obj") {
+        return loadOBJ(filename);
+    } else if (extension == "ply") {
+        return loadPLY(filename);
+    }
+    throw std::runtime_error("Unsupported mesh file '" + filename + "', expected .obj or .ply");
+}
+
+#endif // MESH_LOADER_H
@@ -3,24 +3,40 @@
 
 #include "vector.h"
 
-class Ray {
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+template <typename T>
+class RayT {
 public:
-    Point3D origin;
-    Vector3D direction;
+    Vector3T<T> origin;
+    Vector3T<T> direction;
 
-    Ray() {} // Default constructor
+    RayT() {} // Default constructor
 
-    Ray(const Point3D& origin, const Vector3D& direction)
+    RayT(const Vector3T<T>& origin, const Vector3T<T>& direction)
         : origin(origin), direction(direction) {}
 
     // Getter methods
-    Point3D getOrigin() const { return origin; }
-    Vector3D getDirection() const { return direction; }
+    Vector3T<T> getOrigin() const { return origin; }
+    Vector3T<T> getDirection() const { return direction; }
 
     // Calculate the point on the ray at t
-    Point3D at(double t) const {
+    Vector3T<T> at(T t) const {
         return origin + direction * t;
     }
 };
 
+// Rays in the scalar type of the geometry
+typedef RayT<real> Ray;
+
+// Smallest t accepted on a ray that leaves a surface at origin, so that rounding error in the hit point
+// cannot make it hit the same surface again: 0.001, or 16 ulps of the largest coordinate of origin if
+// that is more. Only float builds get there, beyond about 500 units from the world origin
+inline real ray_epsilon(const Vector3T<real>& origin) {
+    real magnitude = std::max(std::fabs(origin.x), std::max(std::fabs(origin.y), std::fabs(origin.z)));
+    return std::max(real(0.001), magnitude * 16 * std::numeric_limits<real>::epsilon());
+}
+
 #endif // RAY_H
\ No newline at end of file
@@ -0,0 +1,38 @@
+#ifndef RAY_COUNTERS_H
+#define RAY_COUNTERS_H
+
+#include <cstdint>
+
+// Number of rays traced, by kind. Every thread counts into its own copy (thread_ray_counters)
+// so the hot path never touches shared memory; the camera adds them up after a render.
+struct RayCounters {
+    std::uint64_t primary = 0;      // Camera rays
+    std::uint64_t closest_hit = 0;  // All closest-hit queries, camera rays included
+    std::uint64_t shadow = 0;       // Any-hit (shadow ray) queries
+
+    std::uint64_t secondary() const {return closest_hit - primary;}
+    std::uint64_t total() const {return closest_hit + shadow;}
+
+    RayCounters& operator+=(const RayCounters& other) {
+        primary += other.primary;
+        closest_hit += other.closest_hit;
+        shadow += other.shadow;
+        return *this;
+    }
+
+    // Rays counted since an earlier snapshot of the same counters
+    RayCounters operator-(const RayCounters& earlier) const {
+        RayCounters difference;
+        difference.primary = primary - earlier.primary;
+        difference.closest_hit = closest_hit - earlier.closest_hit;
+        difference.shadow = shadow - earlier.shadow;
+        return difference;
+    }
+};
+
+inline RayCounters& thread_ray_counters() {
+    static thread_local RayCounters counters;
+    return counters;
+}
+
+#endif // RAY_COUNTERS_H
@@ -0,0 +1,210 @@
+#ifndef RAY_PACKET_H
+#define RAY_PACKET_H
+
+#include "aabb.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// Lanes of the packet slab test: as many rays per instruction as the vector unit holds, 8 doubles or
+// 16 floats with AVX-512, 4 doubles or 8 floats with AVX2, one ray at a time without either.
+// min and max take their operands in the order that makes them return the same value as the
+// std::min/std::max of AABB::slab, NaNs included, so a packet sees exactly the boxes its rays
+// would see one by one.
+#if defined(__AVX512F__) && defined(RT_FLOAT)
+struct PacketLanes {
+    typedef __m512 Lanes;
+    static const int width = 16;
+    static Lanes load(const real* p) {return _mm512_loadu_ps(p);}
+    static Lanes splat(real s) {return _mm512_set1_ps(s);}
+    static Lanes sub(Lanes a, Lanes b) {return _mm512_sub_ps(a, b);}
+    static Lanes mul(Lanes a, Lanes b) {return _mm512_mul_ps(a, b);}
+    // a < b ? a : b and a > b ? a : b. The zero-masked forms compile to the same instruction, the plain
+    // ones trip GCC 12's -Wmaybe-uninitialized on the _mm512_undefined operand inside them
+    static Lanes min(Lanes a, Lanes b) {return _mm512_maskz_min_ps(0xFFFF, a, b);}
+    static Lanes max(Lanes a, Lanes b) {return _mm512_maskz_max_ps(0xFFFF, a, b);}
+    static unsigned ge(Lanes a, Lanes b) {return _mm512_cmp_ps_mask(a, b, _CMP_GE_OQ);}
+};
+#elif defined(__AVX512F__)
+struct PacketLanes {
+    typedef __m512d Lanes;
+    static const int width = 8;
+    static Lanes load(const real* p) {return _mm512_loadu_pd(p);}
+    static Lanes splat(real s) {return _mm512_set1_pd(s);}
+    static Lanes sub(Lanes a, Lanes b) {return _mm512_sub_pd(a, b);}
+    static Lanes mul(Lanes a, Lanes b) {return _mm512_mul_pd(a, b);}
+    static Lanes min(Lanes a, Lanes b) {return _mm512_maskz_min_pd(0xFF, a, b);}
+    static Lanes max(Lanes a, Lanes b) {return _mm512_maskz_max_pd(0xFF, a, b);}
+    static unsigned ge(Lanes a, Lanes b) {return _mm512_cmp_pd_mask(a, b, _CMP_GE_OQ);}
+};
+#elif defined(__AVX2__) && defined(RT_FLOAT)
+struct PacketLanes {
+    typedef __m256 Lanes;
+    static const int width = 8;
+    static Lanes load(const real* p) {return _mm256_loadu_ps(p);}
+    static Lanes splat(real s) {return _mm256_set1_ps(s);}
+    static Lanes sub(Lanes a, Lanes b) {return _mm256_sub_ps(a, b);}
+    static Lanes mul(Lanes a, Lanes b) {return _mm256_mul_ps(a, b);}
+    static Lanes min(Lanes a, Lanes b) {return _mm256_min_ps(a, b);}
+    static Lanes max(Lanes a, Lanes b) {return _mm256_max_ps(a, b);}
+    static unsigned ge(Lanes a, Lanes b) {return _mm256_movemask_ps(_mm256_cmp_ps(a, b, _CMP_GE_OQ));}
+};
+#elif defined(__AVX2__)
+struct PacketLanes {
+    typedef __m256d Lanes;
+    static const int width = 4;
+    static Lanes load(const real* p) {return _mm256_loadu_pd(p);}
+    static Lanes splat(real s) {return _mm256_set1_pd(s);}
+    static Lanes sub(Lanes a, Lanes b) {return _mm256_sub_pd(a, b);}
+    static Lanes mul(Lanes a, Lanes b) {return _mm256_mul_pd(a, b);}
+    static Lanes min(Lanes a, Lanes b) {return _mm256_min_pd(a, b);}
+    static Lanes max(Lanes a, Lanes b) {return _mm256_max_pd(a, b);}
+    static unsigned ge(Lanes a, Lanes b) {return _mm256_movemask_pd(_mm256_cmp_pd(a, b, _CMP_GE_OQ));}
+};
+#else
+struct PacketLanes {
+    typedef real Lanes;
+    static const int width = 1;
+    static Lanes load(const real* p) {return *p;}
+    static Lanes splat(real s) {return s;}
+    static Lanes sub(Lanes a, Lanes b) {return a - b;}
+    static Lanes mul(Lanes a, Lanes b) {return a * b;}
+    static Lanes min(Lanes a, Lanes b) {return a < b ? a : b;}
+    static Lanes max(Lanes a, Lanes b) {return a > b ? a : b;}
+    static unsigned ge(Lanes a, Lanes b) {return a >= b ? 1u : 0u;}
+};
+#endif
+
+// Up to max_size coherent rays traced through the BVH together (see BVH::hit_packet), stored as
+// structure of arrays so the slab test of one box runs over several rays per instruction.
+//
+// Before the per-ray test, a box is checked against the frustum of the whole packet: per axis,
+// the bounds of the ray origins and inverse directions give a lower bound on every ray's entry
+// distance and an upper bound on its exit distance. Floating point rounding is monotonic, so the
+// bounds hold for the rounded per-ray values as well, and a box the frustum misses is missed by
+// every ray. This needs the rays to travel the same way along each axis; set() refuses packets
+// whose directions diverge in sign, and those are traced one ray at a time.
+class RayPacket {
+    public:
+        static const int max_size = 16;
+
+        int size = 0;
+        bool dir_is_negative[3];
+
+        alignas(64) real origin[3][max_size];
+        alignas(64) real inv_direction[3][max_size];
+        alignas(64) real t_min[max_size];
+        alignas(64) real t_max[max_size];   // Shrunk to the closest hit so far by the caller
+
+        // Fill the packet with count rays (at most max_size), each with the interval ray_t[k].
+        // Returns false if the directions diverge in sign along some axis, i.e. the packet is not coherent
+        bool set(const Ray* rays, const Interval* ray_t, int count) {
+            size = count;
+            for (int axis = 0; axis < 3; ++axis) {
+                dir_is_negative[axis] = component(rays[0].getDirection(), axis) < 0;
+            }
+            for (int k = 0; k < max_size; ++k) {
+                if (k < count) {
+                    Point3D o = rays[k].getOrigin();
+                    Vector3D d = rays[k].getDirection();
+                    for (int axis = 0; axis < 3; ++axis) {
+                        if ((component(d, axis) < 0) != dir_is_negative[axis]) return false;
+                        origin[axis][k] = component(o, axis);
+                        inv_direction[axis][k] = static_cast<real>(1.0 / component(d, axis));   // As in BVH::hit_leaves
+                    }
+                    t_min[k] = ray_t[k].min;
+                    t_max[k] = ray_t[k].max;
+                } else {
+                    // Padding lanes never hit a box: their interval is empty
+                    for (int axis = 0; axis < 3; ++axis) {
+                        origin[axis][k] = 0;
+                        inv_direction[axis][k] = 0;
+                    }
+                    t_min[k] = std::numeric_limits<real>::infinity();
+                    t_max[k] = -std::numeric_limits<real>::infinity();
+                }
+            }
+
+            for (int axis = 0; axis < 3; ++axis) {
+                const real* o = origin[axis];
+                const real* inv = inv_direction[axis];
+                origin_min[axis] = *std::min_element(o, o + count);
+                origin_max[axis] = *std::max_element(o, o + count);
+                inv_min[axis] = *std::min_element(inv, inv + count);
+                inv_max[axis] = *std::max_element(inv, inv + count);
+                // A zero direction component makes the inverse infinite; the frustum then says nothing along this axis
+                frustum_axis[axis] = std::isfinite(inv_min[axis]) && std::isfinite(inv_max[axis]);
+            }
+            near_bound = *std::min_element(t_min, t_min + count);
+            update_far_bound();
+            return true;
+        }
+
+        // Call after changing t_max, so the frustum test culls boxes behind every ray's closest hit
+        void update_far_bound() {
+            far_bound = *std::max_element(t_max, t_max + size);
+        }
+
+        // True if no ray of the packet can hit the box
+        bool frustum_misses(const AABB& box) const {
+            real entry = near_bound;    // Lower bound on every ray's entry distance
+            real exit = far_bound;      // Upper bound on every ray's exit distance
+            for (int axis = 0; axis < 3; ++axis) {
+                if (!frustum_axis[axis]) continue;
+                const Interval& slab = box.axis(axis);
+                real to_min = slab.min - origin_max[axis];    // At most slab.min - o for every ray
+                real to_max = slab.max - origin_min[axis];    // At least slab.max - o for every ray
+                real low, high;
+                if (!dir_is_negative[axis]) {
+                    low = to_min * (to_min >= 0 ? inv_min[axis] : inv_max[axis]);
+                    high = to_max * (to_max >= 0 ? inv_max[axis] : inv_min[axis]);
+                } else {
+                    low = to_max * (to_max >= 0 ? inv_min[axis] : inv_max[axis]);
+                    high = to_min * (to_min >= 0 ? inv_max[axis] : inv_min[axis]);
+                }
+                entry = std::max(entry, low);
+                exit = std::min(exit, high * AABB::far_scale());
+            }
+            return entry > exit;
+        }
+
+        // Bit k set if ray k hits the box within [t_min[k], t_max[k]], with the same arithmetic as AABB::hit
+        unsigned slab_mask(const AABB& box) const {
+            typedef PacketLanes L;
+            const L::Lanes far_scale = L::splat(AABB::far_scale());
+            const Interval* slabs[3] = {&box.x, &box.y, &box.z};
+            unsigned mask = 0;
+            for (int k = 0; k < size; k += L::width) {
+                L::Lanes near = L::load(t_min + k);
+                L::Lanes far = L::load(t_max + k);
+                for (int axis = 0; axis < 3; ++axis) {
+                    L::Lanes o = L::load(origin[axis] + k);
+                    L::Lanes inv = L::load(inv_direction[axis] + k);
+                    L::Lanes t0 = L::mul(L::sub(L::splat(slabs[axis]->min), o), inv);
+                    L::Lanes t1 = L::mul(L::sub(L::splat(slabs[axis]->max), o), inv);
+                    near = L::max(L::min(t1, t0), near);
+                    far = L::min(L::mul(L::max(t1, t0), far_scale), far);
+                }
+                mask |= L::ge(far, near) << k;
+            }
+            return mask & ((1u << size) - 1);
+        }
+
+    private:
+        real origin_min[3], origin_max[3];
+        real inv_min[3], inv_max[3];
+        bool frustum_axis[3];
+        real near_bound;
+        real far_bound;
+
+        static real component(const Vector3D& v, int axis) {
+            return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+        }
+};
+
+#endif // RAY_PACKET_H
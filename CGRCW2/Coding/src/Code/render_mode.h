@@ -0,0 +1,46 @@
+#ifndef RENDER_MODE_H
+#define RENDER_MODE_H
+
+#include <string>
+
+// Render modes of the scene file's "rendermode" key.
+// The name is resolved once when the scene is loaded; the integrators are
+// specialized per mode, so no strings are compared while rendering.
+enum RenderMode {
+    RENDER_BINARY,      // Red where a ray hits anything
+    RENDER_NORMAL,      // Surface normal as color
+    RENDER_DIFFUSE,     // Random diffuse bounces
+    RENDER_PHONG,       // Blinn-Phong lighting with shadow rays and material scattering
+    RENDER_PBR          // Path tracing with light sampling and BSDF sampling combined by MIS
+};
+
+// Returns false if name is not a known render mode
+inline bool parseRenderMode(const std::string& name, RenderMode& mode) {
+    if (name == "binary") {
+        mode = RENDER_BINARY;
+    } else if (name == "normal") {
+        mode = RENDER_NORMAL;
+    } else if (name == "diffuse") {
+        mode = RENDER_DIFFUSE;
+    } else if (name == "phong") {
+        mode = RENDER_PHONG;
+    } else if (name == "pbr") {
+        mode = RENDER_PBR;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+inline const char* renderModeName(RenderMode mode) {
+    switch (mode) {
+        case RENDER_BINARY:  return "binary";
+        case RENDER_NORMAL:  return "normal";
+        case RENDER_DIFFUSE: return "diffuse";
+        case RENDER_PHONG:   return "phong";
+        case RENDER_PBR:     return "pbr";
+    }
+    return "unknown";
+}
+
+#endif // RENDER_MODE_H
@@ -0,0 +1,25 @@
+#ifndef ROULETTE_H
+#define ROULETTE_H
+
+#include "color.h"
+#include "math_utils.h"
+
+#include <algorithm>
+
+// Russian roulette for path termination, shared by both integrators so they draw the same numbers.
+// After roulette_depth bounces, a path whose throughput has dropped below 1 is ended with probability
+// q = max(0.05, 1 - max component), and a surviving path has its throughput divided by 1 - q, so the
+// expected color is unchanged (Pharr et al., PBR 3rd ed., 14.5.1). Paths that still carry full
+// energy are never cut and draw no random number. roulette_depth 0 turns the roulette off.
+// Returns false if the path ends here, with a color of zero.
+inline bool survives_roulette(Color& throughput, int bounces, int roulette_depth) {
+    if (roulette_depth <= 0 || bounces < roulette_depth) return true;
+    double carried = std::max(throughput.x, std::max(throughput.y, throughput.z));
+    if (carried >= 1) return true;
+    double q = std::max(0.05, 1 - carried);
+    if (random_double() < q) return false;
+    throughput = throughput * (1 / (1 - q));
+    return true;
+}
+
+#endif // ROULETTE_H
@@ -1,4 +1,4 @@
 @echo off
 set /p file_location="Enter the file location: "
 set /p file_name="Enter the output file name: "
-raytracer %file_location% > output/%file_name%.ppm
\ No newline at end of file
+raytracer --output output/%file_name%.ppm %file_location%
\ No newline at end of file
@@ -0,0 +1,55 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <cstdint>
+
+// Counter-based random number stream.
+// A stream is keyed on (seed, pixel, sample) and every draw from it is numbered by a
+// dimension counter, so each value is a pure function of those four numbers. Nothing is
+// shared between threads and the image does not depend on thread count or tile order.
+class Sampler {
+    public:
+        Sampler() : key(mix(0)), dimension(0) {}
+
+        Sampler(std::uint64_t seed, std::uint64_t pixel, std::uint64_t sample)
+            : key(mix(mix(mix(seed) ^ pixel) ^ sample)), dimension(0) {}
+
+        // SplitMix64 evaluated at position 'dimension' of the stream
+        std::uint64_t next_uint64() {
+            return mix(key + (dimension++) * golden_gamma);
+        }
+
+        // Uniform real in [0,1) with the full 53 bits of double precision
+        double next_double() {
+            return (next_uint64() >> 11) * (1.0 / 9007199254740992.0);
+        }
+
+        std::uint64_t getDimension() const {return dimension;}
+
+    private:
+        static const std::uint64_t golden_gamma = 0x9E3779B97F4A7C15ULL;
+
+        std::uint64_t key;
+        std::uint64_t dimension;
+
+        // SplitMix64 finalizer, a bijective avalanche mix of all 64 bits
+        static std::uint64_t mix(std::uint64_t z) {
+            z += golden_gamma;
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+            return z ^ (z >> 31);
+        }
+};
+
+// Stream used by random_double() on the calling thread. The renderer restarts it for every pixel sample
+inline Sampler& thread_sampler() {
+    static thread_local Sampler sampler;
+    return sampler;
+}
+
+// Point the calling thread at the stream of one pixel sample
+inline void start_sample(std::uint64_t seed, std::uint64_t pixel, std::uint64_t sample) {
+    thread_sampler() = Sampler(seed, pixel, sample);
+}
+
+#endif // SAMPLER_H
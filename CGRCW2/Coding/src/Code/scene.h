@@ -4,11 +4,47 @@
 #include "sphere.h"
 #include "triangle.h"
 #include "cylinder.h"
+#include "mesh.h"
 #include "light.h"
+#include "bvh.h"
+#include "light_tree.h"
+#include "sphere_batch.h"
+#include "ray_counters.h"
+#include "stats.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
 #include <memory>
+#include <stdexcept>
+#include <unordered_map>
 #include <vector>
 
+// How the lights are sampled at every hit point in phong mode
+enum LightSampling {
+    LIGHT_SAMPLING_ALL,     // Shadow rays towards every light
+    LIGHT_SAMPLING_TREE     // Shadow rays towards light_samples lights picked from the light tree
+};
+
+// How pbr mode weights light sampling against BSDF sampling where both can find a light (Veach 1997, 9.2).
+// The last two keep one strategy alone, for comparison; lights of radius 0 always get light samples
+enum MISHeuristic {
+    MIS_POWER,      // Squared densities, the default
+    MIS_BALANCE,    // Densities
+    MIS_LIGHT,      // Light samples only
+    MIS_BSDF        // BSDF samples only
+};
+
+// Arrays of plain primitive records the scene keeps, one per kind of shape, see Scene::hitPrimitive
+enum PrimitiveArray : std::uint8_t {PRIMITIVE_SPHERE, PRIMITIVE_TRIANGLE, PRIMITIVE_CYLINDER, PRIMITIVE_MESH, PRIMITIVE_SHAPE};
+
+// Where the record of one shape is: the array of its kind and the index in it
+struct PrimitiveRef {
+    std::uint32_t index;
+    std::uint8_t kind;
+    bool casts_shadow;      // False for refractive materials, which shadow rays pass through
+};
+
 // Scene class
 // A scene is a collection of shapes
 class Sphere;
@@ -16,34 +52,311 @@ class Scene : public Shape {
     private: 
         std::vector<std::shared_ptr<Shape>> shapes;
         std::vector<std::shared_ptr<Light>> lights;  // Add this line
+        // Material table: shapes and hit records refer to materials by their index here, so tracing a ray
+        // copies a 32-bit index instead of a shared_ptr and its atomic reference count
+        std::vector<std::shared_ptr<Material>> materials;
+        std::unordered_map<const Material*, std::uint32_t> material_ids;
+        BVH bvh;    // Built over shapes by build_bvh(); while empty, hit() falls back to the linear scan
+
+        // What rays are traced against: add() compiles every shape into a plain record in the array of its
+        // kind, so testing a primitive is a switch on its kind instead of a virtual call through a pointer to
+        // a separately allocated object. Once the BVH is built, the records are stored in its leaf order.
+        // Meshes keep their own BVH and other Shape classes their virtual hit(), both reached by pointer
+        std::vector<SpherePrimitive> sphere_prims;
+        std::vector<TrianglePrimitive> triangle_prims;
+        std::vector<CylinderPrimitive> cylinder_prims;
+        std::vector<const TriangleMesh*> mesh_prims;
+        std::vector<const Shape*> other_prims;
+        std::vector<PrimitiveRef> refs;         // Per shape
+        std::vector<PrimitiveRef> leaf_refs;    // Per entry of the BVH's primitive indices, in leaf order
+
+        // Spheres moved into SoA storage by pack_spheres() are tested with the SIMD kernel,
+        // through their own BVH whose leaves index the batch directly
+        SphereBatch sphere_batch;
+        BVH sphere_bvh;
+        std::vector<int> unbatched;     // Indices of the shapes that are not in sphere_batch, covered by bvh
+
+        LightSampling light_sampling = LIGHT_SAMPLING_ALL;
+        int light_samples = 1;
+        LightTree light_tree;
+
+        static const int max_shadow_rays = 256;
+        int shadow_rays = 10;   // Shadow rays per light with a radius and hit point, at most max_shadow_rays
+        MISHeuristic mis_heuristic = MIS_POWER;
+
+        // Append the record of shape to the array of its kind. Its material index must already be set
+        PrimitiveRef addPrimitive(const Shape* shape) {
+            PrimitiveRef ref = {0, PRIMITIVE_SHAPE, true};
+            if (const Sphere* sphere = dynamic_cast<const Sphere*>(shape)) {
+                ref.kind = PRIMITIVE_SPHERE;
+                ref.index = static_cast<std::uint32_t>(sphere_prims.size());
+                sphere_prims.push_back(sphere->primitive());
+            } else if (const Triangle* triangle = dynamic_cast<const Triangle*>(shape)) {
+                ref.kind = PRIMITIVE_TRIANGLE;
+                ref.index = static_cast<std::uint32_t>(triangle_prims.size());
+                triangle_prims.push_back(triangle->primitive());
+            } else if (const Cylinder* cylinder = dynamic_cast<const Cylinder*>(shape)) {
+                ref.kind = PRIMITIVE_CYLINDER;
+                ref.index = static_cast<std::uint32_t>(cylinder_prims.size());
+                cylinder_prims.push_back(cylinder->primitive());
+            } else if (const TriangleMesh* mesh = dynamic_cast<const TriangleMesh*>(shape)) {
+                ref.kind = PRIMITIVE_MESH;
+                ref.index = static_cast<std::uint32_t>(mesh_prims.size());
+                mesh_prims.push_back(mesh);
+            } else {
+                ref.index = static_cast<std::uint32_t>(other_prims.size());
+                other_prims.push_back(shape);
+            }
+            return ref;
+        }
+
+        // Rewrite the sphere, triangle and cylinder arrays in the leaf order of bvh, followed by the shapes
+        // outside it, so that a traversal walks every array front to back; then fill leaf_refs
+        void order_primitives() {
+            std::vector<int> order;
+            order.reserve(shapes.size());
+            std::vector<char> placed(shapes.size(), 0);
+            for (int prim : bvh.getPrimIndices()) {
+                order.push_back(unbatched[prim]);
+                placed[unbatched[prim]] = 1;
+            }
+            for (size_t i = 0; i < shapes.size(); ++i) {
+                if (!placed[i]) order.push_back(static_cast<int>(i));
+            }
+
+            std::vector<SpherePrimitive> spheres;
+            std::vector<TrianglePrimitive> triangles;
+            std::vector<CylinderPrimitive> cylinders;
+            spheres.reserve(sphere_prims.size());
+            triangles.reserve(triangle_prims.size());
+            cylinders.reserve(cylinder_prims.size());
+            for (int shape : order) {
+                PrimitiveRef& ref = refs[shape];
+                if (ref.kind == PRIMITIVE_SPHERE) {
+                    spheres.push_back(sphere_prims[ref.index]);
+                    ref.index = static_cast<std::uint32_t>(spheres.size() - 1);
+                } else if (ref.kind == PRIMITIVE_TRIANGLE) {
+                    triangles.push_back(triangle_prims[ref.index]);
+                    ref.index = static_cast<std::uint32_t>(triangles.size() - 1);
+                } else if (ref.kind == PRIMITIVE_CYLINDER) {
+                    cylinders.push_back(cylinder_prims[ref.index]);
+                    ref.index = static_cast<std::uint32_t>(cylinders.size() - 1);
+                }
+            }
+            sphere_prims.swap(spheres);
+            triangle_prims.swap(triangles);
+            cylinder_prims.swap(cylinders);
+
+            leaf_refs.clear();
+            leaf_refs.reserve(bvh.getPrimIndices().size());
+            for (int prim : bvh.getPrimIndices()) {
+                leaf_refs.push_back(refs[unbatched[prim]]);
+            }
+        }
+
+        void build_light_tree() {
+            std::vector<Point3D> positions;
+            std::vector<double> powers;
+            for (const auto& light : lights) {
+                Color intensity = light->getIntensity();
+                positions.push_back(light->getPosition());
+                powers.push_back((std::fabs(intensity.x) + std::fabs(intensity.y) + std::fabs(intensity.z)) / 3);
+            }
+            light_tree.build(positions, powers);
+        }
     public:
 
         Scene() {};
         Scene(std::shared_ptr<Shape> shape) {add(shape);}
         Scene(std::shared_ptr<Light> light) {add(light);}
 
-        void clear() {shapes.clear(); lights.clear();}  // Clear lights as well
+        void clear() {  // Clear lights as well
+            shapes.clear(); lights.clear(); materials.clear(); material_ids.clear(); unbatched.clear(); light_tree = LightTree();
+            sphere_prims.clear(); triangle_prims.clear(); cylinder_prims.clear(); mesh_prims.clear(); other_prims.clear();
+            refs.clear(); leaf_refs.clear();
+            sphere_batch.clear(); bvh = BVH(); sphere_bvh = BVH();
+        }
 
-        void add(std::shared_ptr<Shape> shape) {
+        // Add a shape, compiled into its record with the derived data (squared and inverse radii, triangle edges
+        // and normals, unit cylinder axes and cap centers) worked out once. Its geometry is checked here with
+        // Shape::validate(): a shape that cannot be intersected is dropped with an error message, so the
+        // intersection routines never check a ray against it. Returns false if the shape was dropped
+        bool add(std::shared_ptr<Shape> shape) {
+            try {
+                shape->validate();
+            } catch (const std::invalid_argument& e) {
+                std::cerr << "Error: " << e.what() << ". Skipping shape." << std::endl;
+                return false;
+            }
             shapes.push_back(shape);
             shape->setScene(this);  // Set the scene of the shape
+            std::uint32_t material = addMaterial(shape->getMaterial());
+            shape->setMaterialId(material);
+            PrimitiveRef ref = addPrimitive(shape.get());
+            ref.casts_shadow = material == no_material || !materials[material]->is_refractive();
+            refs.push_back(ref);
+            unbatched.push_back(static_cast<int>(shapes.size()) - 1);
+            bvh = BVH();            // The BVH no longer covers every shape, build_bvh() has to be called again
+            return true;
+        }
+
+        // Index of material in the material table, adding it on first use. add() calls this for every shape
+        std::uint32_t addMaterial(const std::shared_ptr<Material>& material) {
+            if (!material) return no_material;
+            auto found = material_ids.find(material.get());
+            if (found != material_ids.end()) return found->second;
+            std::uint32_t id = static_cast<std::uint32_t>(materials.size());
+            materials.push_back(material);
+            material_ids[material.get()] = id;
+            return id;
+        }
+
+        // Material of a hit record, by the index stored in Hit_record::material
+        const Material& getMaterial(std::uint32_t id) const {return *materials[id];}
+        int getMaterialCount() const {return static_cast<int>(materials.size());}
+
+        // Move every sphere into the SoA sphere batch, which is intersected with the SIMD kernel
+        // instead of one virtual Sphere::hit call per sphere. Call build_bvh() afterwards to get trees over both sets
+        void pack_spheres() {
+            sphere_batch.clear();
+            unbatched.clear();
+            for (size_t i = 0; i < shapes.size(); ++i) {
+                if (refs[i].kind == PRIMITIVE_SPHERE) {
+                    const SpherePrimitive& sphere = sphere_prims[refs[i].index];
+                    sphere_batch.add(sphere.center, sphere.radius, static_cast<int>(i), refs[i].casts_shadow);
+                } else {
+                    unbatched.push_back(static_cast<int>(i));
+                }
+            }
+            bvh = BVH();
+            sphere_bvh = BVH();
+        }
+
+        // Build a BVH over all shapes added so far, and the light tree over all lights if lights are sampled
+        // from it. Call again after adding more shapes or lights
+        void build_bvh() {
+            RT_STATS_TIMER(STAGE_BVH_BUILD);
+            if (light_sampling == LIGHT_SAMPLING_TREE) build_light_tree();
+            std::vector<AABB> boxes;
+            boxes.reserve(unbatched.size());
+            for (int index : unbatched) {
+                boxes.push_back(shapes[index]->bounding_box());
+            }
+            bvh.build(boxes);
+            order_primitives();
+
+            if (!sphere_batch.empty()) {
+                std::vector<AABB> sphere_boxes;
+                for (int i = 0; i < sphere_batch.size(); ++i) {
+                    sphere_boxes.push_back(shapes[sphere_batch.shape_index(i)]->bounding_box());
+                }
+                sphere_bvh.build(sphere_boxes, SphereBatch::lanes);
+                // Store the spheres in leaf order, so a leaf is a contiguous range of the batch
+                sphere_batch.reorder(sphere_bvh.getPrimIndices());
+            }
+        }
+
+        // Use a BVH built earlier by build_bvh() over the same shapes, e.g. one read from a scene cache.
+        // Only for scenes without packed spheres; throws std::invalid_argument if the tree does not fit
+        void set_bvh(const BVH& tree) {
+            if (!sphere_batch.empty() || tree.getPrimIndices().size() != unbatched.size()) {
+                throw std::invalid_argument("BVH does not cover the shapes of the scene");
+            }
+            bvh = tree;
+            order_primitives();
+        }
+
+        const BVH& getBVH() const {return bvh;}
+        bool has_bvh() const {return !bvh.empty() || !sphere_bvh.empty();}
+        bool has_packed_spheres() const {return !sphere_batch.empty();}
+        const SphereBatch& getSphereBatch() const {return sphere_batch;}
+        // Add a light. With LIGHT_SAMPLING_TREE the light tree no longer covers every light, and it is built
+        // again once all are in, by set_light_sampling() or build_bvh(), rather than on every add
+        void add(std::shared_ptr<Light> light) {
+            lights.push_back(light);
+            light_tree = LightTree();
+        }
+
+        // Shade every light at every hit (the default), or only 'samples' lights picked from a light tree
+        // by their expected contribution. Both give the same image on average
+        void set_light_sampling(LightSampling sampling, int samples = 1) {
+            light_sampling = sampling;
+            light_samples = std::max(1, samples);
+            light_tree = LightTree();
+            if (light_sampling == LIGHT_SAMPLING_TREE) build_light_tree();
+        }
+
+        LightSampling getLightSampling() const {return light_sampling;}
+
+        void set_mis_heuristic(MISHeuristic heuristic) {mis_heuristic = heuristic;}
+        MISHeuristic getMISHeuristic() const {return mis_heuristic;}
+
+        // Hash of the settings above and of set_shadow_rays, which change what a sample estimates
+        // though not its mean; a checkpoint taken with other settings cannot be continued with these
+        std::uint64_t samplingKey() const {
+            std::uint64_t key = 14695981039346656037ULL;
+            key = hash_combine(key, static_cast<std::uint64_t>(light_sampling));
+            key = hash_combine(key, static_cast<std::uint64_t>(light_samples));
+            key = hash_combine(key, static_cast<std::uint64_t>(shadow_rays));
+            return hash_combine(key, static_cast<std::uint64_t>(mis_heuristic));
         }
-        void add(std::shared_ptr<Light> light) {lights.push_back(light);}  // Add this function
         // Check if ray intersects scene, update the hit record if it does
 
         // Getter functions
-        std::vector<std::shared_ptr<Shape>> getShapes() const {return shapes;}
-        std::vector<std::shared_ptr<Light>> getLights() const {return lights;}  // Add this function
+        const std::vector<std::shared_ptr<Shape>>& getShapes() const {return shapes;}
+        const std::vector<std::shared_ptr<Light>>& getLights() const {return lights;}  // Add this function
+        int getLightCount() const {return static_cast<int>(lights.size());}
         
-        virtual bool hit(const Ray& r, Interval ray_t, Hit_record& rec, const Point3D* check_point = nullptr) const override {
-            Hit_record temp_rec;
+        virtual bool hit(const Ray& r, Interval ray_t, Hit_record& rec) const override {
+            thread_ray_counters().closest_hit++;
             bool hit_anything = false;
+
+            if (!sphere_batch.empty()) {
+                int index = -1;
+                bool found;
+                Interval sphere_t = ray_t;
+                if (!sphere_bvh.empty()) {
+                    found = sphere_bvh.hit_leaves(r, ray_t, [&](int first, int count, Interval& t) {
+                        if (!sphere_batch.hit(r, first, count, t, index)) return false;
+                        sphere_t.max = t.max;   // hit_leaves shrinks its own copy of the interval
+                        return true;
+                    });
+                } else {
+                    found = sphere_batch.hit(r, 0, sphere_batch.size(), sphere_t, index);
+                }
+                // Only the winning sphere fills in the hit record. Its own test gives the same distance as
+                // an unpacked scene; where it rejects the kernel's hit, as the float roots of a grazing ray
+                // can, the record is filled at the kernel's distance rather than losing the hit
+                if (found) {
+                    const SpherePrimitive& sphere = sphere_prims[refs[sphere_batch.shape_index(index)].index];
+                    if (!sphere.hit(r, ray_t, rec)) {
+                        sphere.fill(r, sphere_t.max, rec);
+                    }
+                    ray_t.max = rec.t;
+                    hit_anything = true;
+                }
+            }
+
+            if (!bvh.empty()) {
+                // Primitives only write the record when they are hit within ray_t, which the BVH shrinks to the closest hit so far
+                return bvh.hit_leaves(r, ray_t, [&](int first, int count, Interval& t) {
+                    bool found = false;
+                    for (int i = first; i < first + count; ++i) {
+                        if (hitPrimitive(leaf_refs[i], r, t, rec)) {
+                            t.max = rec.t;
+                            found = true;
+                        }
+                    }
+                    return found;
+                }) || hit_anything;
+            }
+
+            Hit_record temp_rec;
             auto closest_so_far = ray_t.max;
 
             // Check if ray intersects any of the shapes in the scene
-            // Could be made more efficient by using a bounding volume hierarchy
-            for (const auto& shape : shapes) {
-                if (shape->hit(r, Interval(ray_t.min, closest_so_far), temp_rec)) {
+            for (int index : unbatched) {
+                if (hitPrimitive(refs[index], r, Interval(ray_t.min, closest_so_far), temp_rec)) {
                     hit_anything = true;
                     closest_so_far = temp_rec.t;
                     rec = temp_rec;
@@ -53,11 +366,98 @@ class Scene : public Shape {
             return hit_anything;
         }
 
-        bool is_light_source_obstructed(const Ray& ray, Interval ray_t, const Point3D& light_position) const override {
-            // Empty implementation
+        // Closest hits of count coherent rays (at most RayPacket::max_size, e.g. neighbouring camera rays) traced
+        // together through the BVH: found[k] and records[k] are what hit(rays[k], ray_t[k], records[k]) gives.
+        // Packets whose directions diverge in sign, scenes without a BVH and scenes with packed spheres
+        // fall back to tracing the rays one at a time
+        void hit_packet(const Ray* rays, const Interval* ray_t, int count, Hit_record* records, bool* found) const {
+            RayPacket packet;
+            if (bvh.empty() || !sphere_batch.empty() || count < 2 || !packet.set(rays, ray_t, count)) {
+                for (int k = 0; k < count; ++k) {
+                    found[k] = hit(rays[k], ray_t[k], records[k]);
+                }
+                return;
+            }
+
+            thread_ray_counters().closest_hit += count;
+            std::fill(found, found + count, false);
+            bvh.hit_packet(packet, [&](int first, int prim_count, unsigned mask) {
+                for (int k = 0; k < count; ++k) {
+                    if (!((mask >> k) & 1)) continue;
+                    Interval t(packet.t_min[k], packet.t_max[k]);
+                    for (int i = first; i < first + prim_count; ++i) {
+                        if (hitPrimitive(leaf_refs[i], rays[k], t, records[k])) {
+                            t.max = records[k].t;
+                            found[k] = true;
+                        }
+                    }
+                    packet.t_max[k] = t.max;
+                }
+            });
+        }
+
+        // Scene-level any-hit query for shadow rays. Returns on the first shadow-casting shape hit within ray_t
+        bool occluded(const Ray& r, Interval ray_t) const override {
+            thread_ray_counters().shadow++;
+            if (!sphere_batch.empty()) {
+                bool blocked;
+                if (!sphere_bvh.empty()) {
+                    blocked = sphere_bvh.any_hit_leaves(r, ray_t, [&](int first, int count) {
+                        return sphere_batch.occluded(r, first, count, ray_t);
+                    });
+                } else {
+                    blocked = sphere_batch.occluded(r, 0, sphere_batch.size(), ray_t);
+                }
+                if (blocked) return true;
+            }
+
+            if (!bvh.empty()) {
+                return bvh.any_hit_leaves(r, ray_t, [&](int first, int count) {
+                    for (int i = first; i < first + count; ++i) {
+                        if (leaf_refs[i].casts_shadow && occludedPrimitive(leaf_refs[i], r, ray_t)) {
+                            return true;
+                        }
+                    }
+                    return false;
+                });
+            }
+
+            for (int index : unbatched) {
+                if (refs[index].casts_shadow && occludedPrimitive(refs[index], r, ray_t)) {
+                    return true;
+                }
+            }
             return false;
         }
 
+        // Closest-hit test of one primitive record. Meshes are called non-virtually by naming TriangleMesh::hit
+        RT_FORCE_INLINE bool hitPrimitive(const PrimitiveRef& ref, const Ray& r, Interval ray_t, Hit_record& rec) const {
+            switch (ref.kind) {
+                case PRIMITIVE_SPHERE:   return sphere_prims[ref.index].hit(r, ray_t, rec);
+                case PRIMITIVE_TRIANGLE: return triangle_prims[ref.index].hit(r, ray_t, rec);
+                case PRIMITIVE_CYLINDER: return cylinder_prims[ref.index].hit(r, ray_t, rec);
+                case PRIMITIVE_MESH:     return mesh_prims[ref.index]->TriangleMesh::hit(r, ray_t, rec);
+                default:                 return other_prims[ref.index]->hit(r, ray_t, rec);
+            }
+        }
+
+        // Any-hit test of one primitive record, for shadow rays
+        RT_FORCE_INLINE bool occludedPrimitive(const PrimitiveRef& ref, const Ray& r, Interval ray_t) const {
+            switch (ref.kind) {
+                case PRIMITIVE_SPHERE:   return sphere_prims[ref.index].occluded(r, ray_t);
+                case PRIMITIVE_TRIANGLE: return triangle_prims[ref.index].occluded(r, ray_t);
+                case PRIMITIVE_CYLINDER: return cylinder_prims[ref.index].occluded(r, ray_t);
+                case PRIMITIVE_MESH:     return mesh_prims[ref.index]->TriangleMesh::occluded(r, ray_t);
+                default:                 return other_prims[ref.index]->occluded(r, ray_t);
+            }
+        }
+
+        // Number of records of each kind, in PrimitiveArray order
+        std::vector<int> getPrimitiveCounts() const {
+            return {static_cast<int>(sphere_prims.size()), static_cast<int>(triangle_prims.size()), static_cast<int>(cylinder_prims.size()),
+                    static_cast<int>(mesh_prims.size()), static_cast<int>(other_prims.size())};
+        }
+
         std::shared_ptr<Material> getMaterial() const override {
             // Empty implementation
             return nullptr;
@@ -78,6 +478,14 @@ class Scene : public Shape {
             return 0;
         }
 
+        AABB bounding_box() const override {
+            AABB box;
+            for (const auto& shape : shapes) {
+                box = AABB(box, shape->bounding_box());
+            }
+            return box;
+        }
+
         virtual void print() const override {
             std::clog << "Scene: " << std::endl;
             for (const auto& shape : shapes) {
@@ -95,98 +503,243 @@ class Scene : public Shape {
     Color calculateLightingForHitPoint(const Ray& ray, const Hit_record& record) const {
         Color total_light(0, 0, 0);
 
-        for (const auto& light : lights) {
-            Point3D light_position = light->getPosition();
-            // Calculate light direction and distance to light
-            Vector3D light_direction = light_position - record.p;
-            double distance_to_light = getLength(light_direction);
-            light_direction = normalize(light_direction);
-            Color light_color = light->getIntensity();
-            int num_shadowrays = 10;
-            Color temp_total_light (0,0,0);
-
-            Vector3D view_direction = -ray.getDirection();
-
-            // Shoot shadow rays
-            for (int i = 0; i < num_shadowrays; i++) {
-                // Get shadow ray
-                Ray shadow_ray = getShadowRay(record.p, light_position);
-                bool is_shadowed = false;
-                
-                // Check if shadow ray intersects any of the shapes in the scene
-                for (const auto& other_shape : shapes) {
-                    std::shared_ptr<Material> mat_ptr = other_shape->getMaterial();
-                    // First check if the shape is refractive. If it is, the shadow ray is not obstructed
-                    if (mat_ptr->is_refractive()) {
-                        // If the shape is refractive, the shadow ray is not obstructed
-                        continue;
-                    }
-                    // If shape is not refractive, do some preliminary checks
-                    if (other_shape->is_sphere()) {
-                        // Check if the sphere is within the interval of the shadow ray. Within the interval of 0 to distance_to_light + radius of sphere
-                        Point3D center = other_shape->getCenter();
-                        double radius = other_shape->getRadius();
-                        Interval interval(0.001, distance_to_light + radius);
-                        double distance_of_center_to_light = getLength(center - light_position);
-                        // if the centre of the sphere is not within the interval, then the sphere is not obstructing the light. Skip this sphere
-                        if (!interval.contains(distance_of_center_to_light)) {
-                            continue;
-                        } else {
-                            Vector3D shape_to_light = light_position - center;
-                            double dot_product = dotProduct(light_direction, shape_to_light);
-                            if (dot_product < 0.5) {        // Adjust this threshold if needed
-                                // Unlikely to cast a shadow
-                                continue;
-                            }
-                        }
-                    } else if (other_shape->is_cylinder()) {
-                        // Check if the cylinder is within the interval of the shadow ray. Within the interval of 0 to distance_to_light + radius of cylinder
-                        Point3D center = other_shape->getCenter();
-                        double radius = other_shape->getRadius();
-                        double height = other_shape->getHeight();
-                        Interval interval(0.001, distance_to_light + std::max(radius, height));
-                        double distance_of_center_to_light = getLength(center - light_position);
-                        // if the centre of the cylinder is not within the interval, then the cylinder is not obstructing the light. Skip this cylinder
-                        if (!interval.contains(distance_of_center_to_light)) {
-                            continue;
-                        } else {
-                            Vector3D shape_to_light = light_position - center;
-                            double dot_product = dotProduct(light_direction, shape_to_light);
-                            if (dot_product < 0.5) {        // Adjust this threshold if needed
-                                // Unlikely to cast a shadow
-                                continue;
-                            }
-                        }
-                    }
-                    // If the shape is not refractive and is within the interval of the shadow ray, check if the shadow ray intersects the shape
-                    if (other_shape->is_light_source_obstructed(shadow_ray, Interval(0.001, distance_to_light), light->getPosition())) { 
-                        is_shadowed = true;
-                        break;
-                    }
-                    
-                }
-
-                // If not shadowed, add light contribution
-                if (!is_shadowed) {
-                    // store in a temporary variable
-                    temp_total_light += record.mat_ptr->shade(record, light_direction, view_direction, light_color, distance_to_light);
-                } else {
-                    // store in a temporary variable
-                    temp_total_light += record.mat_ptr->shade(record, light_direction, view_direction, light_color, -1);
+        int slots = getShadowLightCount();
+        for (int slot = 0; slot < slots; ++slot) {
+            // Shoot shadow rays. Anything between the hit point and the sampled point on the light blocks it
+            char shadowed[max_shadow_rays];
+            int light_index;
+            double weight;
+            {
+                RT_STATS_TIMER(STAGE_SHADOW_RAYS);
+                light_index = selectLight(record.p, slot, weight);
+                ShadowSamples samples = shadowSamples(light_index);
+                for (int i = 0; i < samples.count; i++) {
+                    real distance_to_sample;
+                    Ray shadow_ray = sampleShadowRay(record.p, light_index, samples, i, distance_to_sample);
+                    shadowed[i] = occluded(shadow_ray, Interval(ray_epsilon(record.p), distance_to_sample));
+                    countShadowRay(shadowed[i]);
                 }
-                // After all shadow rays have been shot, add the average light contribution to the total light
-                total_light += temp_total_light / num_shadowrays;
             }
+            RT_STATS_TIMER(STAGE_SHADE);
+            total_light += sampledLightContribution(ray, record, light_index, weight, shadowed);
         }
         // After all lights have been processed, return the total light
         return total_light;
     }
 
-    Ray getShadowRay(const Point3D& hit_point, const Point3D& light_position) const {
-        auto sample = light_position + random_in_unit_sphere() * 0.1;
+    // Shadow rays towards every light with a radius at every hit point, between 1 and getMaxShadowRays().
+    // Lights of radius 0 are points and always get a single ray, which gives hard shadows
+    void set_shadow_rays(int count) {shadow_rays = std::min(std::max(count, 1), max_shadow_rays);}
+    int getShadowRays() const {return shadow_rays;}
+    static int getMaxShadowRays() {return max_shadow_rays;}
 
-        auto ray_direction = sample - hit_point;
-        return Ray(hit_point, ray_direction);
+    // Shadow rays cast towards light light_index at every hit point
+    int shadowRayCount(int light_index) const {
+        return lights[light_index]->getRadius() > 0 ? shadow_rays : 1;
+    }
+
+    // Number of lights shaded at every hit point, each with shadowRayCount() shadow rays
+    int getShadowLightCount() const {
+        if (lights.empty()) return 0;
+        return light_sampling == LIGHT_SAMPLING_ALL ? static_cast<int>(lights.size()) : light_samples;
+    }
+
+    // The light shaded in slot 'slot' of a hit point at p, and the weight of its estimate.
+    // Picking from the light tree draws one random number per slot
+    int selectLight(const Point3D& p, int slot, double& weight) const {
+        if (light_sampling == LIGHT_SAMPLING_ALL) {
+            weight = 1;
+            return slot;
+        }
+        double u = random_double();
+        double pdf;
+        int light_index = light_tree.sample(p, u, pdf);
+        if (light_index < 0) {
+            // No light has any power, so they all contribute the same
+            light_index = std::min(static_cast<int>(u * lights.size()), static_cast<int>(lights.size()) - 1);
+            pdf = 1.0 / lights.size();
+        }
+        weight = 1.0 / (pdf * light_samples);
+        return light_index;
+    }
+
+    // Estimate of the light from one slot. With every light shaded, that light's contribution. With
+    // sampled lights, the part that depends on the light is weighted by its selection probability,
+    // and the ambient part, the same for every light, is scaled up to all lights
+    Color sampledLightContribution(const Ray& ray, const Hit_record& record, int light_index, double weight, const char* shadowed) const {
+        Color contribution = lightContribution(ray, record, light_index, shadowed);
+        if (light_sampling == LIGHT_SAMPLING_ALL) {
+            return contribution;
+        }
+        Color ambient = shadeLight(ray, record, light_index, 0);
+        return ambient * (static_cast<double>(lights.size()) / light_samples) + (contribution - ambient) * weight;
+    }
+
+    // Statistics of one shadow ray's outcome, a no-op unless built with RT_STATS
+    static void countShadowRay(bool blocked) {
+        if (blocked) {
+            RT_STATS_COUNT(shadow_occluded);
+        } else {
+            RT_STATS_COUNT(shadow_unoccluded);
+        }
+    }
+
+    // Where the shadow rays of one light and hit point end: count points on the light (see Light::samplePoint),
+    // a pattern placed by two random numbers. A light of radius 0 gets one ray to its center and draws none
+    struct ShadowSamples {
+        int count;
+        double u0, v0;
+    };
+
+    ShadowSamples shadowSamples(int light_index) const {
+        ShadowSamples samples = {shadowRayCount(light_index), 0, 0};
+        if (lights[light_index]->getRadius() > 0) {
+            samples.u0 = random_double();
+            samples.v0 = random_double();
+        }
+        return samples;
+    }
+
+    // Unit shadow ray i of samples.count from a hit point towards light light_index.
+    // distance_to_sample receives the distance to its point on the light, the end of the shadow ray
+    Ray sampleShadowRay(const Point3D& hit_point, int light_index, const ShadowSamples& samples, int i, real& distance_to_sample) const {
+        Vector3D ray_direction = lights[light_index]->samplePoint(i, samples.count, samples.u0, samples.v0) - hit_point;
+        distance_to_sample = getLength(ray_direction);
+        return Ray(hit_point, ray_direction / distance_to_sample);
+    }
+
+    // Light arriving from light light_index, given the outcome of its shadowRayCount() shadow rays
+    Color lightContribution(const Ray& ray, const Hit_record& record, int light_index, const char* shadowed) const {
+        int count = shadowRayCount(light_index);
+        int unshadowed = 0;
+        for (int i = 0; i < count; i++) {
+            unshadowed += !shadowed[i];
+        }
+        return shadeLight(ray, record, light_index, static_cast<double>(unshadowed) / count);
+    }
+
+    // Light arriving from light light_index when the fraction 'visibility' of it can be seen from the hit point:
+    // the lit and the shadowed shading, mixed by how much of the light is blocked
+    Color shadeLight(const Ray& ray, const Hit_record& record, int light_index, double visibility) const {
+        const auto& light = lights[light_index];
+        // Calculate light direction and distance to light
+        Vector3D light_direction = light->getPosition() - record.p;
+        double distance_to_light = getLength(light_direction);
+        light_direction = normalize(light_direction);
+        Color light_color = light->getIntensity();
+        Vector3D view_direction = -ray.getDirection();
+        const Material& material = getMaterial(record.material);
+
+        Color total_light(0, 0, 0);
+        if (visibility > 0) {
+            total_light += visibility * material.shade(record, light_direction, view_direction, light_color, distance_to_light);
+        }
+        if (visibility < 1) {
+            total_light += (1 - visibility) * material.shade(record, light_direction, view_direction, light_color, -1);
+        }
+        return total_light;
+    }
+
+    // pbr mode. Every hit samples one direction per slot of getShadowLightCount() towards the light
+    // selectLight picks, and one direction from its BSDF, which continues the path. A light with a
+    // radius can be found by both, so each estimate is weighted by misWeight against the other
+    struct DirectLightSample {
+        Ray shadow_ray;         // Unit direction towards the light
+        real distance;          // Distance to the sampled point on the light, the end of the shadow ray
+        Color contribution;     // Light it carries unless something blocks it
+    };
+
+    // Light sample of slot 'slot' at the hit rec of a ray arriving from the unit direction wo. Draws the
+    // numbers of selectLight and then two more, whether or not it returns anything. Returns false if the
+    // sample cannot contribute, which needs no shadow ray
+    bool sampleDirectLight(const Hit_record& rec, const Vector3D& wo, int slot, DirectLightSample& sample) const {
+        double weight;
+        int light_index = selectLight(rec.p, slot, weight);
+        double u1 = random_double();
+        double u2 = random_double();
+        LightSample light_sample;
+        if (!lights[light_index]->sampleLi(rec.p, u1, u2, light_sample)) return false;
+        double cos_theta = dotProduct(light_sample.wi, rec.normal);
+        if (cos_theta <= 0) return false;
+        const Material& material = getMaterial(rec.material);
+        Color f = material.eval(wo, light_sample.wi, rec.normal);
+        if (f.x <= 0 && f.y <= 0 && f.z <= 0) return false;
+
+        sample.shadow_ray = Ray(rec.p, light_sample.wi);
+        sample.distance = light_sample.distance;
+        sample.contribution = f * light_sample.radiance * (cos_theta * weight);
+        if (light_sample.pdf > 0) {
+            // Density of this strategy, over all the slots: the direction's times the light's selection density
+            double light_pdf = light_sample.pdf / weight;
+            double mis_weight = misWeight(light_pdf, material.pdf(wo, light_sample.wi, rec.normal), MIS_LIGHT);
+            if (mis_weight <= 0) return false;
+            sample.contribution = sample.contribution * (mis_weight / light_sample.pdf);
+        }
+        return true;
+    }
+
+    // Light seen along the BSDF sampled ray r before distance t_max: the radiance of the nearest light
+    // in front, weighted against the light samples at the ray's origin. bsdf_pdf is the density with
+    // which r was sampled, 0 for a camera ray or a delta lobe, which light samples never reproduce.
+    // Returns false if no light is in front, true if one is, which ends the path
+    bool lightAlongRay(const Ray& r, real t_max, double bsdf_pdf, Color& emitted) const {
+        real t;
+        int nearest = nearestLight(r, t_max, t);
+        if (nearest < 0) return false;
+        emitted = weightedEmission(r, nearest, bsdf_pdf);
+        return true;
+    }
+
+    // Light the BSDF sampled ray r of a path out of bounces reaches, 0 if a surface is in front of it.
+    // Its MIS weight is the rest of the light samples' at the last hit, so the path still gets all
+    // of that hit's direct light. Costs a shadow ray if r points at a light, and draws no numbers
+    Color lightBeyondPath(const Ray& r, double bsdf_pdf) const {
+        real t;
+        int nearest = nearestLight(r, infinity, t);
+        if (nearest < 0) return Color(0, 0, 0);
+        bool blocked = occluded(r, Interval(ray_epsilon(r.getOrigin()), t));
+        countShadowRay(blocked);
+        return blocked ? Color(0, 0, 0) : weightedEmission(r, nearest, bsdf_pdf);
+    }
+
+    // Expected number of times the slots at p pick light light_index: once with every light shaded,
+    // light_samples times its tree probability otherwise. When no light has power selectLight picks
+    // uniformly while this returns 0, which cannot matter, as those lights emit nothing
+    double lightSelectionDensity(const Point3D& p, int light_index) const {
+        if (light_sampling == LIGHT_SAMPLING_ALL) return 1;
+        return light_samples * light_tree.pdf(p, light_index);
+    }
+
+    // Index of the nearest light r hits before t_max, and its distance t; -1 if there is none
+    int nearestLight(const Ray& r, real t_max, real& t) const {
+        int nearest = -1;
+        t = t_max;
+        for (size_t i = 0; i < lights.size(); ++i) {
+            real t_light;
+            if (lights[i]->hitLight(r, Interval(ray_epsilon(r.getOrigin()), t), t_light)) {
+                nearest = static_cast<int>(i);
+                t = t_light;
+            }
+        }
+        return nearest;
+    }
+
+    // Radiance of light light_index seen along r, weighted against the light samples at r's origin
+    Color weightedEmission(const Ray& r, int light_index, double bsdf_pdf) const {
+        Color emitted = lights[light_index]->emittedRadiance();
+        if (bsdf_pdf <= 0) return emitted;
+        double light_pdf = lights[light_index]->pdfLi(r.getOrigin(), normalize(r.getDirection())) * lightSelectionDensity(r.getOrigin(), light_index);
+        return emitted * misWeight(bsdf_pdf, light_pdf, MIS_BSDF);
+    }
+
+    // Weight of a sample of strategy (MIS_LIGHT or MIS_BSDF) and density pdf against the other one, of density other_pdf
+    double misWeight(double pdf, double other_pdf, MISHeuristic strategy) const {
+        switch (mis_heuristic) {
+            case MIS_BALANCE: return pdf / (pdf + other_pdf);
+            case MIS_LIGHT:
+            case MIS_BSDF:    return mis_heuristic == strategy ? 1 : 0;
+            default:          return pdf * pdf / (pdf * pdf + other_pdf * other_pdf);
+        }
     }
 };
 
@@ -0,0 +1,797 @@
+#ifndef SCENE_CACHE_H
+#define SCENE_CACHE_H
+
+#include "scene.h"
+#include "scene_parser.h"
+#include "material.h"
+#include "mesh.h"
+#include "stats.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// Compiled scene cache (.rtscene).
+// After a scene file has been parsed and its BVH built, the result is written as one binary file:
+// settings, materials, lights, shapes, mesh buffers and BVHs as flat records. Later runs on the same
+// scene file map the cache into memory instead of parsing the JSON, loading meshes and building BVHs.
+//
+// The cache belongs to one scene file: it stores a hash of the file's bytes, and the size and
+// modification time of every mesh file the scene loaded, and is only used while all of them match.
+//
+// File layout, in native byte order. Offsets are counted from the start of the file, so the file
+// can be mapped anywhere, and every section starts on a 64-byte boundary:
+//   Header          magic "RTSCENE", version, precision, source hash, file size, offset and size of every section
+//   Settings        the camera and render settings of the scene file (see writeSettings)
+//   Dependencies    the mesh files, with size and modification time
+//   Materials       MaterialRecord per material; shapes sharing a material object share the record
+//   Lights          LightRecord per light
+//   Shapes          ShapeRecord per shape, in scene order
+//   Meshes          MeshRecord per triangle mesh, referring to ranges of the two sections below
+//   MeshVertices    float x, y, z per vertex
+//   MeshIndices     uint32 three per triangle
+//   Trees           TreeRecord per BVH: the scene BVH first, then one per mesh
+//   TreeNodes       NodeRecord per BVH node
+//   TreePrims       int32 primitive index per BVH leaf entry
+class SceneCache {
+    public:
+        // 64-bit FNV-1a hash of the bytes of a file, the key of its cache. 0 if the file cannot be read
+        static std::uint64_t sourceHash(const std::string& filename) {
+            std::ifstream file(filename, std::ios::in | std::ios::binary);
+            if (!file.is_open()) {
+                return 0;
+            }
+            std::uint64_t hash = 14695981039346656037ULL;
+            std::vector<char> buffer(1 << 20);
+            while (file) {
+                file.read(buffer.data(), buffer.size());
+                std::streamsize count = file.gcount();
+                for (std::streamsize i = 0; i < count; ++i) {
+                    hash = (hash ^ static_cast<unsigned char>(buffer[i])) * 1099511628211ULL;
+                }
+            }
+            return hash;
+        }
+
+        // Write the scene read from the file with hash source_hash, with the settings of its reader.
+        // The scene BVH is stored if the scene has one and no packed spheres. Returns false if the
+        // scene holds objects the cache cannot describe or the file cannot be written
+        static bool save(const std::string& filename, std::uint64_t source_hash, const SceneDescription& settings, const Scene& scene) {
+            std::vector<char> sections[SECTION_COUNT];
+            writeSettings(sections[SECTION_SETTINGS], settings);
+            writeDependencies(sections[SECTION_DEPENDENCIES], settings.mesh_files);
+
+            std::map<const Material*, std::uint32_t> material_indices;
+            std::vector<MeshRecord> meshes;
+            std::vector<float> mesh_vertices;
+            std::vector<std::uint32_t> mesh_indices;
+            std::vector<const BVH*> trees(1, scene.has_packed_spheres() ? nullptr : &scene.getBVH());
+
+            for (const std::shared_ptr<Light>& light : scene.getLights()) {
+                const PointLight* point_light = dynamic_cast<const PointLight*>(light.get());
+                if (!point_light) {
+                    std::cerr << "Error: the scene cache only holds point lights. Not writing " << filename << std::endl;
+                    return false;
+                }
+                LightRecord record;
+                putTriplet(record.position, point_light->getPosition());
+                putTriplet(record.intensity, point_light->getIntensity());
+                record.radius = point_light->getRadius();
+                append(sections[SECTION_LIGHTS], record);
+            }
+
+            for (const std::shared_ptr<Shape>& shape : scene.getShapes()) {
+                ShapeRecord record;
+                std::memset(&record, 0, sizeof(record));
+                if (!materialIndex(shape->getMaterial().get(), material_indices, sections[SECTION_MATERIALS], record.material)) {
+                    std::cerr << "Error: the scene cache only holds Lambertian and Blinn-Phong materials. Not writing " << filename << std::endl;
+                    return false;
+                }
+
+                const Shape* s = shape.get();
+                if (const Sphere* sphere = dynamic_cast<const Sphere*>(s)) {
+                    record.type = SHAPE_SPHERE;
+                    putTriplet(record.values, sphere->getCenter());
+                    record.values[3] = sphere->getRadius();
+                } else if (const Cylinder* cylinder = dynamic_cast<const Cylinder*>(s)) {
+                    record.type = SHAPE_CYLINDER;
+                    putTriplet(record.values, cylinder->getCenter());
+                    putTriplet(record.values + 3, cylinder->getAxis());
+                    record.values[6] = cylinder->getRadius();
+                    record.values[7] = cylinder->getHeight();
+                } else if (const Triangle* triangle = dynamic_cast<const Triangle*>(s)) {
+                    record.type = SHAPE_TRIANGLE;
+                    putTriplet(record.values, triangle->get_v0());
+                    putTriplet(record.values + 3, triangle->get_v1());
+                    putTriplet(record.values + 6, triangle->get_v2());
+                } else if (const TriangleMesh* mesh = dynamic_cast<const TriangleMesh*>(s)) {
+                    record.type = SHAPE_MESH;
+                    record.mesh = static_cast<std::uint32_t>(meshes.size());
+                    MeshRecord mesh_record;
+                    mesh_record.vertex_offset = mesh_vertices.size();
+                    mesh_record.vertex_count = mesh->getVertices().size();
+                    mesh_record.index_offset = mesh_indices.size();
+                    mesh_record.index_count = mesh->getIndices().size();
+                    meshes.push_back(mesh_record);
+                    mesh_vertices.insert(mesh_vertices.end(), mesh->getVertices().begin(), mesh->getVertices().end());
+                    mesh_indices.insert(mesh_indices.end(), mesh->getIndices().begin(), mesh->getIndices().end());
+                    trees.push_back(&mesh->getBVH());
+                } else {
+                    std::cerr << "Error: the scene cache cannot hold a shape of the scene. Not writing " << filename << std::endl;
+                    return false;
+                }
+                append(sections[SECTION_SHAPES], record);
+            }
+
+            appendAll(sections[SECTION_MESHES], meshes);
+            appendAll(sections[SECTION_MESH_VERTICES], mesh_vertices);
+            appendAll(sections[SECTION_MESH_INDICES], mesh_indices);
+            writeTrees(trees, sections[SECTION_TREES], sections[SECTION_TREE_NODES], sections[SECTION_TREE_PRIMS]);
+
+            // Header, then the sections at aligned offsets
+            Header header;
+            std::memset(&header, 0, sizeof(header));
+            std::memcpy(header.magic, magic(), magic_size);
+            header.version = version;
+            header.precision = sizeof(real);
+            header.source_hash = source_hash;
+            std::uint64_t offset = align(sizeof(Header));
+            for (int i = 0; i < SECTION_COUNT; ++i) {
+                header.sections[i].offset = offset;
+                header.sections[i].size = sections[i].size();
+                offset = align(offset + sections[i].size());
+            }
+            header.file_size = offset;
+
+            // Written under a temporary name and renamed, so concurrent runs never map a half-written cache
+            std::string temporary = filename + ".tmp";
+            {
+                std::ofstream file(temporary, std::ios::out | std::ios::binary);
+                const char padding[alignment] = {0};
+                file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+                std::uint64_t written = sizeof(header);
+                for (int i = 0; i < SECTION_COUNT; ++i) {
+                    file.write(padding, header.sections[i].offset - written);
+                    file.write(sections[i].data(), sections[i].size());
+                    written = header.sections[i].offset + sections[i].size();
+                }
+                file.write(padding, header.file_size - written);
+                if (!file.is_open() || !file) {
+                    std::cerr << "Error: Could not write scene cache " << temporary << std::endl;
+                    return false;
+                }
+            }
+#ifdef _WIN32
+            std::remove(filename.c_str());     // rename() does not replace existing files on Windows
+#endif
+            if (std::rename(temporary.c_str(), filename.c_str()) != 0) {
+                std::cerr << "Error: Could not rename " << temporary << " to " << filename << std::endl;
+                return false;
+            }
+            return true;
+        }
+
+        // Fill an empty scene and the settings from the cache of the file with hash source_hash.
+        // with_bvh takes over the stored scene BVH, if there is one. Returns false, leaving both
+        // untouched, if the cache is missing, belongs to another version of the file, or is damaged
+        static bool load(const std::string& filename, std::uint64_t source_hash, SceneDescription& settings, Scene& scene, bool with_bvh) {
+            RT_STATS_TIMER(STAGE_SCENE_LOAD);
+            MappedFile file;
+            if (!file.open(filename)) {
+                std::clog << "No scene cache " << filename << " yet\n";
+                return false;
+            }
+
+            Header header;
+            if (file.size() < sizeof(Header)) {
+                std::cerr << "Error: " << filename << " is not a scene cache" << std::endl;
+                return false;
+            }
+            std::memcpy(&header, file.data(), sizeof(Header));
+            if (std::memcmp(header.magic, magic(), magic_size) != 0) {
+                std::cerr << "Error: " << filename << " is not a scene cache" << std::endl;
+                return false;
+            }
+            if (header.version != version) {
+                std::clog << "Scene cache " << filename << " has version " << header.version << ", expected " << version << ". Rebuilding it\n";
+                return false;
+            }
+            if (header.precision != sizeof(real)) {
+                // Boxes rounded from the other precision need not enclose this build's primitives
+                std::clog << "Scene cache " << filename << " was written by a " << 8 * header.precision << "-bit build. Rebuilding it\n";
+                return false;
+            }
+            if (header.source_hash != source_hash) {
+                std::clog << "Scene cache " << filename << " was written for another version of the scene file. Rebuilding it\n";
+                return false;
+            }
+            if (header.file_size != file.size()) {
+                std::cerr << "Error: Scene cache " << filename << " is truncated" << std::endl;
+                return false;
+            }
+
+            try {
+                Reader dependencies(section<char>(file, header, SECTION_DEPENDENCIES));
+                if (!dependenciesUnchanged(dependencies)) {
+                    std::clog << "A mesh file of scene cache " << filename << " has changed. Rebuilding it\n";
+                    return false;
+                }
+
+                SceneDescription loaded;
+                Reader settings_reader(section<char>(file, header, SECTION_SETTINGS));
+                readSettings(settings_reader, loaded);
+                fillScene(file, header, scene, with_bvh);
+                settings = std::move(loaded);
+            } catch (std::exception& e) {
+                std::cerr << "Error: Scene cache " << filename << " is damaged (" << e.what() << "). Rebuilding it" << std::endl;
+                scene.clear();
+                return false;
+            }
+            std::clog << "Loaded scene cache " << filename << "\n";
+            return true;
+        }
+
+    private:
+        enum Section {
+            SECTION_SETTINGS, SECTION_DEPENDENCIES, SECTION_MATERIALS, SECTION_LIGHTS, SECTION_SHAPES,
+            SECTION_MESHES, SECTION_MESH_VERTICES, SECTION_MESH_INDICES, SECTION_TREES, SECTION_TREE_NODES, SECTION_TREE_PRIMS,
+            SECTION_COUNT
+        };
+
+        enum ShapeType {SHAPE_SPHERE, SHAPE_CYLINDER, SHAPE_TRIANGLE, SHAPE_MESH};
+        enum MaterialType {MATERIAL_RECORD_LAMBERTIAN, MATERIAL_RECORD_BLINN_PHONG};
+
+        static const char* magic() {return "RTSCENE";}    // Eight bytes with the terminating zero
+        static const size_t magic_size = 8;
+        static const std::uint32_t version = 2;
+        static const std::uint64_t alignment = 64;
+
+        struct SectionRange {
+            std::uint64_t offset;
+            std::uint64_t size;     // In bytes
+        };
+
+        struct Header {
+            char magic[8];
+            std::uint32_t version;
+            std::uint32_t precision;        // sizeof(real) of the build that wrote the BVH boxes
+            std::uint64_t source_hash;
+            std::uint64_t file_size;
+            SectionRange sections[SECTION_COUNT];
+        };
+
+        struct MaterialRecord {
+            std::uint32_t type;             // MaterialType
+            std::int32_t specular_exponent;
+            std::uint32_t reflective;
+            std::uint32_t refractive;
+            double diffuse[3];              // The albedo of a Lambertian material
+            double specular[3];
+            double kd, ks, reflectivity, refractive_index;
+        };
+
+        struct LightRecord {
+            double position[3];
+            double intensity[3];
+            double radius;
+        };
+
+        struct ShapeRecord {
+            std::uint32_t type;             // ShapeType
+            std::uint32_t material;         // Index into the materials, no_material for none
+            std::uint32_t mesh;             // Index into the meshes, for SHAPE_MESH
+            std::uint32_t reserved;
+            // Sphere: center, radius. Cylinder: center, axis, radius, height. Triangle: v0, v1, v2
+            double values[9];
+        };
+
+        struct MeshRecord {
+            std::uint64_t vertex_offset, vertex_count;     // In floats of MeshVertices
+            std::uint64_t index_offset, index_count;       // In entries of MeshIndices
+        };
+
+        struct TreeRecord {
+            std::uint64_t node_offset, node_count;         // In records of TreeNodes
+            std::uint64_t prim_offset, prim_count;         // In entries of TreePrims
+        };
+
+        struct NodeRecord {
+            double min[3];
+            double max[3];
+            std::int32_t offset, count, axis, reserved;    // As in BVH::Node
+        };
+
+        static_assert(sizeof(Header) == 32 + 16 * SECTION_COUNT, "Scene cache header must not have padding");
+        static_assert(sizeof(MaterialRecord) == 96, "MaterialRecord must not have padding");
+        static_assert(sizeof(LightRecord) == 56, "LightRecord must not have padding");
+        static_assert(sizeof(ShapeRecord) == 88, "ShapeRecord must not have padding");
+        static_assert(sizeof(NodeRecord) == 64, "NodeRecord must not have padding");
+
+        // Read-only view of a whole file: mapped into memory where mmap is available, read otherwise
+        class MappedFile {
+            public:
+                MappedFile() {}
+                MappedFile(const MappedFile&) = delete;
+                MappedFile& operator=(const MappedFile&) = delete;
+                ~MappedFile() {
+#ifndef _WIN32
+                    if (mapped) munmap(mapped, length);
+#endif
+                }
+
+                bool open(const std::string& filename) {
+#ifndef _WIN32
+                    int descriptor = ::open(filename.c_str(), O_RDONLY);
+                    if (descriptor < 0) return false;
+                    struct stat info;
+                    if (fstat(descriptor, &info) == 0 && info.st_size > 0) {
+                        void* address = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, descriptor, 0);
+                        if (address != MAP_FAILED) {
+                            mapped = address;
+                            length = static_cast<size_t>(info.st_size);
+                        }
+                    }
+                    ::close(descriptor);
+                    if (mapped) return true;
+#endif
+                    std::ifstream file(filename, std::ios::in | std::ios::binary);
+                    if (!file.is_open()) return false;
+                    buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+                    length = buffer.size();
+                    return true;
+                }
+
+                const char* data() const {return mapped ? static_cast<const char*>(mapped) : buffer.data();}
+                size_t size() const {return length;}
+
+            private:
+                void* mapped = nullptr;
+                size_t length = 0;
+                std::vector<char> buffer;
+        };
+
+        // Sequential reader of the variable-length sections. Throws std::runtime_error past the end
+        class Reader {
+            public:
+                struct Range {
+                    const char* data;
+                    size_t size;
+                };
+
+                explicit Reader(Range range) : data(range.data), size(range.size) {}
+
+                template <typename T>
+                T get() {
+                    T value;
+                    std::memcpy(&value, take(sizeof(T)), sizeof(T));
+                    return value;
+                }
+
+                std::string getString() {
+                    std::uint32_t length = get<std::uint32_t>();
+                    const char* text = take(length);
+                    return std::string(text, length);
+                }
+
+            private:
+                const char* data;
+                size_t size;
+                size_t offset = 0;
+
+                const char* take(size_t count) {
+                    if (count > size - offset) {
+                        throw std::runtime_error("section ends early");
+                    }
+                    const char* p = data + offset;
+                    offset += count;
+                    return p;
+                }
+        };
+
+        static std::uint64_t align(std::uint64_t offset) {
+            return (offset + alignment - 1) / alignment * alignment;
+        }
+
+        template <typename T>
+        static void append(std::vector<char>& bytes, const T& value) {
+            const char* raw = reinterpret_cast<const char*>(&value);
+            bytes.insert(bytes.end(), raw, raw + sizeof(T));
+        }
+
+        template <typename T>
+        static void appendAll(std::vector<char>& bytes, const std::vector<T>& values) {
+            const char* raw = reinterpret_cast<const char*>(values.data());
+            bytes.insert(bytes.end(), raw, raw + values.size() * sizeof(T));
+        }
+
+        static void appendString(std::vector<char>& bytes, const std::string& text) {
+            append(bytes, static_cast<std::uint32_t>(text.size()));
+            bytes.insert(bytes.end(), text.begin(), text.end());
+        }
+
+        static void putTriplet(double* values, const Vector3D& v) {
+            values[0] = v.x;
+            values[1] = v.y;
+            values[2] = v.z;
+        }
+
+        static Vector3D getTriplet(const double* values) {
+            return Vector3D(values[0], values[1], values[2]);
+        }
+
+        // Bytes of a section, as records of T. Throws std::runtime_error if they lie outside the file
+        template <typename T>
+        static Reader::Range section(const MappedFile& file, const Header& header, Section which) {
+            const SectionRange& range = header.sections[which];
+            if (range.offset % alignment != 0 || range.offset > file.size() || range.size > file.size() - range.offset || range.size % sizeof(T) != 0) {
+                throw std::runtime_error("section out of range");
+            }
+            Reader::Range bytes = {file.data() + range.offset, static_cast<size_t>(range.size)};
+            return bytes;
+        }
+
+        // Records of a section, used in place. Sections are aligned, so the records are too
+        template <typename T>
+        static const T* records(const MappedFile& file, const Header& header, Section which, size_t& count) {
+            Reader::Range bytes = section<T>(file, header, which);
+            count = bytes.size / sizeof(T);
+            return reinterpret_cast<const T*>(bytes.data);
+        }
+
+        // Settings: every field as a state byte, the JSON type it had if that was wrong, and its value
+        static void writeSettings(std::vector<char>& bytes, const SceneDescription& d) {
+            append(bytes, static_cast<std::uint8_t>(d.document_null));
+            writeField(bytes, d.nbounces);
+            writeField(bytes, d.rendermode);
+            writeField(bytes, d.camera_type);
+            writeField(bytes, d.width);
+            writeField(bytes, d.height);
+            writeField(bytes, d.position);
+            writeField(bytes, d.look_at);
+            writeField(bytes, d.up_vector);
+            writeField(bytes, d.fov);
+            writeField(bytes, d.exposure);
+            writeField(bytes, d.adaptive);
+            writeField(bytes, d.min_samples);
+            writeField(bytes, d.max_samples);
+            writeField(bytes, d.error_threshold);
+            append(bytes, static_cast<std::uint8_t>(d.scene_null));
+            writeField(bytes, d.background_color);
+            append(bytes, static_cast<std::uint8_t>(d.lights_state));
+            append(bytes, static_cast<std::uint8_t>(d.shapes_state));
+            append(bytes, static_cast<std::uint64_t>(d.shape_entries));
+            append(bytes, d.content_hash);
+        }
+
+        static void readSettings(Reader& reader, SceneDescription& d) {
+            d.document_null = reader.get<std::uint8_t>() != 0;
+            readField(reader, d.nbounces);
+            readField(reader, d.rendermode);
+            readField(reader, d.camera_type);
+            readField(reader, d.width);
+            readField(reader, d.height);
+            readField(reader, d.position);
+            readField(reader, d.look_at);
+            readField(reader, d.up_vector);
+            readField(reader, d.fov);
+            readField(reader, d.exposure);
+            readField(reader, d.adaptive);
+            readField(reader, d.min_samples);
+            readField(reader, d.max_samples);
+            readField(reader, d.error_threshold);
+            d.scene_null = reader.get<std::uint8_t>() != 0;
+            readField(reader, d.background_color);
+            d.lights_state = listState(reader.get<std::uint8_t>());
+            d.shapes_state = listState(reader.get<std::uint8_t>());
+            d.shape_entries = static_cast<size_t>(reader.get<std::uint64_t>());
+            d.content_hash = reader.get<std::uint64_t>();
+        }
+
+        static SceneListState listState(std::uint8_t value) {
+            if (value > LIST_NOT_ARRAY) throw std::runtime_error("invalid list state");
+            return static_cast<SceneListState>(value);
+        }
+
+        template <typename T>
+        static void writeFieldHeader(std::vector<char>& bytes, const SceneField<T>& field) {
+            append(bytes, static_cast<std::uint8_t>(field.state));
+            appendString(bytes, field.found_type);
+        }
+
+        template <typename T>
+        static void readFieldHeader(Reader& reader, SceneField<T>& field) {
+            std::uint8_t state = reader.get<std::uint8_t>();
+            if (state > SceneField<T>::WRONG_TYPE) throw std::runtime_error("invalid field state");
+            field.state = static_cast<typename SceneField<T>::State>(state);
+            field.found_type = typeName(reader.getString());
+        }
+
+        // The static name of a JSON type, which SceneField keeps as a plain pointer
+        static const char* typeName(const std::string& name) {
+            static const char* names[] = {"null", "boolean", "number", "string", "object", "array", "binary"};
+            for (const char* known : names) {
+                if (name == known) return known;
+            }
+            return "";
+        }
+
+        static void writeField(std::vector<char>& bytes, const SceneField<int>& field) {
+            writeFieldHeader(bytes, field);
+            append(bytes, static_cast<std::int32_t>(field.value));
+        }
+
+        static void readField(Reader& reader, SceneField<int>& field) {
+            readFieldHeader(reader, field);
+            field.value = reader.get<std::int32_t>();
+        }
+
+        static void writeField(std::vector<char>& bytes, const SceneField<double>& field) {
+            writeFieldHeader(bytes, field);
+            append(bytes, field.value);
+        }
+
+        static void readField(Reader& reader, SceneField<double>& field) {
+            readFieldHeader(reader, field);
+            field.value = reader.get<double>();
+        }
+
+        static void writeField(std::vector<char>& bytes, const SceneField<bool>& field) {
+            writeFieldHeader(bytes, field);
+            append(bytes, static_cast<std::uint8_t>(field.value));
+        }
+
+        static void readField(Reader& reader, SceneField<bool>& field) {
+            readFieldHeader(reader, field);
+            field.value = reader.get<std::uint8_t>() != 0;
+        }
+
+        static void writeField(std::vector<char>& bytes, const SceneField<std::string>& field) {
+            writeFieldHeader(bytes, field);
+            appendString(bytes, field.value);
+        }
+
+        static void readField(Reader& reader, SceneField<std::string>& field) {
+            readFieldHeader(reader, field);
+            field.value = reader.getString();
+        }
+
+        static void writeField(std::vector<char>& bytes, const SceneField<Triplet>& field) {
+            writeFieldHeader(bytes, field);
+            append(bytes, field.value);
+        }
+
+        static void readField(Reader& reader, SceneField<Triplet>& field) {
+            readFieldHeader(reader, field);
+            field.value = reader.get<Triplet>();
+        }
+
+        // Size and modification time of a file, false if it does not exist
+        static bool fileStamp(const std::string& path, std::uint64_t& size, std::int64_t& modified) {
+            struct stat info;
+            if (stat(path.c_str(), &info) != 0) return false;
+            size = static_cast<std::uint64_t>(info.st_size);
+            modified = static_cast<std::int64_t>(info.st_mtime);
+            return true;
+        }
+
+        // Dependencies: the number of mesh files, then path, existence, size and modification time of each.
+        // A mesh file that was missing when the cache was written has to stay missing
+        static void writeDependencies(std::vector<char>& bytes, const std::vector<std::string>& files) {
+            append(bytes, static_cast<std::uint32_t>(files.size()));
+            for (const std::string& path : files) {
+                std::uint64_t size = 0;
+                std::int64_t modified = 0;
+                bool exists = fileStamp(path, size, modified);
+                appendString(bytes, path);
+                append(bytes, static_cast<std::uint8_t>(exists));
+                append(bytes, size);
+                append(bytes, modified);
+            }
+        }
+
+        static bool dependenciesUnchanged(Reader& reader) {
+            std::uint32_t count = reader.get<std::uint32_t>();
+            for (std::uint32_t i = 0; i < count; ++i) {
+                std::string path = reader.getString();
+                bool existed = reader.get<std::uint8_t>() != 0;
+                std::uint64_t size = reader.get<std::uint64_t>();
+                std::int64_t modified = reader.get<std::int64_t>();
+                std::uint64_t current_size = 0;
+                std::int64_t current_modified = 0;
+                bool exists = fileStamp(path, current_size, current_modified);
+                if (exists != existed || (exists && (size != current_size || modified != current_modified))) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // Index of a material in the materials section, appending its record the first time it is seen.
+        // False for material classes without a record
+        static bool materialIndex(const Material* material, std::map<const Material*, std::uint32_t>& indices, std::vector<char>& bytes, std::uint32_t& index) {
+            if (!material) {
+                index = no_material;
+                return true;
+            }
+            auto found = indices.find(material);
+            if (found != indices.end()) {
+                index = found->second;
+                return true;
+            }
+
+            MaterialRecord record;
+            std::memset(&record, 0, sizeof(record));
+            if (const Lambertian* lambertian = dynamic_cast<const Lambertian*>(material)) {
+                record.type = MATERIAL_RECORD_LAMBERTIAN;
+                putTriplet(record.diffuse, lambertian->getAlbedo());
+            } else if (const Blinn_Phong* phong = dynamic_cast<const Blinn_Phong*>(material)) {
+                record.type = MATERIAL_RECORD_BLINN_PHONG;
+                putTriplet(record.diffuse, phong->getDiffuseColor());
+                putTriplet(record.specular, phong->getSpecularColor());
+                record.kd = phong->getKd();
+                record.ks = phong->getKs();
+                record.specular_exponent = phong->getSpecularExponent();
+                record.reflective = phong->is_reflective();
+                record.reflectivity = phong->getReflectivity();
+                record.refractive = phong->is_refractive();
+                record.refractive_index = phong->getRefractiveIndex();
+            } else {
+                return false;
+            }
+            index = static_cast<std::uint32_t>(indices.size());
+            indices[material] = index;
+            append(bytes, record);
+            return true;
+        }
+
+        static std::shared_ptr<Material> makeMaterial(const MaterialRecord& record) {
+            if (record.type == MATERIAL_RECORD_LAMBERTIAN) {
+                return std::make_shared<Lambertian>(getTriplet(record.diffuse));
+            }
+            if (record.type == MATERIAL_RECORD_BLINN_PHONG) {
+                return std::make_shared<Blinn_Phong>(getTriplet(record.diffuse), getTriplet(record.specular), record.kd, record.ks,
+                                                     record.specular_exponent, record.reflective != 0, record.reflectivity,
+                                                     record.refractive != 0, record.refractive_index);
+            }
+            throw std::runtime_error("unknown material type");
+        }
+
+        static void writeTrees(const std::vector<const BVH*>& trees, std::vector<char>& tree_bytes, std::vector<char>& node_bytes, std::vector<char>& prim_bytes) {
+            std::uint64_t node_total = 0;
+            std::uint64_t prim_total = 0;
+            for (const BVH* tree : trees) {
+                TreeRecord record = {node_total, 0, prim_total, 0};
+                if (tree) {
+                    for (const BVH::Node& node : tree->getNodes()) {
+                        NodeRecord node_record = {
+                            {node.box.x.min, node.box.y.min, node.box.z.min},
+                            {node.box.x.max, node.box.y.max, node.box.z.max},
+                            node.offset, node.count, node.axis, 0
+                        };
+                        append(node_bytes, node_record);
+                    }
+                    for (int prim : tree->getPrimIndices()) {
+                        append(prim_bytes, static_cast<std::int32_t>(prim));
+                    }
+                    record.node_count = tree->getNodes().size();
+                    record.prim_count = tree->getPrimIndices().size();
+                }
+                node_total += record.node_count;
+                prim_total += record.prim_count;
+                append(tree_bytes, record);
+            }
+        }
+
+        // Tree number 'which' of the Trees section, over prim_count primitives
+        static BVH readTree(const MappedFile& file, const Header& header, size_t which, size_t prim_count) {
+            size_t tree_count, node_count, prim_total;
+            const TreeRecord* trees = records<TreeRecord>(file, header, SECTION_TREES, tree_count);
+            const NodeRecord* nodes = records<NodeRecord>(file, header, SECTION_TREE_NODES, node_count);
+            const std::int32_t* prims = records<std::int32_t>(file, header, SECTION_TREE_PRIMS, prim_total);
+            if (which >= tree_count) throw std::runtime_error("tree out of range");
+            const TreeRecord& tree = trees[which];
+            if (tree.node_offset > node_count || tree.node_count > node_count - tree.node_offset ||
+                tree.prim_offset > prim_total || tree.prim_count > prim_total - tree.prim_offset) {
+                throw std::runtime_error("tree out of range");
+            }
+
+            std::vector<BVH::Node> tree_nodes(static_cast<size_t>(tree.node_count));
+            for (size_t i = 0; i < tree_nodes.size(); ++i) {
+                const NodeRecord& record = nodes[tree.node_offset + i];
+                BVH::Node& node = tree_nodes[i];
+                // Set the intervals directly; the AABB constructors would pad flat boxes a second time
+                node.box.x = Interval(record.min[0], record.max[0]);
+                node.box.y = Interval(record.min[1], record.max[1]);
+                node.box.z = Interval(record.min[2], record.max[2]);
+                node.offset = record.offset;
+                node.count = record.count;
+                node.axis = record.axis;
+            }
+            const std::int32_t* first = prims + tree.prim_offset;
+            BVH bvh;
+            bvh.assign(std::move(tree_nodes), std::vector<int>(first, first + tree.prim_count), prim_count);
+            return bvh;
+        }
+
+        static void fillScene(const MappedFile& file, const Header& header, Scene& scene, bool with_bvh) {
+            size_t material_count, light_count, shape_count, mesh_count, vertex_total, index_total;
+            const MaterialRecord* material_records = records<MaterialRecord>(file, header, SECTION_MATERIALS, material_count);
+            const LightRecord* lights = records<LightRecord>(file, header, SECTION_LIGHTS, light_count);
+            const ShapeRecord* shapes = records<ShapeRecord>(file, header, SECTION_SHAPES, shape_count);
+            const MeshRecord* meshes = records<MeshRecord>(file, header, SECTION_MESHES, mesh_count);
+            const float* vertices = records<float>(file, header, SECTION_MESH_VERTICES, vertex_total);
+            const std::uint32_t* indices = records<std::uint32_t>(file, header, SECTION_MESH_INDICES, index_total);
+
+            std::vector<std::shared_ptr<Material>> materials;
+            materials.reserve(material_count);
+            for (size_t i = 0; i < material_count; ++i) {
+                materials.push_back(makeMaterial(material_records[i]));
+            }
+
+            for (size_t i = 0; i < light_count; ++i) {
+                if (!(lights[i].radius >= 0)) throw std::runtime_error("negative light radius");
+                scene.add(std::make_shared<PointLight>(getTriplet(lights[i].position), getTriplet(lights[i].intensity), lights[i].radius));
+            }
+
+            for (size_t i = 0; i < shape_count; ++i) {
+                const ShapeRecord& record = shapes[i];
+                if (record.material != no_material && record.material >= material_count) {
+                    throw std::runtime_error("material out of range");
+                }
+                std::shared_ptr<Material> material = record.material == no_material ? nullptr : materials[record.material];
+                const double* v = record.values;
+                switch (record.type) {
+                    case SHAPE_SPHERE:
+                        scene.add(std::make_shared<Sphere>(getTriplet(v), v[3], material));
+                        break;
+                    case SHAPE_CYLINDER:
+                        scene.add(std::make_shared<Cylinder>(getTriplet(v), getTriplet(v + 3), v[6], v[7], material));
+                        break;
+                    case SHAPE_TRIANGLE:
+                        scene.add(std::make_shared<Triangle>(getTriplet(v), getTriplet(v + 3), getTriplet(v + 6), material));
+                        break;
+                    case SHAPE_MESH: {
+                        if (record.mesh >= mesh_count) throw std::runtime_error("mesh out of range");
+                        const MeshRecord& mesh = meshes[record.mesh];
+                        if (mesh.vertex_offset > vertex_total || mesh.vertex_count > vertex_total - mesh.vertex_offset ||
+                            mesh.index_offset > index_total || mesh.index_count > index_total - mesh.index_offset) {
+                            throw std::runtime_error("mesh buffers out of range");
+                        }
+                        const float* first_vertex = vertices + mesh.vertex_offset;
+                        const std::uint32_t* first_index = indices + mesh.index_offset;
+                        BVH bvh = readTree(file, header, record.mesh + 1, static_cast<size_t>(mesh.index_count / 3));
+                        scene.add(std::make_shared<TriangleMesh>(std::vector<float>(first_vertex, first_vertex + mesh.vertex_count),
+                                                                 std::vector<std::uint32_t>(first_index, first_index + mesh.index_count),
+                                                                 material, std::move(bvh)));
+                        break;
+                    }
+                    default:
+                        throw std::runtime_error("unknown shape type");
+                }
+            }
+
+            if (with_bvh) {
+                BVH bvh = readTree(file, header, 0, shape_count);
+                if (!bvh.empty()) {
+                    scene.set_bvh(bvh);
+                }
+            }
+        }
+};
+
+#endif // SCENE_CACHE_H
@@ -0,0 +1,574 @@
+#ifndef SCENE_PARSER_H
+#define SCENE_PARSER_H
+
+#include "scene.h"
+#include "material.h"
+#include "mesh.h"
+#include "mesh_loader.h"
+#include "nlohmann/json.hpp"
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Streaming reader of the scene file format.
+// SceneParser is a SAX handler for nlohmann::json::sax_parse, so no JSON tree is ever built:
+// settings are stored straight into a SceneDescription, number arrays into fixed-size triplets,
+// and every light and shape is constructed as soon as its closing brace has been parsed.
+
+typedef std::array<double, 3> Triplet;
+
+// One setting of the file, and whether it was found with the expected type
+template <typename T>
+struct SceneField {
+    enum State {MISSING, SET, WRONG_TYPE};
+    T value = T();
+    State state = MISSING;
+    const char* found_type = "";    // JSON type of the value when it had the wrong type
+};
+
+enum SceneListState {LIST_MISSING, LIST_ARRAY, LIST_NOT_ARRAY};
+
+// Everything read from a scene file
+struct SceneDescription {
+    bool document_null = false;
+    SceneField<int> nbounces;
+    SceneField<std::string> rendermode;
+
+    // "camera"
+    SceneField<std::string> camera_type;
+    SceneField<int> width, height;
+    SceneField<Triplet> position, look_at, up_vector;
+    SceneField<double> fov, exposure;
+    SceneField<bool> adaptive;
+    SceneField<int> min_samples, max_samples;
+    SceneField<double> error_threshold;
+
+    // "scene"
+    bool scene_null = false;
+    SceneField<Triplet> background_color;
+    SceneListState lights_state = LIST_MISSING;
+    SceneListState shapes_state = LIST_MISSING;
+    size_t shape_entries = 0;       // Entries of "shapes", skipped ones included
+    std::vector<std::shared_ptr<Light>> lights;
+    std::vector<std::shared_ptr<Shape>> shapes;
+    std::vector<std::string> mesh_files;    // Resolved paths of the mesh files the shapes were loaded from
+
+    std::uint64_t content_hash = 14695981039346656037ULL;  // FNV-1a over the parse events
+};
+
+class SceneParser : public nlohmann::json::json_sax_t {
+    public:
+        // Relative mesh paths are resolved against base_directory
+        SceneParser(SceneDescription& description, const std::string& base_directory)
+            : description(description), base_directory(base_directory) {}
+
+        // Parse JSON text, given as anything nlohmann::json::sax_parse reads (a stream, a string), into
+        // description. Throws std::runtime_error on a syntax error
+        template <typename Input>
+        static void parse(Input&& input, const std::string& base_directory, SceneDescription& description) {
+            SceneParser parser(description, base_directory);
+            if (!nlohmann::json::sax_parse(std::forward<Input>(input), &parser)) {
+                throw std::runtime_error("Invalid scene file: " + parser.error_message);
+            }
+        }
+
+        // Path of a file referenced by the scene. Relative paths are relative to the scene file
+        static std::string resolvePath(const std::string& base_directory, const std::string& path) {
+            bool absolute = !path.empty() && (path[0] == '/' || path[0] == '\\' || (path.size() > 1 && path[1] == ':'));
+            return absolute ? path : base_directory + path;
+        }
+
+        bool null() override {
+            hashEvent('n', nullptr, 0);
+            return value(Scalar(Scalar::NUL, "null"));
+        }
+
+        bool boolean(bool flag) override {
+            hashEvent(flag ? 't' : 'f', nullptr, 0);
+            Scalar scalar(Scalar::BOOLEAN, "boolean");
+            scalar.flag = flag;
+            scalar.number = flag ? 1.0 : 0.0;
+            return value(scalar);
+        }
+
+        bool number_integer(number_integer_t number) override {
+            hashEvent('i', &number, sizeof(number));
+            return value(Scalar(static_cast<double>(number)));
+        }
+
+        bool number_unsigned(number_unsigned_t number) override {
+            hashEvent('u', &number, sizeof(number));
+            return value(Scalar(static_cast<double>(number)));
+        }
+
+        bool number_float(number_float_t number, const string_t& /*text*/) override {
+            hashEvent('d', &number, sizeof(number));
+            return value(Scalar(number));
+        }
+
+        bool string(string_t& text) override {
+            hashEvent('s', text.data(), text.size());
+            Scalar scalar(Scalar::STRING, "string");
+            scalar.text = &text;
+            return value(scalar);
+        }
+
+        bool binary(binary_t& /*data*/) override {
+            return value(Scalar(Scalar::OTHER, "binary"));
+        }
+
+        bool key(string_t& name) override {
+            hashEvent('k', name.data(), name.size());
+            current_key.assign(name);
+            if (!stack.empty() && stack.back() == MATERIAL) {
+                shape.material_keys++;
+            }
+            return true;
+        }
+
+        bool start_object(std::size_t /*elements*/) override {
+            hashEvent('{', nullptr, 0);
+            return open(true);
+        }
+
+        bool end_object() override {
+            hashEvent('}', nullptr, 0);
+            return close();
+        }
+
+        bool start_array(std::size_t /*elements*/) override {
+            hashEvent('[', nullptr, 0);
+            return open(false);
+        }
+
+        bool end_array() override {
+            hashEvent(']', nullptr, 0);
+            return close();
+        }
+
+        bool parse_error(std::size_t /*position*/, const std::string& /*last_token*/, const nlohmann::json::exception& error) override {
+            error_message = error.what();
+            return false;
+        }
+
+    private:
+        // Where in the file the parser is
+        enum Context {ROOT, CAMERA, SCENE, LIGHTS, LIGHT, SHAPES, SHAPE, MATERIAL, MATERIAL_LIST, TRIPLET, SKIP};
+
+        struct Scalar {
+            enum Kind {NUL, BOOLEAN, NUMBER, STRING, OTHER};
+            Kind kind;
+            const char* type_name;
+            double number = 0.0;
+            bool flag = false;
+            const std::string* text = nullptr;
+
+            Scalar(Kind kind, const char* type_name) : kind(kind), type_name(type_name) {}
+            explicit Scalar(double number) : kind(NUMBER), type_name("number"), number(number) {}
+
+            // nlohmann::json::get converts booleans to numbers, so the reader does too
+            bool numeric() const {return kind == NUMBER || kind == BOOLEAN;}
+        };
+
+        // The setting a key refers to; at most one pointer is set
+        struct FieldRef {
+            SceneField<int>* integer = nullptr;
+            SceneField<double>* real = nullptr;
+            SceneField<bool>* flag = nullptr;
+            SceneField<std::string>* text = nullptr;
+            SceneField<Triplet>* triplet = nullptr;
+
+            FieldRef() {}
+            FieldRef(SceneField<int>& field) : integer(&field) {}
+            FieldRef(SceneField<double>& field) : real(&field) {}
+            FieldRef(SceneField<bool>& field) : flag(&field) {}
+            FieldRef(SceneField<std::string>& field) : text(&field) {}
+            FieldRef(SceneField<Triplet>& field) : triplet(&field) {}
+        };
+
+        struct LightEntry {
+            SceneField<std::string> type;
+            SceneField<Triplet> position, intensity;
+            SceneField<double> radius;      // Optional, default_light_radius when missing
+        };
+
+        struct ShapeEntry {
+            SceneField<std::string> type, file;
+            SceneField<Triplet> center, axis, v0, v1, v2;
+            SceneField<double> radius, height;
+
+            enum MaterialState {MATERIAL_MISSING, MATERIAL_EMPTY, MATERIAL_OBJECT, MATERIAL_NOT_OBJECT};
+            MaterialState material = MATERIAL_MISSING;
+            int material_keys = 0;
+            SceneField<double> ks, kd, reflectivity, refractive_index;
+            SceneField<int> specular_exponent;
+            SceneField<Triplet> diffuse_color, specular_color;
+            SceneField<bool> is_reflective, is_refractive;
+        };
+
+        enum Check {CHECK_OK, CHECK_MISSING, CHECK_WRONG_TYPE};
+
+        SceneDescription& description;
+        std::string base_directory;
+        std::string error_message;
+
+        std::vector<Context> stack;
+        std::string current_key;
+        LightEntry light;
+        ShapeEntry shape;
+        SceneField<Triplet>* triplet = nullptr;     // Triplet being read, and how far
+        int triplet_count = 0;
+        bool triplet_numbers = true;
+
+        void hashEvent(char tag, const void* data, size_t size) {
+            std::uint64_t& hash = description.content_hash;
+            hash = (hash ^ static_cast<unsigned char>(tag)) * 1099511628211ULL;
+            const unsigned char* bytes = static_cast<const unsigned char*>(data);
+            for (size_t i = 0; i < size; ++i) {
+                hash = (hash ^ bytes[i]) * 1099511628211ULL;
+            }
+        }
+
+        bool key_is(const char* name) const {return current_key == name;}
+
+        FieldRef lookup(Context context) {
+            SceneDescription& d = description;
+            switch (context) {
+                case ROOT:
+                    if (key_is("nbounces")) return d.nbounces;
+                    if (key_is("rendermode")) return d.rendermode;
+                    break;
+                case CAMERA:
+                    if (key_is("type")) return d.camera_type;
+                    if (key_is("width")) return d.width;
+                    if (key_is("height")) return d.height;
+                    if (key_is("position")) return d.position;
+                    if (key_is("lookAt")) return d.look_at;
+                    if (key_is("upVector")) return d.up_vector;
+                    if (key_is("fov")) return d.fov;
+                    if (key_is("exposure")) return d.exposure;
+                    if (key_is("adaptive")) return d.adaptive;
+                    if (key_is("minSamples")) return d.min_samples;
+                    if (key_is("maxSamples")) return d.max_samples;
+                    if (key_is("errorThreshold")) return d.error_threshold;
+                    break;
+                case SCENE:
+                    if (key_is("backgroundcolor")) return d.background_color;
+                    break;
+                case LIGHT:
+                    if (key_is("type")) return light.type;
+                    if (key_is("position")) return light.position;
+                    if (key_is("intensity")) return light.intensity;
+                    if (key_is("radius")) return light.radius;
+                    break;
+                case SHAPE:
+                    if (key_is("type")) return shape.type;
+                    if (key_is("file")) return shape.file;
+                    if (key_is("center")) return shape.center;
+                    if (key_is("axis")) return shape.axis;
+                    if (key_is("v0")) return shape.v0;
+                    if (key_is("v1")) return shape.v1;
+                    if (key_is("v2")) return shape.v2;
+                    if (key_is("radius")) return shape.radius;
+                    if (key_is("height")) return shape.height;
+                    break;
+                case MATERIAL:
+                    if (key_is("ks")) return shape.ks;
+                    if (key_is("kd")) return shape.kd;
+                    if (key_is("specularexponent")) return shape.specular_exponent;
+                    if (key_is("diffusecolor")) return shape.diffuse_color;
+                    if (key_is("specularcolor")) return shape.specular_color;
+                    if (key_is("isreflective")) return shape.is_reflective;
+                    if (key_is("reflectivity")) return shape.reflectivity;
+                    if (key_is("isrefractive")) return shape.is_refractive;
+                    if (key_is("refractiveindex")) return shape.refractive_index;
+                    break;
+                default:
+                    break;
+            }
+            return FieldRef();
+        }
+
+        template <typename T>
+        static void set(SceneField<T>& field, const T& value) {
+            field.value = value;
+            field.state = SceneField<T>::SET;
+        }
+
+        template <typename T>
+        static void wrongType(SceneField<T>& field, const char* type_name) {
+            field.state = SceneField<T>::WRONG_TYPE;
+            field.found_type = type_name;
+        }
+
+        static void wrongType(const FieldRef& field, const char* type_name) {
+            if (field.integer) wrongType(*field.integer, type_name);
+            if (field.real) wrongType(*field.real, type_name);
+            if (field.flag) wrongType(*field.flag, type_name);
+            if (field.text) wrongType(*field.text, type_name);
+            if (field.triplet) wrongType(*field.triplet, type_name);
+        }
+
+        // Numbers convert to int and double fields like nlohmann::json::get does; anything else must match exactly
+        static void store(const FieldRef& field, const Scalar& scalar) {
+            if (field.integer && scalar.numeric()) {
+                set(*field.integer, static_cast<int>(scalar.number));
+            } else if (field.real && scalar.numeric()) {
+                set(*field.real, scalar.number);
+            } else if (field.flag && scalar.kind == Scalar::BOOLEAN) {
+                set(*field.flag, scalar.flag);
+            } else if (field.text && scalar.kind == Scalar::STRING) {
+                set(*field.text, *scalar.text);
+            } else {
+                wrongType(field, scalar.type_name);
+            }
+        }
+
+        bool value(const Scalar& scalar) {
+            if (stack.empty()) {
+                description.document_null = scalar.kind == Scalar::NUL;
+                return true;
+            }
+            Context context = stack.back();
+            switch (context) {
+                case TRIPLET:
+                    if (scalar.numeric()) {
+                        if (triplet_count < 3) triplet->value[triplet_count] = scalar.number;
+                    } else {
+                        triplet_numbers = false;
+                    }
+                    triplet_count++;
+                    return true;
+                case SKIP:
+                    return true;
+                case MATERIAL_LIST:
+                    shape.material = ShapeEntry::MATERIAL_NOT_OBJECT;
+                    return true;
+                case LIGHTS:
+                    std::cerr << "Error: incorrect type for a key in light. Skipping this light." << std::endl;
+                    return true;
+                case SHAPES:
+                    description.shape_entries++;
+                    std::cerr << "Error: incorrect type for a key in shape. Skipping this shape." << std::endl;
+                    return true;
+                default:
+                    break;
+            }
+
+            if (context == ROOT && key_is("scene")) {
+                description.scene_null = scalar.kind == Scalar::NUL;
+                sceneNotObject(scalar.type_name);
+            } else if (context == SCENE && key_is("lightsources")) {
+                description.lights_state = LIST_NOT_ARRAY;
+            } else if (context == SCENE && key_is("shapes")) {
+                description.shapes_state = LIST_NOT_ARRAY;
+            } else if (context == SHAPE && key_is("material")) {
+                shape.material = scalar.kind == Scalar::NUL ? ShapeEntry::MATERIAL_EMPTY : ShapeEntry::MATERIAL_NOT_OBJECT;
+            } else {
+                store(lookup(context), scalar);
+            }
+            return true;
+        }
+
+        bool open(bool object) {
+            if (stack.empty()) {
+                stack.push_back(object ? ROOT : SKIP);
+                return true;
+            }
+
+            Context context = stack.back();
+            Context next = SKIP;
+            if (context == SKIP) {
+                next = SKIP;
+            } else if (context == MATERIAL_LIST) {
+                shape.material = ShapeEntry::MATERIAL_NOT_OBJECT;
+            } else if (context == TRIPLET) {
+                triplet_numbers = false;
+                triplet_count++;
+            } else if (context == LIGHTS) {
+                if (object) {
+                    light = LightEntry();
+                    next = LIGHT;
+                } else {
+                    std::cerr << "Error: incorrect type for a key in light. Skipping this light." << std::endl;
+                }
+            } else if (context == SHAPES) {
+                description.shape_entries++;
+                if (object) {
+                    shape = ShapeEntry();
+                    next = SHAPE;
+                } else {
+                    std::cerr << "Error: incorrect type for a key in shape. Skipping this shape." << std::endl;
+                }
+            } else if (context == ROOT && key_is("camera")) {
+                next = object ? CAMERA : SKIP;
+            } else if (context == ROOT && key_is("scene")) {
+                if (!object) sceneNotObject("array");
+                next = object ? SCENE : SKIP;
+            } else if (context == SCENE && key_is("lightsources")) {
+                description.lights_state = object ? LIST_NOT_ARRAY : LIST_ARRAY;
+                description.lights.clear();     // A repeated key replaces the earlier list
+                next = object ? SKIP : LIGHTS;
+            } else if (context == SCENE && key_is("shapes")) {
+                description.shapes_state = object ? LIST_NOT_ARRAY : LIST_ARRAY;
+                description.shapes.clear();
+                description.mesh_files.clear();
+                description.shape_entries = 0;
+                next = object ? SKIP : SHAPES;
+            } else if (context == SHAPE && key_is("material")) {
+                // An empty array counts as no material, like an empty object or null
+                shape.material = ShapeEntry::MATERIAL_EMPTY;
+                shape.material_keys = 0;
+                next = object ? MATERIAL : MATERIAL_LIST;
+            } else {
+                FieldRef field = lookup(context);
+                if (!object && field.triplet) {
+                    triplet = field.triplet;
+                    triplet_count = 0;
+                    triplet_numbers = true;
+                    next = TRIPLET;
+                } else {
+                    wrongType(field, object ? "object" : "array");
+                }
+            }
+            stack.push_back(next);
+            return true;
+        }
+
+        bool close() {
+            Context context = stack.back();
+            stack.pop_back();
+            if (context == TRIPLET) {
+                // Extra components are ignored, as the vector-based reader did
+                if (triplet_numbers && triplet_count >= 3) {
+                    triplet->state = SceneField<Triplet>::SET;
+                } else {
+                    wrongType(*triplet, "array");
+                }
+            } else if (context == MATERIAL) {
+                shape.material = shape.material_keys == 0 ? ShapeEntry::MATERIAL_EMPTY : ShapeEntry::MATERIAL_OBJECT;
+            } else if (context == LIGHT) {
+                addLight();
+            } else if (context == SHAPE) {
+                addShape();
+            }
+            return true;
+        }
+
+        // Nothing can be read from a "scene" that is not an object; its settings then have the wrong type
+        void sceneNotObject(const char* type_name) {
+            description.lights_state = description.shapes_state = LIST_NOT_ARRAY;
+            wrongType(description.background_color, type_name);
+        }
+
+        template <typename T>
+        static Check check(const SceneField<T>& field) {
+            if (field.state == SceneField<T>::MISSING) return CHECK_MISSING;
+            if (field.state == SceneField<T>::WRONG_TYPE) return CHECK_WRONG_TYPE;
+            return CHECK_OK;
+        }
+
+        // The first problem among required fields, in the order they are looked up
+        static Check firstProblem(std::initializer_list<Check> checks) {
+            for (Check c : checks) {
+                if (c != CHECK_OK) return c;
+            }
+            return CHECK_OK;
+        }
+
+        static bool reportLight(Check problem) {
+            if (problem == CHECK_MISSING) {
+                std::cerr << "Error: required key not found in light. Skipping this light." << std::endl;
+            } else if (problem == CHECK_WRONG_TYPE) {
+                std::cerr << "Error: incorrect type for a key in light. Skipping this light." << std::endl;
+            }
+            return problem == CHECK_OK;
+        }
+
+        static bool reportShape(Check problem) {
+            if (problem == CHECK_MISSING) {
+                std::cerr << "Error: required key not found in shape. Skipping this shape." << std::endl;
+            } else if (problem == CHECK_WRONG_TYPE) {
+                std::cerr << "Error: incorrect type for a key in shape. Skipping this shape." << std::endl;
+            }
+            return problem == CHECK_OK;
+        }
+
+        static Point3D point(const SceneField<Triplet>& field) {
+            return Point3D(field.value[0], field.value[1], field.value[2]);
+        }
+
+        void addLight() {
+            if (!reportLight(check(light.type))) return;
+            if (light.type.value == "pointlight") {
+                if (!reportLight(firstProblem({check(light.position), check(light.intensity)}))) return;
+                if (!reportLight(light.radius.state == SceneField<double>::WRONG_TYPE ? CHECK_WRONG_TYPE : CHECK_OK)) return;
+                double radius = light.radius.state == SceneField<double>::SET ? light.radius.value : default_light_radius;
+                if (!(radius >= 0)) {
+                    std::cerr << "Error: light radius must not be negative. Using 0." << std::endl;
+                    radius = 0;
+                }
+                description.lights.push_back(std::make_shared<PointLight>(point(light.position), point(light.intensity), radius));
+            } else {
+                std::cerr << "Error: light type '" << light.type.value << "' not recognized. Skipping light." << std::endl;
+            }
+        }
+
+        void addShape() {
+            std::shared_ptr<Material> material;
+            if (shape.material == ShapeEntry::MATERIAL_MISSING || shape.material == ShapeEntry::MATERIAL_EMPTY) {
+                if (shape.material == ShapeEntry::MATERIAL_MISSING) {
+                    std::cerr << "Error: 'material' not found in shape data. Using default material." << std::endl;
+                }
+                material = std::make_shared<Lambertian>(Color(0.8, 0.8, 0.8));
+            } else if (shape.material == ShapeEntry::MATERIAL_NOT_OBJECT) {
+                std::cerr << "Error: material data is not an object. Skipping shape." << std::endl;
+                return;
+            } else {
+                Check problem = firstProblem({check(shape.ks), check(shape.kd), check(shape.specular_exponent),
+                                              check(shape.diffuse_color), check(shape.specular_color), check(shape.is_reflective),
+                                              check(shape.reflectivity), check(shape.is_refractive), check(shape.refractive_index)});
+                if (!reportShape(problem)) return;
+                material = std::make_shared<Blinn_Phong>(point(shape.diffuse_color), point(shape.specular_color), shape.kd.value, shape.ks.value,
+                                                         shape.specular_exponent.value, shape.is_reflective.value, shape.reflectivity.value,
+                                                         shape.is_refractive.value, shape.refractive_index.value);
+            }
+
+            if (!reportShape(check(shape.type))) return;
+            const std::string& type = shape.type.value;
+            if (type == "sphere") {
+                if (!reportShape(firstProblem({check(shape.center), check(shape.radius)}))) return;
+                description.shapes.push_back(std::make_shared<Sphere>(point(shape.center), shape.radius.value, material));
+            } else if (type == "cylinder") {
+                if (!reportShape(firstProblem({check(shape.center), check(shape.axis), check(shape.radius), check(shape.height)}))) return;
+                description.shapes.push_back(std::make_shared<Cylinder>(point(shape.center), point(shape.axis), shape.radius.value, shape.height.value, material));
+            } else if (type == "triangle") {
+                if (!reportShape(firstProblem({check(shape.v0), check(shape.v1), check(shape.v2)}))) return;
+                description.shapes.push_back(std::make_shared<Triangle>(point(shape.v0), point(shape.v1), point(shape.v2), material));
+            } else if (type == "mesh") {
+                if (!reportShape(check(shape.file))) return;
+                std::string path = resolvePath(base_directory, shape.file.value);
+                description.mesh_files.push_back(path);
+                try {
+                    MeshData data = loadMeshFile(path);
+                    auto mesh = std::make_shared<TriangleMesh>(std::move(data.vertices), std::move(data.indices), material);
+                    std::clog << "Loaded mesh '" << shape.file.value << "': " << mesh->triangleCount() << " triangles, " << mesh->vertexCount() << " vertices\n";
+                    description.shapes.push_back(mesh);
+                } catch (std::exception& e) {
+                    std::cerr << "Error: " << e.what() << ". Skipping mesh." << std::endl;
+                }
+            } else {
+                std::cerr << "Error: shape type '" << type << "' not recognized. Skipping shape." << std::endl;
+            }
+        }
+};
+
+#endif // SCENE_PARSER_H
@@ -2,16 +2,23 @@
 #define SHAPE_H
 
 #include "math_utils.h"
+#include "aabb.h"
+
+#include <cstdint>
+#include <stdexcept>
 
 class Material; // Forward declaration
 class Scene;
 
+// Material index of a shape without a material
+const std::uint32_t no_material = 0xffffffffu;
+
 class Hit_record { // Record of the hit
     public:
-        float t;                            // t scalar of the ray
+        real t;                             // t scalar of the ray
         Vector3D p;                         // Point of intersection
         Vector3D normal;                    // Normal at the point of intersection
-        std::shared_ptr<Material> mat_ptr;  // Material of the object
+        std::uint32_t material;             // Index of the object's material in the scene's material table
         bool front_face;                    // Is the ray hitting the front face of the object?
 
         void set_face_normal(const Ray& r, const Vector3D& outward_normal) {
@@ -23,18 +30,30 @@ class Hit_record { // Record of the hit
 class Shape {
     protected:
         Scene* scene; // Pointer to the scene the shape is in
-        
+        std::uint32_t material_id = no_material;    // Index of getMaterial() in the scene's material table, set by Scene::add
+
     public:
         virtual ~Shape() {}
 
-        virtual bool hit(const Ray& r, Interval ray_t, Hit_record& rec, const Point3D* check_point = nullptr) const = 0;
+        virtual bool hit(const Ray& r, Interval ray_t, Hit_record& rec) const = 0;
 
         void setScene(Scene* _scene) {scene = _scene;}
+        void setMaterialId(std::uint32_t id) {material_id = id;}
+        std::uint32_t getMaterialId() const {return material_id;}
 
-        virtual bool is_light_source_obstructed(const Ray& ray, Interval ray_t, const Point3D& light_position) const = 0;
+        // Any-hit query used by shadow rays: true as soon as the ray hits the shape anywhere within ray_t.
+        // Unlike hit(), no hit record, normal or material is produced.
+        virtual bool occluded(const Ray& r, Interval ray_t) const = 0;
 
         virtual std::shared_ptr<Material> getMaterial() const = 0;
 
+        // Throws std::invalid_argument if the geometry cannot be intersected, e.g. a cylinder without an axis.
+        // Scene::add() drops such shapes instead of letting their intersection routines check every ray
+        virtual void validate() const {}
+
+        // Axis-aligned box enclosing the whole shape, used to build the scene BVH
+        virtual AABB bounding_box() const = 0;
+
         virtual Point3D getCenter() const = 0;
         virtual double getRadius() const = 0;
         virtual double getHeight() const = 0;
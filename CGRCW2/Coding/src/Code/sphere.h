@@ -3,73 +3,95 @@
 
 #include "shape.h"
 #include "material.h"
+#include "stats.h"
 
 class Scene;
 
+// Plain sphere record: what the scene stores per sphere and intersects without a virtual call
+struct SpherePrimitive {
+    Point3D center;
+    real radius;
+    real radius_squared;        // Derived from radius by Sphere::primitive()
+    real inverse_radius;
+    std::uint32_t material;     // Index into the scene's material table
+
+    // Check if ray intersects sphere, update the hit record if it does
+    RT_FORCE_INLINE bool hit(const Ray& ray, Interval ray_t, Hit_record& record) const {
+        RT_STATS_TEST(PRIM_SPHERE);
+        Vector3D oc = ray.getOrigin() - center;
+        real a = getLengthSquared(ray.getDirection());
+        real half_b = dotProduct(oc, ray.getDirection());
+        real c = getLengthSquared(oc) - radius_squared;
+        real discriminant = half_b * half_b - a * c;
+
+        if (discriminant < 0) return false;
+        real sqrtd = std::sqrt(discriminant);
+
+        // Find the nearest root that lies in the acceptable range.
+        real root = (-half_b - sqrtd) / a;
+        // If the root is not in the acceptable range, try the other root
+        if (!(ray_t.contains(root))) {
+            // If the other root is not in the acceptable range, return false
+            root = (-half_b + sqrtd) / a;
+            if (!(ray_t.contains(root)))
+                return false;
+        }
+
+        // If past this point, intersection point found and is in acceptable range
+        fill(ray, root, record);
+        return true;
+    }
+
+    // Hit record of the ray's hit at distance t, which is on the sphere
+    RT_FORCE_INLINE void fill(const Ray& ray, real t, Hit_record& record) const {
+        record.t = t;
+        record.p = ray.at(t);
+        Vector3D outward_normal = (record.p - center) * inverse_radius;
+        record.set_face_normal(ray, outward_normal);
+        record.material = material;
+    }
+
+    // Shadow ray test: only the roots are needed, either one inside ray_t blocks the ray
+    RT_FORCE_INLINE bool occluded(const Ray& ray, Interval ray_t) const {
+        RT_STATS_TEST(PRIM_SPHERE);
+        Vector3D oc = ray.getOrigin() - center;
+        real a = getLengthSquared(ray.getDirection());
+        real half_b = dotProduct(oc, ray.getDirection());
+        real c = getLengthSquared(oc) - radius_squared;
+        real discriminant = half_b * half_b - a * c;
+
+        if (discriminant < 0) return false;
+        real sqrtd = std::sqrt(discriminant);
+
+        return ray_t.contains((-half_b - sqrtd) / a) || ray_t.contains((-half_b + sqrtd) / a);
+    }
+};
+
 class Sphere : public Shape
 {
     public:
         // Default constructor
         Sphere(Point3D _center, double _radius, std::shared_ptr<Material> _material) : center(_center), radius(_radius), mat(_material) {}
 
-        // Check if ray intersects sphere, update the hit record if it does
-        // Alternatively, if a check_point is passed, check if the closest intersection point is the same as *check_point. If it is, return true, else return false. No update to the hit record is made.
-        virtual bool hit(const Ray& ray, Interval ray_t, Hit_record& record, const Point3D* check_point) const override{
-            Vector3D oc = ray.getOrigin() - center;
-            double a = getLengthSquared(ray.getDirection());
-            double half_b = dotProduct(oc, ray.getDirection());
-            double c = getLengthSquared(oc) - radius * radius;
-            double discriminant = half_b * half_b - a * c;
-
-            if (discriminant < 0) return false;
-            double sqrtd = sqrt(discriminant);
-
-            // Find the nearest root that lies in the acceptable range.
-            double root = (-half_b - sqrtd) / a;
-            // If the root is not in the acceptable range, try the other root
-            if (!(ray_t.contains(root))) {
-                // If the other root is not in the acceptable range, return false
-                root = (-half_b + sqrtd) / a;
-                if (!(ray_t.contains(root)))
-                    return false;
-            }
+        // The record the scene intersects this sphere through
+        SpherePrimitive primitive() const {
+            SpherePrimitive p = {center, radius, radius * radius, 1 / radius, material_id};
+            return p;
+        }
 
-            // If past this point, intersection point found and is in acceptable range
-
-            // Calculate the intersection point
-            auto t = root;
-            auto position = ray.at(t);
-
-            // If check_point a nullptr, skip this step
-            // If not, shadow ray is being traced. Check if the intersection point is the same as the check_point
-            if (check_point != nullptr) {
-                // If the intersection point is not the same as the check_point, return true
-                if (position != *check_point) {
-                    // This means there was some other shape that was closer to the light source than this sphere
-                    return true;
-                } else {
-                    return false;
-                }
+        // A negative radius turns the normals inwards, which is allowed; a zero one leaves nothing to hit
+        virtual void validate() const override {
+            if (!(std::fabs(radius) > 0) || !std::isfinite(radius)) {
+                throw std::invalid_argument("Sphere radius must be nonzero and finite");
             }
+        }
 
-            record.t = t;
-            record.p = position;
-            Vector3D outward_normal = (record.p - center) / radius;
-            record.set_face_normal(ray, outward_normal);
-            record.mat_ptr = mat;
-
-            return true;
+        virtual bool hit(const Ray& ray, Interval ray_t, Hit_record& record) const override {
+            return primitive().hit(ray, ray_t, record);
         }
 
-        // Checks if a shadow ray from intersection point can be traced back to the light source. If ray is traceable, it shouldn't hit any other shapes in the scene.
-        virtual bool is_light_source_obstructed(const Ray& ray, Interval ray_t, const Point3D& light_position) const {
-            Hit_record temp_rec;
-            // Check if shadow ray intersects any of the shapes in the scene
-            if (hit(ray, ray_t, temp_rec, &light_position)) {
-                return true;
-            } else {
-                return false;
-            }
+        virtual bool occluded(const Ray& ray, Interval ray_t) const override {
+            return primitive().occluded(ray, ray_t);
         }
 
         virtual Point3D getCenter() const override {return center;}
@@ -77,6 +99,11 @@ class Sphere : public Shape
         virtual std::shared_ptr<Material> getMaterial() const override {return mat;}
         virtual double getHeight() const override {return 0;}
 
+        virtual AABB bounding_box() const override {
+            Vector3D radius_vector(std::fabs(radius), std::fabs(radius), std::fabs(radius));
+            return AABB(center - radius_vector, center + radius_vector);
+        }
+
         virtual bool is_sphere() const override {return true;}
         virtual bool is_triangle() const override {return false;}
         virtual bool is_cylinder() const override {return false;}
@@ -89,7 +116,7 @@ class Sphere : public Shape
 
     private:
         Point3D center;
-        double radius;
+        real radius;
         std::shared_ptr<Material> mat;
 };
 
@@ -0,0 +1,346 @@
+#ifndef SPHERE_BATCH_H
+#define SPHERE_BATCH_H
+
+#include "math_utils.h"
+#include "stats.h"
+
+#include <limits>
+#include <vector>
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// Spheres packed as a structure of arrays (cx, cy, cz, r^2) so that one ray can be tested
+// against several spheres per instruction. With AVX-512 a block is 8 doubles wide, with
+// AVX2 it is 4; without either, the same loop runs one sphere at a time.
+// The arrays are padded with NaN spheres so a block may always be loaded whole; NaNs
+// never compare as inside the ray interval, so padding lanes can never report a hit.
+class SphereBatch {
+    public:
+#if defined(__AVX512F__)
+        static const int lanes = 8;
+#elif defined(__AVX2__)
+        static const int lanes = 4;
+#else
+        static const int lanes = 1;
+#endif
+
+        bool empty() const {return shape_indices.empty();}
+        int size() const {return static_cast<int>(shape_indices.size());}
+
+        // Index into Scene's shape list of the sphere at batch position i
+        int shape_index(int i) const {return shape_indices[i];}
+
+        const char* kernel_name() const {
+            return lanes == 8 ? "avx512" : (lanes == 4 ? "avx2" : "scalar");
+        }
+
+        void clear() {
+            cx.clear(); cy.clear(); cz.clear(); r2.clear();
+            centers.clear(); radii.clear();
+            shape_indices.clear(); casts_shadow.clear();
+        }
+
+        void add(const Point3D& center, double radius, int shape_index, bool shadow_caster) {
+            // Drop the padding of the previous add before appending
+            cx.resize(size()); cy.resize(size()); cz.resize(size()); r2.resize(size());
+            casts_shadow.resize(size());
+
+            cx.push_back(center.x);
+            cy.push_back(center.y);
+            cz.push_back(center.z);
+            r2.push_back(radius * radius);
+            centers.push_back(center);
+            radii.push_back(radius);
+            shape_indices.push_back(shape_index);
+            casts_shadow.push_back(shadow_caster ? 1.0 : 0.0);
+
+            // A block that starts at the last sphere must still be readable
+            double nan = std::numeric_limits<double>::quiet_NaN();
+            cx.resize(size() + lanes, nan);
+            cy.resize(size() + lanes, nan);
+            cz.resize(size() + lanes, nan);
+            r2.resize(size() + lanes, nan);
+            casts_shadow.resize(size() + lanes, 0.0);
+        }
+
+        // Reorder the batch so that position i holds the sphere that used to be at order[i]
+        void reorder(const std::vector<int>& order) {
+            SphereBatch sorted;
+            for (int i : order) {
+                sorted.add(centers[i], radii[i], shape_indices[i], casts_shadow[i] != 0.0);
+            }
+            *this = sorted;
+        }
+
+        // Nearest hit among positions [first, first + count) inside ray_t.
+        // On a hit, ray_t.max is shrunk to the hit distance and hit_index is set to the batch position.
+        bool hit(const Ray& r, int first, int count, Interval& ray_t, int& hit_index) const {
+            RT_STATS_TESTS(PRIM_BATCHED_SPHERE, count);
+#if defined(__AVX512F__)
+            return hit_avx512(r, first, count, ray_t, hit_index);
+#elif defined(__AVX2__)
+            return hit_avx2(r, first, count, ray_t, hit_index);
+#else
+            return hit_scalar(r, first, count, ray_t, hit_index);
+#endif
+        }
+
+        // True if any shadow-casting sphere in [first, first + count) is hit inside ray_t
+        bool occluded(const Ray& r, int first, int count, Interval ray_t) const {
+            RT_STATS_TESTS(PRIM_BATCHED_SPHERE, count);
+#if defined(__AVX512F__)
+            return occluded_avx512(r, first, count, ray_t);
+#elif defined(__AVX2__)
+            return occluded_avx2(r, first, count, ray_t);
+#else
+            return occluded_scalar(r, first, count, ray_t);
+#endif
+        }
+
+        // Reference version of the kernel, one sphere at a time over the same arrays
+        bool hit_scalar(const Ray& r, int first, int count, Interval& ray_t, int& hit_index) const {
+            Point3D o = r.getOrigin();
+            Vector3D d = r.getDirection();
+            double a = getLengthSquared(d);
+            bool hit_anything = false;
+
+            for (int i = first; i < first + count; ++i) {
+                double ocx = o.x - cx[i], ocy = o.y - cy[i], ocz = o.z - cz[i];
+                double half_b = ocx * d.x + ocy * d.y + ocz * d.z;
+                double c = ocx * ocx + ocy * ocy + ocz * ocz - r2[i];
+                double discriminant = half_b * half_b - a * c;
+                if (discriminant < 0) continue;
+
+                double sqrtd = sqrt(discriminant);
+                double root = (-half_b - sqrtd) / a;
+                if (!ray_t.contains(root)) {
+                    root = (-half_b + sqrtd) / a;
+                    if (!ray_t.contains(root)) continue;
+                }
+                ray_t.max = root;
+                hit_index = i;
+                hit_anything = true;
+            }
+            return hit_anything;
+        }
+
+        bool occluded_scalar(const Ray& r, int first, int count, Interval ray_t) const {
+            Point3D o = r.getOrigin();
+            Vector3D d = r.getDirection();
+            double a = getLengthSquared(d);
+
+            for (int i = first; i < first + count; ++i) {
+                if (casts_shadow[i] == 0.0) continue;
+                double ocx = o.x - cx[i], ocy = o.y - cy[i], ocz = o.z - cz[i];
+                double half_b = ocx * d.x + ocy * d.y + ocz * d.z;
+                double c = ocx * ocx + ocy * ocy + ocz * ocz - r2[i];
+                double discriminant = half_b * half_b - a * c;
+                if (discriminant < 0) continue;
+
+                double sqrtd = sqrt(discriminant);
+                if (ray_t.contains((-half_b - sqrtd) / a) || ray_t.contains((-half_b + sqrtd) / a)) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+    private:
+        std::vector<double> cx, cy, cz, r2;
+        std::vector<double> casts_shadow;   // 1.0 or 0.0, kept as doubles so it loads straight into a lane mask
+        std::vector<Point3D> centers;       // Unpadded copies, only used to rebuild the arrays
+        std::vector<double> radii;
+        std::vector<int> shape_indices;
+
+#if defined(__AVX2__) && !defined(__AVX512F__)
+        bool hit_avx2(const Ray& r, int first, int count, Interval& ray_t, int& hit_index) const {
+            Point3D o = r.getOrigin();
+            Vector3D d = r.getDirection();
+            const __m256d ox = _mm256_set1_pd(o.x), oy = _mm256_set1_pd(o.y), oz = _mm256_set1_pd(o.z);
+            const __m256d dx = _mm256_set1_pd(d.x), dy = _mm256_set1_pd(d.y), dz = _mm256_set1_pd(d.z);
+            const __m256d a = _mm256_set1_pd(getLengthSquared(d));
+            const __m256d t_min = _mm256_set1_pd(ray_t.min);
+            const __m256d inf = _mm256_set1_pd(infinity);
+            const __m256d lane_offsets = _mm256_set_pd(3, 2, 1, 0);
+
+            __m256d best_t = _mm256_set1_pd(ray_t.max);
+            __m256d best_index = _mm256_set1_pd(-1);
+
+            for (int i = first; i < first + count; i += lanes) {
+                __m256d ocx = _mm256_sub_pd(ox, _mm256_loadu_pd(&cx[i]));
+                __m256d ocy = _mm256_sub_pd(oy, _mm256_loadu_pd(&cy[i]));
+                __m256d ocz = _mm256_sub_pd(oz, _mm256_loadu_pd(&cz[i]));
+                __m256d half_b = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(ocx, dx), _mm256_mul_pd(ocy, dy)), _mm256_mul_pd(ocz, dz));
+                __m256d c = _mm256_sub_pd(_mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(ocx, ocx), _mm256_mul_pd(ocy, ocy)), _mm256_mul_pd(ocz, ocz)), _mm256_loadu_pd(&r2[i]));
+                __m256d discriminant = _mm256_sub_pd(_mm256_mul_pd(half_b, half_b), _mm256_mul_pd(a, c));
+
+                // Lanes past the end of the range belong to other leaves
+                __m256d index = _mm256_add_pd(_mm256_set1_pd(i), lane_offsets);
+                __m256d valid = _mm256_and_pd(_mm256_cmp_pd(discriminant, _mm256_setzero_pd(), _CMP_GE_OQ),
+                                              _mm256_cmp_pd(index, _mm256_set1_pd(first + count), _CMP_LT_OQ));
+
+                __m256d sqrtd = _mm256_sqrt_pd(_mm256_max_pd(discriminant, _mm256_setzero_pd()));
+                __m256d near_root = _mm256_div_pd(_mm256_sub_pd(_mm256_setzero_pd(), _mm256_add_pd(half_b, sqrtd)), a);
+                __m256d far_root = _mm256_div_pd(_mm256_sub_pd(sqrtd, half_b), a);
+
+                // Nearest root inside [t_min, best_t], otherwise infinity
+                __m256d near_ok = _mm256_and_pd(_mm256_cmp_pd(near_root, t_min, _CMP_GE_OQ), _mm256_cmp_pd(near_root, best_t, _CMP_LE_OQ));
+                __m256d far_ok = _mm256_and_pd(_mm256_cmp_pd(far_root, t_min, _CMP_GE_OQ), _mm256_cmp_pd(far_root, best_t, _CMP_LE_OQ));
+                __m256d t = _mm256_blendv_pd(_mm256_blendv_pd(inf, far_root, far_ok), near_root, near_ok);
+                __m256d closer = _mm256_and_pd(valid, _mm256_or_pd(near_ok, far_ok));
+
+                best_t = _mm256_blendv_pd(best_t, t, closer);
+                best_index = _mm256_blendv_pd(best_index, index, closer);
+            }
+
+            double t_lanes[4], index_lanes[4];
+            _mm256_storeu_pd(t_lanes, best_t);
+            _mm256_storeu_pd(index_lanes, best_index);
+            return reduce(t_lanes, index_lanes, 4, ray_t, hit_index);
+        }
+
+        bool occluded_avx2(const Ray& r, int first, int count, Interval ray_t) const {
+            Point3D o = r.getOrigin();
+            Vector3D d = r.getDirection();
+            const __m256d ox = _mm256_set1_pd(o.x), oy = _mm256_set1_pd(o.y), oz = _mm256_set1_pd(o.z);
+            const __m256d dx = _mm256_set1_pd(d.x), dy = _mm256_set1_pd(d.y), dz = _mm256_set1_pd(d.z);
+            const __m256d a = _mm256_set1_pd(getLengthSquared(d));
+            const __m256d t_min = _mm256_set1_pd(ray_t.min);
+            const __m256d t_max = _mm256_set1_pd(ray_t.max);
+            const __m256d lane_offsets = _mm256_set_pd(3, 2, 1, 0);
+
+            for (int i = first; i < first + count; i += lanes) {
+                __m256d ocx = _mm256_sub_pd(ox, _mm256_loadu_pd(&cx[i]));
+                __m256d ocy = _mm256_sub_pd(oy, _mm256_loadu_pd(&cy[i]));
+                __m256d ocz = _mm256_sub_pd(oz, _mm256_loadu_pd(&cz[i]));
+                __m256d half_b = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(ocx, dx), _mm256_mul_pd(ocy, dy)), _mm256_mul_pd(ocz, dz));
+                __m256d c = _mm256_sub_pd(_mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(ocx, ocx), _mm256_mul_pd(ocy, ocy)), _mm256_mul_pd(ocz, ocz)), _mm256_loadu_pd(&r2[i]));
+                __m256d discriminant = _mm256_sub_pd(_mm256_mul_pd(half_b, half_b), _mm256_mul_pd(a, c));
+
+                __m256d index = _mm256_add_pd(_mm256_set1_pd(i), lane_offsets);
+                __m256d valid = _mm256_and_pd(_mm256_cmp_pd(discriminant, _mm256_setzero_pd(), _CMP_GE_OQ),
+                                              _mm256_cmp_pd(index, _mm256_set1_pd(first + count), _CMP_LT_OQ));
+                valid = _mm256_and_pd(valid, _mm256_cmp_pd(_mm256_loadu_pd(&casts_shadow[i]), _mm256_setzero_pd(), _CMP_NEQ_OQ));
+                if (_mm256_movemask_pd(valid) == 0) continue;
+
+                __m256d sqrtd = _mm256_sqrt_pd(_mm256_max_pd(discriminant, _mm256_setzero_pd()));
+                __m256d near_root = _mm256_div_pd(_mm256_sub_pd(_mm256_setzero_pd(), _mm256_add_pd(half_b, sqrtd)), a);
+                __m256d far_root = _mm256_div_pd(_mm256_sub_pd(sqrtd, half_b), a);
+                __m256d near_ok = _mm256_and_pd(_mm256_cmp_pd(near_root, t_min, _CMP_GE_OQ), _mm256_cmp_pd(near_root, t_max, _CMP_LE_OQ));
+                __m256d far_ok = _mm256_and_pd(_mm256_cmp_pd(far_root, t_min, _CMP_GE_OQ), _mm256_cmp_pd(far_root, t_max, _CMP_LE_OQ));
+
+                if (_mm256_movemask_pd(_mm256_and_pd(valid, _mm256_or_pd(near_ok, far_ok))) != 0) {
+                    return true;
+                }
+            }
+            return false;
+        }
+#endif
+
+#if defined(__AVX512F__)
+        bool hit_avx512(const Ray& r, int first, int count, Interval& ray_t, int& hit_index) const {
+            Point3D o = r.getOrigin();
+            Vector3D d = r.getDirection();
+            const __m512d ox = _mm512_set1_pd(o.x), oy = _mm512_set1_pd(o.y), oz = _mm512_set1_pd(o.z);
+            const __m512d dx = _mm512_set1_pd(d.x), dy = _mm512_set1_pd(d.y), dz = _mm512_set1_pd(d.z);
+            const __m512d a = _mm512_set1_pd(getLengthSquared(d));
+            const __m512d t_min = _mm512_set1_pd(ray_t.min);
+            const __m512d zero = _mm512_setzero_pd();
+            const __m512d lane_offsets = _mm512_set_pd(7, 6, 5, 4, 3, 2, 1, 0);
+
+            __m512d best_t = _mm512_set1_pd(ray_t.max);
+            __m512d best_index = _mm512_set1_pd(-1);
+
+            for (int i = first; i < first + count; i += lanes) {
+                __m512d ocx = _mm512_sub_pd(ox, _mm512_loadu_pd(&cx[i]));
+                __m512d ocy = _mm512_sub_pd(oy, _mm512_loadu_pd(&cy[i]));
+                __m512d ocz = _mm512_sub_pd(oz, _mm512_loadu_pd(&cz[i]));
+                __m512d half_b = _mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(ocx, dx), _mm512_mul_pd(ocy, dy)), _mm512_mul_pd(ocz, dz));
+                __m512d c = _mm512_sub_pd(_mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(ocx, ocx), _mm512_mul_pd(ocy, ocy)), _mm512_mul_pd(ocz, ocz)), _mm512_loadu_pd(&r2[i]));
+                __m512d discriminant = _mm512_sub_pd(_mm512_mul_pd(half_b, half_b), _mm512_mul_pd(a, c));
+
+                // Lanes past the end of the range belong to other leaves
+                __m512d index = _mm512_add_pd(_mm512_set1_pd(i), lane_offsets);
+                __mmask8 valid = _mm512_cmp_pd_mask(discriminant, zero, _CMP_GE_OQ)
+                               & _mm512_cmp_pd_mask(index, _mm512_set1_pd(first + count), _CMP_LT_OQ);
+                if (valid == 0) continue;
+
+                // maskz forms: same result, but avoid GCC 12 uninitialized warnings from _mm512_undefined_pd
+                __m512d sqrtd = _mm512_maskz_sqrt_pd(0xFF, _mm512_maskz_max_pd(0xFF, discriminant, zero));
+                __m512d near_root = _mm512_div_pd(_mm512_sub_pd(zero, _mm512_add_pd(half_b, sqrtd)), a);
+                __m512d far_root = _mm512_div_pd(_mm512_sub_pd(sqrtd, half_b), a);
+
+                // Nearest root inside [t_min, best_t]
+                __mmask8 near_ok = _mm512_cmp_pd_mask(near_root, t_min, _CMP_GE_OQ) & _mm512_cmp_pd_mask(near_root, best_t, _CMP_LE_OQ);
+                __mmask8 far_ok = _mm512_cmp_pd_mask(far_root, t_min, _CMP_GE_OQ) & _mm512_cmp_pd_mask(far_root, best_t, _CMP_LE_OQ);
+                __m512d t = _mm512_mask_blend_pd(near_ok, far_root, near_root);
+                __mmask8 closer = valid & (near_ok | far_ok);
+
+                best_t = _mm512_mask_blend_pd(closer, best_t, t);
+                best_index = _mm512_mask_blend_pd(closer, best_index, index);
+            }
+
+            double t_lanes[8], index_lanes[8];
+            _mm512_storeu_pd(t_lanes, best_t);
+            _mm512_storeu_pd(index_lanes, best_index);
+            return reduce(t_lanes, index_lanes, 8, ray_t, hit_index);
+        }
+
+        bool occluded_avx512(const Ray& r, int first, int count, Interval ray_t) const {
+            Point3D o = r.getOrigin();
+            Vector3D d = r.getDirection();
+            const __m512d ox = _mm512_set1_pd(o.x), oy = _mm512_set1_pd(o.y), oz = _mm512_set1_pd(o.z);
+            const __m512d dx = _mm512_set1_pd(d.x), dy = _mm512_set1_pd(d.y), dz = _mm512_set1_pd(d.z);
+            const __m512d a = _mm512_set1_pd(getLengthSquared(d));
+            const __m512d t_min = _mm512_set1_pd(ray_t.min);
+            const __m512d t_max = _mm512_set1_pd(ray_t.max);
+            const __m512d zero = _mm512_setzero_pd();
+            const __m512d lane_offsets = _mm512_set_pd(7, 6, 5, 4, 3, 2, 1, 0);
+
+            for (int i = first; i < first + count; i += lanes) {
+                __m512d ocx = _mm512_sub_pd(ox, _mm512_loadu_pd(&cx[i]));
+                __m512d ocy = _mm512_sub_pd(oy, _mm512_loadu_pd(&cy[i]));
+                __m512d ocz = _mm512_sub_pd(oz, _mm512_loadu_pd(&cz[i]));
+                __m512d half_b = _mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(ocx, dx), _mm512_mul_pd(ocy, dy)), _mm512_mul_pd(ocz, dz));
+                __m512d c = _mm512_sub_pd(_mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(ocx, ocx), _mm512_mul_pd(ocy, ocy)), _mm512_mul_pd(ocz, ocz)), _mm512_loadu_pd(&r2[i]));
+                __m512d discriminant = _mm512_sub_pd(_mm512_mul_pd(half_b, half_b), _mm512_mul_pd(a, c));
+
+                __m512d index = _mm512_add_pd(_mm512_set1_pd(i), lane_offsets);
+                __mmask8 valid = _mm512_cmp_pd_mask(discriminant, zero, _CMP_GE_OQ)
+                               & _mm512_cmp_pd_mask(index, _mm512_set1_pd(first + count), _CMP_LT_OQ)
+                               & _mm512_cmp_pd_mask(_mm512_loadu_pd(&casts_shadow[i]), zero, _CMP_NEQ_OQ);
+                if (valid == 0) continue;
+
+                __m512d sqrtd = _mm512_maskz_sqrt_pd(0xFF, _mm512_maskz_max_pd(0xFF, discriminant, zero));
+                __m512d near_root = _mm512_div_pd(_mm512_sub_pd(zero, _mm512_add_pd(half_b, sqrtd)), a);
+                __m512d far_root = _mm512_div_pd(_mm512_sub_pd(sqrtd, half_b), a);
+                __mmask8 near_ok = _mm512_cmp_pd_mask(near_root, t_min, _CMP_GE_OQ) & _mm512_cmp_pd_mask(near_root, t_max, _CMP_LE_OQ);
+                __mmask8 far_ok = _mm512_cmp_pd_mask(far_root, t_min, _CMP_GE_OQ) & _mm512_cmp_pd_mask(far_root, t_max, _CMP_LE_OQ);
+
+                if (valid & (near_ok | far_ok)) {
+                    return true;
+                }
+            }
+            return false;
+        }
+#endif
+
+        // Pick the nearest of the per-lane winners; ties go to the lower batch position
+        static bool reduce(const double* t_lanes, const double* index_lanes, int count, Interval& ray_t, int& hit_index) {
+            int best = -1;
+            for (int lane = 0; lane < count; ++lane) {
+                if (index_lanes[lane] < 0) continue;
+                if (best < 0 || t_lanes[lane] < t_lanes[best] || (t_lanes[lane] == t_lanes[best] && index_lanes[lane] < index_lanes[best])) {
+                    best = lane;
+                }
+            }
+            if (best < 0) return false;
+            ray_t.max = t_lanes[best];
+            hit_index = static_cast<int>(index_lanes[best]);
+            return true;
+        }
+};
+
+#endif // SPHERE_BATCH_H
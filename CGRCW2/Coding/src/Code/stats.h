@@ -0,0 +1,174 @@
+#ifndef STATS_H
+#define STATS_H
+
+// Render statistics: intersection tests by primitive type, shadow-ray outcomes, a histogram of
+// path depths and the time spent in each stage of the renderer.
+//
+// Only compiled in when RT_STATS is defined (g++ ... -DRT_STATS, or make STATS=1); otherwise
+// every RT_STATS_* macro expands to nothing and the hot paths are exactly as without them.
+// Like the ray counters, every thread counts into its own copy (thread_stats), which
+// merge_thread_stats() adds to the process-wide total (global_stats).
+
+#ifdef RT_STATS
+
+#include "ray_counters.h"
+#include "nlohmann/json.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+
+enum PrimitiveKind {
+    PRIM_SPHERE,
+    PRIM_BATCHED_SPHERE,    // Spheres tested by the SIMD kernel of the sphere batch
+    PRIM_TRIANGLE,
+    PRIM_CYLINDER,
+    PRIM_MESH_TRIANGLE,
+    PRIM_BVH_NODE,          // Bounding box tests during BVH traversal
+    PRIM_KIND_COUNT
+};
+
+enum Stage {
+    STAGE_SCENE_LOAD,       // Parsing the scene file and building the shapes
+    STAGE_BVH_BUILD,
+    STAGE_RENDER,           // Whole of Camera::render, wall time of the calling thread
+    STAGE_CAMERA_RAYS,      // Generating camera rays
+    STAGE_INTERSECT,        // Closest-hit queries
+    STAGE_SHADOW_RAYS,      // Generating and tracing shadow rays
+    STAGE_SHADE,            // Material::shade for every light
+    STAGE_SCATTER,          // Material::scatter
+    STAGE_OUTPUT,           // Writing the image
+    STAGE_COUNT
+};
+
+inline const char* primitiveKindName(int kind) {
+    static const char* names[PRIM_KIND_COUNT] = {"sphere", "batched_sphere", "triangle", "cylinder", "mesh_triangle", "bvh_node"};
+    return names[kind];
+}
+
+inline const char* stageName(int stage) {
+    static const char* names[STAGE_COUNT] = {"scene_load", "bvh_build", "render", "camera_rays", "intersect", "shadow_rays", "shade", "scatter", "output"};
+    return names[stage];
+}
+
+struct RenderStats {
+    static const int depth_bins = 64;   // Deeper bounces are counted in the last bin
+
+    std::uint64_t intersection_tests[PRIM_KIND_COUNT] = {0};
+    std::uint64_t shadow_occluded = 0;          // Shadow rays whose any-hit traversal stopped at a blocker
+    std::uint64_t shadow_unoccluded = 0;        // Shadow rays that reached the light
+    std::uint64_t depth_histogram[depth_bins] = {0};    // Rays traced at each bounce, 0 = camera rays
+    std::uint64_t stage_nanoseconds[STAGE_COUNT] = {0};
+    std::uint64_t stage_calls[STAGE_COUNT] = {0};
+
+    RenderStats& operator+=(const RenderStats& other) {
+        for (int i = 0; i < PRIM_KIND_COUNT; ++i) intersection_tests[i] += other.intersection_tests[i];
+        shadow_occluded += other.shadow_occluded;
+        shadow_unoccluded += other.shadow_unoccluded;
+        for (int i = 0; i < depth_bins; ++i) depth_histogram[i] += other.depth_histogram[i];
+        for (int i = 0; i < STAGE_COUNT; ++i) {
+            stage_nanoseconds[i] += other.stage_nanoseconds[i];
+            stage_calls[i] += other.stage_calls[i];
+        }
+        return *this;
+    }
+
+    void addDepth(int bounce, std::uint64_t count) {
+        depth_histogram[bounce < 0 ? 0 : (bounce < depth_bins ? bounce : depth_bins - 1)] += count;
+    }
+
+    // Stage times are summed over all threads, so with several workers they exceed the render's wall time
+    nlohmann::ordered_json toJson(const RayCounters& rays) const {
+        nlohmann::ordered_json json;
+        json["rays"] = {
+            {"primary", rays.primary}, {"secondary", rays.secondary()}, {"shadow", rays.shadow}, {"total", rays.total()}
+        };
+        for (int i = 0; i < PRIM_KIND_COUNT; ++i) {
+            json["intersection_tests"][primitiveKindName(i)] = intersection_tests[i];
+        }
+        json["shadow_rays"] = {{"occluded", shadow_occluded}, {"unoccluded", shadow_unoccluded}};
+
+        // Histogram up to the deepest bounce reached
+        int last = depth_bins - 1;
+        while (last > 0 && depth_histogram[last] == 0) --last;
+        json["depth_histogram"] = nlohmann::ordered_json::array();
+        for (int i = 0; i <= last; ++i) {
+            json["depth_histogram"].push_back(depth_histogram[i]);
+        }
+
+        for (int i = 0; i < STAGE_COUNT; ++i) {
+            json["stages"][stageName(i)] = {{"seconds", stage_nanoseconds[i] * 1e-9}, {"calls", stage_calls[i]}};
+        }
+        return json;
+    }
+};
+
+inline RenderStats& thread_stats() {
+    static thread_local RenderStats stats;
+    return stats;
+}
+
+inline RenderStats& global_stats() {
+    static RenderStats stats;
+    return stats;
+}
+
+// Add the calling thread's statistics to global_stats() and start its copy over
+inline void merge_thread_stats() {
+    static std::mutex merge_mutex;
+    std::lock_guard<std::mutex> lock(merge_mutex);
+    global_stats() += thread_stats();
+    thread_stats() = RenderStats();
+}
+
+inline bool saveStats(const std::string& filename, const RenderStats& stats, const RayCounters& rays) {
+    std::ofstream file(filename);
+    if (!file.is_open()) {
+        std::cerr << "Error: Could not open statistics file " << filename << std::endl;
+        return false;
+    }
+    file << stats.toJson(rays).dump(2) << std::endl;
+    return true;
+}
+
+// Adds the time from construction to destruction to one stage of the calling thread
+class StageTimer {
+    public:
+        explicit StageTimer(Stage stage) : stage(stage), start(std::chrono::steady_clock::now()) {}
+        ~StageTimer() {
+            RenderStats& stats = thread_stats();
+            stats.stage_nanoseconds[stage] += static_cast<std::uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+            stats.stage_calls[stage]++;
+        }
+
+    private:
+        Stage stage;
+        std::chrono::steady_clock::time_point start;
+};
+
+#define RT_STATS_CONCAT_INNER(a, b) a##b
+#define RT_STATS_CONCAT(a, b) RT_STATS_CONCAT_INNER(a, b)
+
+#define RT_STATS_COUNT(field) (thread_stats().field++)
+#define RT_STATS_TEST(kind) (thread_stats().intersection_tests[kind]++)
+#define RT_STATS_TESTS(kind, count) (thread_stats().intersection_tests[kind] += (count))
+#define RT_STATS_DEPTH(bounce, count) (thread_stats().addDepth((bounce), (count)))
+#define RT_STATS_TIMER(stage) StageTimer RT_STATS_CONCAT(stage_timer_, __LINE__)(stage)
+#define RT_STATS_MERGE() merge_thread_stats()
+
+#else
+
+#define RT_STATS_COUNT(field) ((void)0)
+#define RT_STATS_TEST(kind) ((void)0)
+#define RT_STATS_TESTS(kind, count) ((void)0)
+#define RT_STATS_DEPTH(bounce, count) ((void)0)
+#define RT_STATS_TIMER(stage) ((void)0)
+#define RT_STATS_MERGE() ((void)0)
+
+#endif // RT_STATS
+
+#endif // STATS_H
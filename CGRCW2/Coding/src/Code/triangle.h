@@ -2,74 +2,108 @@
 #define TRIANGLE_H
 
 #include "shape.h"
+#include "stats.h"
 #include <algorithm>
 
+// Plain triangle record: what the scene stores per triangle and intersects without a virtual call.
+// The edges and the unit face normal are worked out once by Triangle::primitive()
+struct TrianglePrimitive {
+    Point3D v0;
+    Vector3D e1, e2;            // v1 - v0 and v2 - v0
+    Vector3D normal;            // normalize(crossProduct(e1, e2))
+    std::uint32_t material;     // Index into the scene's material table
+
+    RT_FORCE_INLINE bool hit(const Ray& ray, Interval ray_t, Hit_record& record) const {
+        RT_STATS_TEST(PRIM_TRIANGLE);
+        Vector3D p = crossProduct(ray.getDirection(), e2);
+        real a = dotProduct(e1, p);
+        Interval epsilon(-0.00001, 0.00001);
+        if (epsilon.surrounds(a)) {
+            return false;
+        }
+        real f = 1.0 / a;
+        Vector3D s = ray.getOrigin() - v0;
+        real u = f * dotProduct(s, p);
+        Interval uInterval(0.0, 1.0);
+        if (!uInterval.contains(u)) {
+            return false;
+        }
+        Vector3D q = crossProduct(s, e1);
+        real v = f * dotProduct(ray.getDirection(), q);
+        Interval vInterval(0.0, 1.0 - u);
+        if (!vInterval.contains(v)) {
+            return false;
+        }
+        real t = f * dotProduct(e2, q);
+        if (!ray_t.contains(t)) {
+            return false;
+        }
+        auto position = ray.at(t);
+        record.t = t;
+        record.p = position;
+        record.material = material;
+        if (dotProduct(ray.getDirection(), normal) < 0) {
+            // Ray is hitting the front face of the triangle
+            record.set_face_normal(ray, normal);        //For some reason, still giving same normal. Check later. Does actually work, just not showing in image
+        } else {
+            // Ray is hitting the back face of the triangle
+            record.set_face_normal(ray, -normal);
+        }
+        return true;
+    }
+
+    // Shadow ray test: the same Moller-Trumbore steps as hit(), stopping once t is known
+    RT_FORCE_INLINE bool occluded(const Ray& ray, Interval ray_t) const {
+        RT_STATS_TEST(PRIM_TRIANGLE);
+        Vector3D p = crossProduct(ray.getDirection(), e2);
+        real a = dotProduct(e1, p);
+        if (std::fabs(a) < 0.00001) {
+            return false;
+        }
+        real f = 1.0 / a;
+        Vector3D s = ray.getOrigin() - v0;
+        real u = f * dotProduct(s, p);
+        if (u < 0.0 || u > 1.0) {
+            return false;
+        }
+        Vector3D q = crossProduct(s, e1);
+        real v = f * dotProduct(ray.getDirection(), q);
+        if (v < 0.0 || v > 1.0 - u) {
+            return false;
+        }
+        return ray_t.contains(f * dotProduct(e2, q));
+    }
+};
+
 class Triangle : public Shape
 {
     public:
         Triangle(Point3D v0, Point3D v1, Point3D v2, std::shared_ptr<Material> _material) : v0(v0), v1(v1), v2(v2), mat(_material) {};
         //Triangle(Point3D v0, Point3D v1, Point3D v2) : v0(v0), v1(v1), v2(v2) {};
 
-        virtual bool hit(const Ray& ray, Interval ray_t, Hit_record& record, const Point3D* check_point) const override {
+        // The record the scene intersects this triangle through
+        TrianglePrimitive primitive() const {
             Vector3D e1 = v1 - v0;
             Vector3D e2 = v2 - v0;
-            Vector3D p = crossProduct(ray.getDirection(), e2);
-            double a = dotProduct(e1, p);
-            Interval epsilon(-0.00001, 0.00001);
-            if (epsilon.surrounds(a)) {
-                return false;
-            }
-            double f = 1.0 / a;
-            Vector3D s = ray.getOrigin() - v0;
-            double u = f * dotProduct(s, p);
-            Interval uInterval(0.0, 1.0);
-            if (!uInterval.contains(u)) {
-                return false;
-            }
-            Vector3D q = crossProduct(s, e1);
-            double v = f * dotProduct(ray.getDirection(), q);
-            Interval vInterval(0.0, 1.0 - u);
-            if (!vInterval.contains(v)) {
-                return false;
-            }
-            double t = f * dotProduct(e2, q);
-            if (!ray_t.contains(t)) {
-                return false;
-            }
-            auto position = ray.at(t);
-            if (check_point != nullptr) {
-                if (position != *check_point) {
-                    return false;
-                } else {
-                    return true;
-                }
-            }
-            record.t = t;
-            record.p = position;
-            record.mat_ptr = mat;
-            Vector3D outward_normal = crossProduct(e1, e2);
-            if (dotProduct(ray.getDirection(), outward_normal) < 0) {
-                // Ray is hitting the front face of the triangle
-                outward_normal = normalize(outward_normal);
-                record.set_face_normal(ray, outward_normal);        //For some reason, still giving same normal. Check later. Does actually work, just not showing in image
-            } else {
-                // Ray is hitting the back face of the triangle
-                outward_normal = normalize(outward_normal);
-                record.set_face_normal(ray, -outward_normal);
-            }
-            return true;
+            TrianglePrimitive p = {v0, e1, e2, normalize(crossProduct(e1, e2)), material_id};
+            return p;
         }
 
-        virtual bool is_light_source_obstructed(const Ray& ray, Interval ray_t, const Point3D& light_position) const override {
-            Hit_record temp_rec;
-            // Check if shadow ray intersects any of the shapes in the scene
-            if (hit(ray, ray_t, temp_rec, &light_position)) {
-                return true;
-            } else {
-                return false;
+        virtual void validate() const override {
+            real area2 = getLength(crossProduct(v1 - v0, v2 - v0));
+            if (!(area2 > 0) || !std::isfinite(area2)) {
+                throw std::invalid_argument("Degenerate triangle (its vertices are collinear)");
             }
         }
 
+        virtual bool hit(const Ray& ray, Interval ray_t, Hit_record& record) const override {
+            return primitive().hit(ray, ray_t, record);
+        }
+
+        virtual bool occluded(const Ray& ray, Interval ray_t) const override {
+            return primitive().occluded(ray, ray_t);
+        }
+
         virtual Point3D getCenter() const override {
             return (v0 + v1 + v2) / 3;
         }
@@ -82,6 +116,10 @@ class Triangle : public Shape
         virtual std::shared_ptr<Material> getMaterial() const override {return mat;}
         virtual double getHeight() const override {return -1;}
 
+        virtual AABB bounding_box() const override {
+            return AABB(AABB(v0, v1), AABB(v2, v2));
+        }
+
         virtual bool is_sphere() const {return false;}
         virtual bool is_triangle() const {return true;}
         virtual bool is_cylinder() const {return false;}
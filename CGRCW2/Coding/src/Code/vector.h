@@ -7,19 +7,28 @@
 #include <iostream>
 
 
-struct Vector3D {
-    double x;
-    double y;
-    double z;
+// Three component vector in scalar type T. The renderer works in Vector3D, which is Vector3T<real>;
+// Vector3T<double> keeps sums in double precision whatever real is (see Accumulator).
+// The operators are friends defined in the class, so a double operand converts to T instead of
+// failing template argument deduction
+template <typename T>
+struct Vector3T {
+    T x;
+    T y;
+    T z;
 
     // Default constructor
-    Vector3D() : x(0), y(0), z(0) {}
+    Vector3T() : x(0), y(0), z(0) {}
 
     // Parameterized constructor
-    Vector3D(double x, double y, double z) : x(x), y(y), z(z) {}
+    Vector3T(T x, T y, T z) : x(x), y(y), z(z) {}
+
+    // Conversion from a vector of another precision
+    template <typename U>
+    explicit Vector3T(const Vector3T<U>& v) : x(static_cast<T>(v.x)), y(static_cast<T>(v.y)), z(static_cast<T>(v.z)) {}
 
     // Addition assignment operator
-    Vector3D& operator+=(const Vector3D& v) {
+    Vector3T& operator+=(const Vector3T& v) {
         x += v.x;
         y += v.y;
         z += v.z;
@@ -27,7 +36,7 @@ struct Vector3D {
     }
 
     // Subtraction assignment operator
-    Vector3D& operator-=(const Vector3D& v) {
+    Vector3T& operator-=(const Vector3T& v) {
         x -= v.x;
         y -= v.y;
         z -= v.z;
@@ -35,7 +44,7 @@ struct Vector3D {
     }
 
     // Multiplication assignment operator
-    Vector3D& operator*=(double scalar) {
+    Vector3T& operator*=(T scalar) {
         x *= scalar;
         y *= scalar;
         z *= scalar;
@@ -43,7 +52,7 @@ struct Vector3D {
     }
 
     // Division assignment operator
-    Vector3D& operator/=(double scalar) {
+    Vector3T& operator/=(T scalar) {
         x /= scalar;
         y /= scalar;
         z /= scalar;
@@ -51,86 +60,106 @@ struct Vector3D {
     }
 
 
-    static Vector3D random() {
-        return Vector3D(random_double(), random_double(), random_double());
+    static Vector3T random() {
+        return Vector3T(random_double(), random_double(), random_double());
     }
 
-    static Vector3D random(double min, double max) {
-        return Vector3D(random_double(min, max), random_double(min, max), random_double(min, max));
+    static Vector3T random(double min, double max) {
+        return Vector3T(random_double(min, max), random_double(min, max), random_double(min, max));
     }
 
-    friend bool operator!=(const Vector3D& v1, const Vector3D& v2);
-};
+    // Negation of a vector
+    friend Vector3T operator-(const Vector3T& v) {
+        return Vector3T(-v.x, -v.y, -v.z);
+    }
 
-// Negation of a vector
-Vector3D operator-(const Vector3D& v) {
-    return Vector3D(-v.x, -v.y, -v.z);
-}
+    // Equivalence operator
+    friend bool operator==(const Vector3T& v1, const Vector3T& v2) {
+        return v1.x == v2.x && v1.y == v2.y && v1.z == v2.z;
+    }
 
-// Equivalence operator
-bool operator==(const Vector3D& v1, const Vector3D& v2) {
-    return v1.x == v2.x && v1.y == v2.y && v1.z == v2.z;
-}
+    // Non-equivalence operator
+    friend bool operator!=(const Vector3T& v1, const Vector3T& v2) {
+        return !(v1 == v2);
+    }
 
-// Non-equivalence operator
-bool operator!=(const Vector3D& v1, const Vector3D& v2) {
-    return !(v1 == v2);
-}
+    // Addition of two vectors
+    friend Vector3T operator+(const Vector3T& v1, const Vector3T& v2) {
+        return Vector3T(v1.x + v2.x, v1.y + v2.y, v1.z + v2.z);
+    }
 
-// Addition of two vectors
-Vector3D operator+(const Vector3D& v1, const Vector3D& v2) {
-    return Vector3D(v1.x + v2.x, v1.y + v2.y, v1.z + v2.z);
-}
+    // Subtraction of two vectors
+    friend Vector3T operator-(const Vector3T& v1, const Vector3T& v2) {
+        return Vector3T(v1.x - v2.x, v1.y - v2.y, v1.z - v2.z);
+    }
 
-// Subtraction of two vectors
-Vector3D operator-(const Vector3D& v1, const Vector3D& v2) {
-    return Vector3D(v1.x - v2.x, v1.y - v2.y, v1.z - v2.z);
-}
+    // Cross multiplication of two vectors
+    friend Vector3T crossProduct(const Vector3T& v1, const Vector3T& v2) {
+        return Vector3T(
+            v1.y * v2.z - v1.z * v2.y,
+            v1.z * v2.x - v1.x * v2.z,
+            v1.x * v2.y - v1.y * v2.x
+        );
+    }
 
-// Cross multiplication of two vectors
-Vector3D crossProduct(const Vector3D& v1, const Vector3D& v2) {
-    return Vector3D(
-        v1.y * v2.z - v1.z * v2.y,
-        v1.z * v2.x - v1.x * v2.z,
-        v1.x * v2.y - v1.y * v2.x
-    );
-}
+    // Dot multiplication of two vectors
+    friend T dotProduct(const Vector3T& v1, const Vector3T& v2) {
+        return v1.x * v2.x + v1.y * v2.y + v1.z * v2.z;
+    }
 
-// Dot multiplication of two vectors
-double dotProduct(const Vector3D& v1, const Vector3D& v2) {
-    return v1.x * v2.x + v1.y * v2.y + v1.z * v2.z;
-}
+    // Element-wise multiplication of two vectors
+    friend Vector3T operator*(const Vector3T& v1, const Vector3T& v2) {
+        return Vector3T(v1.x * v2.x, v1.y * v2.y, v1.z * v2.z);
+    }
 
-// Element-wise multiplication of two vectors
-Vector3D operator*(const Vector3D& v1, const Vector3D& v2) {
-    return Vector3D(v1.x * v2.x, v1.y * v2.y, v1.z * v2.z);
-}
+    // Scalar multiplication of a vector
+    friend Vector3T operator*(const Vector3T& v, T scalar) {
+        return Vector3T(v.x * scalar, v.y * scalar, v.z * scalar);
+    }
 
-// Scalar multiplication of a vector
-Vector3D operator*(const Vector3D& v, double scalar) {
-    return Vector3D(v.x * scalar, v.y * scalar, v.z * scalar);
-}
+    // Scalar multiplication of a vector but with the scalar on the left
+    friend Vector3T operator*(T scalar, const Vector3T& v) {
+        return Vector3T(v.x * scalar, v.y * scalar, v.z * scalar);
+    }
 
-// Scalar multiplication of a vector but with the scalar on the left
-Vector3D operator*(double scalar, const Vector3D& v) {
-    return Vector3D(v.x * scalar, v.y * scalar, v.z * scalar);
-}
+    // Scalar division of a vector
+    friend Vector3T operator/(const Vector3T& v, T scalar) {
+        return Vector3T(v.x / scalar, v.y / scalar, v.z / scalar);
+    }
 
-// Scalar division of a vector
-Vector3D operator/(const Vector3D& v, double scalar) {
-    return Vector3D(v.x / scalar, v.y / scalar, v.z / scalar);
-}
+    // Hadamard division of two vectors
+    friend Vector3T operator/(const Vector3T& v1, const Vector3T& v2) {
+        return Vector3T(v1.x / v2.x, v1.y / v2.y, v1.z / v2.z);
+    }
 
-// Hadamard division of two vectors
-Vector3D operator/(const Vector3D& v1, const Vector3D& v2) {
-    return Vector3D(v1.x / v2.x, v1.y / v2.y, v1.z / v2.z);
-}
+    // Get the length squared of a vector
+    friend T getLengthSquared(const Vector3T& v) {
+        return v.x * v.x + v.y * v.y + v.z * v.z;
+    }
+
+    // Get the length of a vector
+    friend T getLength(const Vector3T& v) {
+        return std::sqrt(getLengthSquared(v));
+    }
 
-// Get the length squared of a vector
-double getLengthSquared(const Vector3D& v) {
-    return v.x * v.x + v.y * v.y + v.z * v.z;
+    // Normalize a vector
+    friend Vector3T normalize(const Vector3T& v) {
+        return v / getLength(v);
+    }
+
+    // Allows us to print a vector
+    friend std::ostream& operator<<(std::ostream& os, const Vector3T& c) {
+        os << "Color(" << c.x << ", " << c.y << ", " << c.z << ")";
+        return os;
+    }
 };
 
+// Optional SIMD layout of Vector3T<real>, see vector_simd.h
+#include "vector_simd.h"
+
+// Vectors in the scalar type of the geometry
+typedef Vector3T<real> Vector3D;
+
 bool near_zero(const Vector3D& v) {
     // Return true if the vector is close to zero in all dimensions.
     const auto s = 1e-8;
@@ -142,16 +171,6 @@ Vector3D clampVector(const Vector3D& v) {
     return Vector3D(unit.clamp(v.x), unit.clamp(v.y), unit.clamp(v.z));
 }
 
-// Get the length of a vector
-double getLength(const Vector3D& v) {
-    return sqrt(getLengthSquared(v));
-};
-
-// Normalize a vector
-Vector3D normalize(const Vector3D& v) {
-    return v / getLength(v);
-};
-
 // Get a random vector in unit sphere
 Vector3D random_in_unit_sphere() {
     while (true) {
@@ -175,6 +194,32 @@ Vector3D random_in_hemisphere(const Vector3D& normal) {
         return -in_unit_sphere;
 }
 
+// Unit vectors t and b that complete the unit vector n to an orthonormal basis, without branches
+// on the direction of n (Duff et al., "Building an Orthonormal Basis, Revisited", 2017)
+void orthonormal_basis(const Vector3D& n, Vector3D& t, Vector3D& b) {
+    double sign = std::copysign(1.0, static_cast<double>(n.z));
+    double a = -1.0 / (sign + n.z);
+    double c = n.x * n.y * a;
+    t = Vector3D(1 + sign * n.x * n.x * a, sign * c, -sign * n.x);
+    b = Vector3D(c, sign + n.y * n.y * a, -n.y);
+}
+
+// Direction at polar angle theta (given by its sine and cosine) and azimuth phi around the unit vector axis
+Vector3D direction_around(const Vector3D& axis, double sin_theta, double cos_theta, double phi) {
+    Vector3D t, b;
+    orthonormal_basis(axis, t, b);
+    return (sin_theta * std::cos(phi)) * t + (sin_theta * std::sin(phi)) * b + cos_theta * axis;
+}
+
+// Random direction around the unit normal with density cos(theta) / pi; draws two numbers
+Vector3D random_cosine_direction(const Vector3D& normal) {
+    double u1 = random_double();
+    double u2 = random_double();
+    double sin_theta = std::sqrt(u1);
+    double cos_theta = std::sqrt(1 - u1);
+    return direction_around(normal, sin_theta, cos_theta, 2 * pi * u2);
+}
+
 Vector3D pixel_sample_disk(const Vector3D u, const Vector3D v) {
     // Returns random point in the pixel disk
     double theta = 2 * pi * random_double();  // Random angle
@@ -204,12 +249,6 @@ Vector3D refract(const Vector3D& uv, const Vector3D& n, double etai_over_etat) {
     return r_out_perp + r_out_parallel;
 }
 
-// Allows us to print a vector
-std::ostream& operator<<(std::ostream& os, const Vector3D& c) {
-    os << "Color(" << c.x << ", " << c.y << ", " << c.z << ")";
-    return os;
-}
-
 // Point3D is alias for Vector3D
 using Point3D = Vector3D;
 
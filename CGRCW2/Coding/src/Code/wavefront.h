@@ -0,0 +1,353 @@
+#ifndef WAVEFRONT_H
+#define WAVEFRONT_H
+
+#include "scene.h"
+#include "material.h"
+#include "render_mode.h"
+#include "roulette.h"
+#include "sampler.h"
+#include "stats.h"
+
+#include <algorithm>
+#include <vector>
+
+// Breadth-first path tracer.
+// Instead of following one sample to the end of its path before starting the next, a whole
+// batch of paths is advanced one bounce at a time through separate stages:
+//   intersect - closest hit for every live path, misses are finished right away
+//   shadow    - shadow rays of every hit are generated into one queue and tested together
+//   shade     - hits are grouped by material kind and scattered into the next wave
+// Every path carries its own random stream, so it draws exactly the numbers the recursive
+// RecursiveIntegrator::ray_color would draw for the same sample.
+// With a packet_size of 4 to 16, the first wave (the camera rays) is intersected in packets of that many rays.
+// In pbr mode the shadow stage tests one light sample per hit and light slot, and the intersect stage ends
+// the paths that run into a light, as RecursiveIntegrator::follow_pbr_path does.
+class WavefrontIntegrator {
+    public:
+        WavefrontIntegrator(const Scene& scene, const Color& background, RenderMode mode, int max_depth, int packet_size = 0, int roulette_depth = 0)
+            : scene(scene), background(background), mode(mode), max_depth(max_depth),
+              packet_size(std::min(packet_size, RayPacket::max_size)), roulette_depth(roulette_depth) {}
+
+        // Trace one path per primary ray. samplers[k] is the random stream of path k, positioned
+        // after the draws that generated rays[k]. colors[k] receives the color of path k
+        void trace(const std::vector<Ray>& rays, const std::vector<Sampler>& samplers, std::vector<Color>& colors) {
+            colors.assign(rays.size(), Color(0, 0, 0));
+            paths.clear();
+            for (size_t k = 0; k < rays.size(); ++k) {
+                paths.push(rays[k].getOrigin(), rays[k].getDirection(), Color(1, 1, 1), samplers[k], static_cast<int>(k));
+            }
+
+            for (int depth = max_depth; depth > 0 && paths.size() > 0; --depth) {
+                intersect(colors, depth);
+                next_paths.clear();
+                if (mode == RENDER_PHONG || mode == RENDER_PBR) {
+                    generate_shadow_rays();
+                    test_shadow_rays();
+                }
+                shade(colors, depth);
+                std::swap(paths, next_paths);
+            }
+
+            // Paths still alive ran out of bounces. In pbr mode their BSDF samples still look for a light,
+            // as in RecursiveIntegrator::follow_pbr_path
+            if (mode == RENDER_PBR) {
+                finish_pbr_paths(colors);
+                return;
+            }
+            for (int k = 0; k < paths.size(); ++k) {
+                colors[paths.slot[k]] = paths.throughput[k] * background;
+            }
+        }
+
+    private:
+        // Live paths in structure-of-arrays form
+        struct PathQueue {
+            std::vector<Point3D> origin;
+            std::vector<Vector3D> direction;
+            std::vector<Color> throughput;  // Product of the attenuations along the path so far
+            std::vector<Sampler> sampler;
+            std::vector<int> slot;          // Index of the path's entry in the output colors
+            std::vector<double> bsdf_pdf;   // Density of the ray's direction in pbr mode, see Scene::lightAlongRay
+
+            int size() const {return static_cast<int>(slot.size());}
+
+            void clear() {
+                origin.clear(); direction.clear(); throughput.clear(); sampler.clear(); slot.clear(); bsdf_pdf.clear();
+            }
+
+            void push(const Point3D& o, const Vector3D& d, const Color& t, const Sampler& s, int path_slot, double pdf = 0) {
+                origin.push_back(o); direction.push_back(d); throughput.push_back(t); sampler.push_back(s); slot.push_back(path_slot); bsdf_pdf.push_back(pdf);
+            }
+        };
+
+        const Scene& scene;
+        Color background;
+        RenderMode mode;
+        int max_depth;
+        int packet_size;
+        int roulette_depth;
+
+        PathQueue paths;
+        PathQueue next_paths;
+
+        // Paths of the current wave that hit something, and their hit records
+        std::vector<int> hit_paths;
+        std::vector<Hit_record> hits;
+
+        // Shadow queue. The lights shaded at hit h are shadow_light[h * slots ...] with the weights in
+        // shadow_weight, and the shadow rays of each start at shadow_first[h * slots ...].
+        // In pbr mode every slot has one shadow ray carrying shadow_contribution, or none and -1 in shadow_first
+        std::vector<int> shadow_first;
+        std::vector<int> shadow_light;
+        std::vector<double> shadow_weight;
+        std::vector<Point3D> shadow_origin;
+        std::vector<Vector3D> shadow_direction;
+        std::vector<real> shadow_distance;
+        std::vector<char> shadowed;
+        std::vector<Color> shadow_contribution;
+
+        // Hits ordered by material kind for the shading stage
+        std::vector<int> shade_order;
+
+        void intersect(std::vector<Color>& colors, int depth) {
+            RT_STATS_TIMER(STAGE_INTERSECT);
+            RT_STATS_DEPTH(max_depth - depth, paths.size());
+            hit_paths.clear();
+            hits.resize(paths.size());
+            if (packet_size > 1 && depth == max_depth) {
+                intersect_packets(colors);
+                return;
+            }
+            for (int k = 0; k < paths.size(); ++k) {
+                Ray r(paths.origin[k], paths.direction[k]);
+                Hit_record& rec = hits[hit_paths.size()];
+                finish_ray(colors, k, r, scene.hit(r, Interval(ray_epsilon(r.getOrigin()), infinity), rec), rec);
+            }
+        }
+
+        // Queue path k for shading if its ray r found the hit rec, otherwise it ends with the background.
+        // In pbr mode a light in front of the hit ends it too. rec must be hits[hit_paths.size()]
+        void finish_ray(std::vector<Color>& colors, int k, const Ray& r, bool found, const Hit_record& rec) {
+            if (mode == RENDER_PBR) {
+                Color emitted;
+                if (scene.lightAlongRay(r, found ? rec.t : infinity, paths.bsdf_pdf[k], emitted)) {
+                    colors[paths.slot[k]] += paths.throughput[k] * emitted;
+                    return;
+                }
+            }
+            if (found) {
+                hit_paths.push_back(k);
+            } else {
+                colors[paths.slot[k]] += paths.throughput[k] * background;
+            }
+        }
+
+        // intersect() for camera rays, packet_size paths at a time
+        void intersect_packets(std::vector<Color>& colors) {
+            Ray rays[RayPacket::max_size];
+            Interval ray_t[RayPacket::max_size];
+            Hit_record records[RayPacket::max_size];
+            bool found[RayPacket::max_size];
+            for (int first = 0; first < paths.size(); first += packet_size) {
+                int count = std::min(paths.size() - first, packet_size);
+                for (int k = 0; k < count; ++k) {
+                    rays[k] = Ray(paths.origin[first + k], paths.direction[first + k]);
+                    ray_t[k] = Interval(ray_epsilon(rays[k].getOrigin()), infinity);
+                }
+                scene.hit_packet(rays, ray_t, count, records, found);
+                for (int k = 0; k < count; ++k) {
+                    Hit_record& rec = hits[hit_paths.size()];
+                    if (found[k]) rec = records[k];
+                    finish_ray(colors, first + k, rays[k], found[k], rec);
+                }
+            }
+        }
+
+        void generate_shadow_rays() {
+            RT_STATS_TIMER(STAGE_SHADOW_RAYS);
+            int slots = scene.getShadowLightCount();
+
+            // The number of rays depends on the lights picked, so the ray arrays grow as they are filled
+            shadow_first.resize(hit_paths.size() * slots);
+            shadow_light.resize(hit_paths.size() * slots);
+            shadow_weight.resize(hit_paths.size() * slots);
+            shadow_origin.clear();
+            shadow_direction.clear();
+            shadow_distance.clear();
+            if (mode == RENDER_PBR) {
+                generate_light_samples(slots);
+                return;
+            }
+
+            for (size_t h = 0; h < hit_paths.size(); ++h) {
+                int k = hit_paths[h];
+                thread_sampler() = paths.sampler[k];
+                for (int slot = 0; slot < slots; ++slot) {
+                    int light = scene.selectLight(hits[h].p, slot, shadow_weight[h * slots + slot]);
+                    shadow_light[h * slots + slot] = light;
+                    shadow_first[h * slots + slot] = static_cast<int>(shadow_origin.size());
+                    Scene::ShadowSamples samples = scene.shadowSamples(light);
+                    for (int i = 0; i < samples.count; ++i) {
+                        real distance;
+                        Ray shadow_ray = scene.sampleShadowRay(hits[h].p, light, samples, i, distance);
+                        shadow_origin.push_back(shadow_ray.getOrigin());
+                        shadow_direction.push_back(shadow_ray.getDirection());
+                        shadow_distance.push_back(distance);
+                    }
+                }
+                paths.sampler[k] = thread_sampler();
+            }
+        }
+
+        // generate_shadow_rays() for pbr mode, in the order of RecursiveIntegrator::follow_pbr_path's draws
+        void generate_light_samples(int slots) {
+            shadow_contribution.clear();
+            for (size_t h = 0; h < hit_paths.size(); ++h) {
+                int k = hit_paths[h];
+                thread_sampler() = paths.sampler[k];
+                Vector3D wo = -normalize(paths.direction[k]);
+                for (int slot = 0; slot < slots; ++slot) {
+                    Scene::DirectLightSample sample;
+                    if (!scene.sampleDirectLight(hits[h], wo, slot, sample)) {
+                        shadow_first[h * slots + slot] = -1;
+                        continue;
+                    }
+                    shadow_first[h * slots + slot] = static_cast<int>(shadow_origin.size());
+                    shadow_origin.push_back(sample.shadow_ray.getOrigin());
+                    shadow_direction.push_back(sample.shadow_ray.getDirection());
+                    shadow_distance.push_back(sample.distance);
+                    shadow_contribution.push_back(sample.contribution);
+                }
+                paths.sampler[k] = thread_sampler();
+            }
+        }
+
+        void test_shadow_rays() {
+            RT_STATS_TIMER(STAGE_SHADOW_RAYS);
+            shadowed.resize(shadow_origin.size());
+            for (size_t s = 0; s < shadow_origin.size(); ++s) {
+                shadowed[s] = scene.occluded(Ray(shadow_origin[s], shadow_direction[s]), Interval(ray_epsilon(shadow_origin[s]), shadow_distance[s]));
+                Scene::countShadowRay(shadowed[s]);
+            }
+        }
+
+        // Counting sort of the hits by material kind, so each kind's scatter code runs back to back
+        void sort_by_material() {
+            int counts[MATERIAL_KIND_COUNT + 1] = {0};
+            for (size_t h = 0; h < hit_paths.size(); ++h) {
+                counts[scene.getMaterial(hits[h].material).getKind() + 1]++;
+            }
+            for (int kind = 0; kind < MATERIAL_KIND_COUNT; ++kind) {
+                counts[kind + 1] += counts[kind];
+            }
+            shade_order.resize(hit_paths.size());
+            for (size_t h = 0; h < hit_paths.size(); ++h) {
+                shade_order[counts[scene.getMaterial(hits[h].material).getKind()]++] = static_cast<int>(h);
+            }
+        }
+
+        // Scatter the paths that hit something at depth bounces left into next_paths. Paths that will be
+        // intersected again go through Russian roulette first, drawing from their stream right after
+        // the scatter, where RecursiveIntegrator::follow_path draws
+        void shade(std::vector<Color>& colors, int depth) {
+            if (mode == RENDER_BINARY || mode == RENDER_NORMAL) {
+                // The first hit decides the color, no path continues
+                for (size_t h = 0; h < hit_paths.size(); ++h) {
+                    int k = hit_paths[h];
+                    Color color = mode == RENDER_BINARY ? Color(1, 0, 0) : 0.5 * (hits[h].normal + Color(1,1,1));
+                    colors[paths.slot[k]] = paths.throughput[k] * color;
+                }
+                return;
+            }
+
+            if (mode == RENDER_DIFFUSE) {
+                double diffuseFactor = 0.5;
+                for (size_t h = 0; h < hit_paths.size(); ++h) {
+                    int k = hit_paths[h];
+                    thread_sampler() = paths.sampler[k];
+                    Vector3D direction = random_in_hemisphere(hits[h].normal);
+                    continue_path(k, hits[h].p, direction, paths.throughput[k] * diffuseFactor, depth);
+                }
+                return;
+            }
+
+            sort_by_material();
+            int slots = scene.getShadowLightCount();
+            if (mode == RENDER_PBR) {
+                shade_pbr(colors, depth, slots);
+                return;
+            }
+            for (int h : shade_order) {
+                int k = hit_paths[h];
+                const Hit_record& rec = hits[h];
+                Ray r(paths.origin[k], paths.direction[k]);
+
+                Color light_contribution(0, 0, 0);
+                for (int slot = 0; slot < slots; ++slot) {
+                    RT_STATS_TIMER(STAGE_SHADE);
+                    const char* light_shadowed = shadowed.data() + shadow_first[h * slots + slot];
+                    light_contribution += scene.sampledLightContribution(r, rec, shadow_light[h * slots + slot], shadow_weight[h * slots + slot], light_shadowed);
+                }
+
+                thread_sampler() = paths.sampler[k];
+                Ray scattered;
+                Color attenuation;
+                bool scatters;
+                {
+                    RT_STATS_TIMER(STAGE_SCATTER);
+                    scatters = scene.getMaterial(rec.material).scatter(r, rec.normal, rec.p, rec.front_face, attenuation, scattered, light_contribution);
+                }
+                if (scatters) {
+                    continue_path(k, scattered.getOrigin(), scattered.getDirection(), paths.throughput[k] * attenuation, depth);
+                } else {
+                    colors[paths.slot[k]] = paths.throughput[k] * Color(0, 1, 0);
+                }
+            }
+        }
+
+        // shade() for pbr mode: add the unblocked light samples, then continue with a BSDF sample
+        void shade_pbr(std::vector<Color>& colors, int depth, int slots) {
+            for (int h : shade_order) {
+                int k = hit_paths[h];
+                const Hit_record& rec = hits[h];
+                for (int slot = 0; slot < slots; ++slot) {
+                    int s = shadow_first[h * slots + slot];
+                    if (s >= 0 && !shadowed[s]) {
+                        colors[paths.slot[k]] += paths.throughput[k] * shadow_contribution[s];
+                    }
+                }
+
+                thread_sampler() = paths.sampler[k];
+                Vector3D wo = -normalize(paths.direction[k]);
+                BSDFSample sample;
+                bool sampled;
+                {
+                    RT_STATS_TIMER(STAGE_SCATTER);
+                    sampled = scene.getMaterial(rec.material).sample(wo, rec.normal, rec.front_face, sample);
+                }
+                if (sampled) {
+                    continue_path(k, rec.p, sample.wi, paths.throughput[k] * sample.weight, depth, sample.pdf);
+                }
+            }
+        }
+
+        // Queue path k for the next wave with its new ray and throughput, unless roulette ends it and
+        // leaves its color at zero. The stream position is taken from thread_sampler()
+        void continue_path(int k, const Point3D& origin, const Vector3D& direction, Color throughput, int depth, double bsdf_pdf = 0) {
+            if (depth > 1 && !survives_roulette(throughput, max_depth - depth + 1, roulette_depth)) {
+                return;
+            }
+            next_paths.push(origin, direction, throughput, thread_sampler(), paths.slot[k], bsdf_pdf);
+        }
+
+        // pbr paths out of bounces gain the light their BSDF samples reach, see Scene::lightBeyondPath
+        void finish_pbr_paths(std::vector<Color>& colors) const {
+            RT_STATS_TIMER(STAGE_SHADOW_RAYS);
+            for (int k = 0; k < paths.size(); ++k) {
+                Ray r(paths.origin[k], paths.direction[k]);
+                colors[paths.slot[k]] += paths.throughput[k] * scene.lightBeyondPath(r, paths.bsdf_pdf[k]);
+            }
+        }
+};
+
+#endif // WAVEFRONT_H
@@ -0,0 +1,180 @@
+#include "scene.h"
+
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include <limits>
+
+// Scene with a mix of every shape type scattered in a 20x20x20 box
+Scene makeRandomScene(int count) {
+    Scene scene;
+    auto material = std::make_shared<Lambertian>(Color(0.5, 0.5, 0.5));
+    for (int i = 0; i < count; ++i) {
+        Point3D p = Vector3D::random(-10, 10);
+        if (i % 3 == 0) {
+            scene.add(std::make_shared<Sphere>(p, random_double(0.1, 1.0), material));
+        } else if (i % 3 == 1) {
+            scene.add(std::make_shared<Triangle>(p, p + Vector3D::random(-1, 1), p + Vector3D::random(-1, 1), material));
+        } else {
+            scene.add(std::make_shared<Cylinder>(p, Vector3D::random(-1, 1), random_double(0.1, 0.5), random_double(0.1, 1.0), material));
+        }
+    }
+    return scene;
+}
+
+void testBoundingBoxesContainHits() {
+    Scene scene = makeRandomScene(300);
+    for (const auto& shape : scene.getShapes()) {
+        AABB box = shape->bounding_box();
+        for (int i = 0; i < 200; ++i) {
+            Ray ray(Vector3D::random(-12, 12), Vector3D::random(-1, 1));
+            Hit_record record;
+            if (shape->hit(ray, Interval(0.001, infinity), record)) {
+                assert(box.x.expand(1e-6).contains(record.p.x));
+                assert(box.y.expand(1e-6).contains(record.p.y));
+                assert(box.z.expand(1e-6).contains(record.p.z));
+            }
+        }
+    }
+}
+
+void testBVHMatchesLinearScan() {
+    Scene linear = makeRandomScene(1000);
+    Scene accelerated = linear;
+    accelerated.build_bvh();
+    assert(accelerated.has_bvh());
+    assert(!linear.has_bvh());
+
+    int hits = 0;
+    for (int i = 0; i < 20000; ++i) {
+        Ray ray(Vector3D::random(-15, 15), Vector3D::random(-1, 1));
+        Hit_record expected, actual;
+        bool expected_hit = linear.hit(ray, Interval(0.001, infinity), expected);
+        bool actual_hit = accelerated.hit(ray, Interval(0.001, infinity), actual);
+        assert(expected_hit == actual_hit);
+        if (expected_hit) {
+            assert(expected.t == actual.t);
+            assert(expected.p == actual.p);
+            ++hits;
+        }
+    }
+    assert(hits > 0);
+}
+
+void testOccludedMatchesHit() {
+    Scene linear = makeRandomScene(1000);
+    Scene accelerated = linear;
+    accelerated.build_bvh();
+
+    int blocked = 0;
+    for (int i = 0; i < 20000; ++i) {
+        Ray ray(Vector3D::random(-15, 15), normalize(Vector3D::random(-1, 1)));
+        Interval ray_t(0.001, random_double(1, 20));
+        Hit_record record;
+        bool expected = linear.hit(ray, ray_t, record);
+        assert(linear.occluded(ray, ray_t) == expected);
+        assert(accelerated.occluded(ray, ray_t) == expected);
+        blocked += expected;
+    }
+    assert(blocked > 0);
+}
+
+// The scene traces its per-kind primitive arrays, reordered to the BVH leaves; the closest hit must match
+// the one found by asking every shape through the Shape interface
+void testPrimitiveArraysMatchShapes() {
+    Scene scene = makeRandomScene(300);
+    scene.build_bvh();
+    std::vector<int> counts = scene.getPrimitiveCounts();
+    assert(counts[PRIMITIVE_SPHERE] == 100 && counts[PRIMITIVE_TRIANGLE] == 100 && counts[PRIMITIVE_CYLINDER] == 100);
+    assert(counts[PRIMITIVE_MESH] == 0 && counts[PRIMITIVE_SHAPE] == 0);
+
+    int hits = 0;
+    for (int i = 0; i < 5000; ++i) {
+        Ray ray(Vector3D::random(-15, 15), Vector3D::random(-1, 1));
+        Hit_record expected, actual;
+        bool expected_hit = false;
+        Interval ray_t(0.001, infinity);
+        for (const auto& shape : scene.getShapes()) {
+            if (shape->hit(ray, ray_t, expected)) {
+                ray_t.max = expected.t;
+                expected_hit = true;
+            }
+        }
+        assert(scene.hit(ray, Interval(0.001, infinity), actual) == expected_hit);
+        if (expected_hit) {
+            // Both run the same record code, but inlined into different callers; with -march=native GCC
+            // may contract different products into FMAs there, so t can differ in the last bits
+            assert(std::fabs(expected.t - actual.t) <= 64 * std::numeric_limits<real>::epsilon() * expected.t);
+            assert(expected.material == actual.material);
+            ++hits;
+        }
+    }
+    assert(hits > 0);
+}
+
+// Packets of neighbouring rays (one frustum) and of random rays (mostly sign divergent, traced one by one)
+// must find the same closest hits as tracing every ray alone
+void testPacketsMatchSingleRays() {
+    Scene scene = makeRandomScene(1000);
+    scene.build_bvh();
+
+    int hits = 0, coherent = 0;
+    for (int i = 0; i < 4000; ++i) {
+        int count = 1 + i % RayPacket::max_size;
+        Ray rays[RayPacket::max_size];
+        Interval ray_t[RayPacket::max_size];
+        Point3D origin = Vector3D::random(-15, 15);
+        Vector3D direction = Vector3D::random(-1, 1);
+        for (int k = 0; k < count; ++k) {
+            if (i % 2 == 0) {
+                rays[k] = Ray(origin + Vector3D::random(-0.1, 0.1), direction + Vector3D::random(-0.01, 0.01));
+            } else {
+                rays[k] = Ray(Vector3D::random(-15, 15), Vector3D::random(-1, 1));
+            }
+            ray_t[k] = Interval(0.001, random_double(5, 40));
+        }
+        RayPacket packet;
+        coherent += count > 1 && packet.set(rays, ray_t, count);
+
+        Hit_record records[RayPacket::max_size];
+        bool found[RayPacket::max_size];
+        scene.hit_packet(rays, ray_t, count, records, found);
+        for (int k = 0; k < count; ++k) {
+            Hit_record expected;
+            assert(scene.hit(rays[k], ray_t[k], expected) == found[k]);
+            if (found[k]) {
+                assert(expected.t == records[k].t);
+                assert(expected.p == records[k].p);
+                assert(expected.material == records[k].material);
+                ++hits;
+            }
+        }
+    }
+    assert(hits > 0);
+    assert(coherent > 1000);
+}
+
+void testEmptyScene() {
+    Scene scene;
+    scene.build_bvh();
+    Hit_record record;
+    assert(!scene.hit(Ray(Point3D(0, 0, 0), Vector3D(0, 0, -1)), Interval(0.001, infinity), record));
+}
+
+int main() {
+    std::cout << "Running BVH tests...\n";
+    seed_random(1);
+    testBoundingBoxesContainHits();
+    std::cout << "Bounding box test passed!\n";
+    testBVHMatchesLinearScan();
+    std::cout << "BVH vs. linear scan test passed!\n";
+    testOccludedMatchesHit();
+    std::cout << "Occlusion query test passed!\n";
+    testPrimitiveArraysMatchShapes();
+    std::cout << "Primitive arrays test passed!\n";
+    testPacketsMatchSingleRays();
+    std::cout << "Ray packet test passed!\n";
+    testEmptyScene();
+    std::cout << "Empty scene test passed!\n";
+    return 0;
+}
@@ -0,0 +1,102 @@
+#include "test_scenes.h"
+
+#include <cassert>
+#include <cstdio>
+#include <iostream>
+
+Camera makeCamera(int samples_per_pixel, int pass_samples, const std::string& checkpoint_file, bool resume) {
+    Camera camera = makeTestCamera(samples_per_pixel);
+    camera.pass_samples = pass_samples;
+    camera.checkpoint_file = checkpoint_file;
+    camera.resume = resume;
+    camera.scene_key = 42;
+    return camera;
+}
+
+void testRoundTrip() {
+    const std::string filename = "checkpoint_test_roundtrip.bin";
+    Accumulator saved(3, 2);
+    saved.at(1, 0).sum = Vector3T<double>(0.25, 1.5, 3.0);
+    saved.at(1, 0).mean = 0.7;
+    saved.at(1, 0).m2 = 0.01;
+    saved.at(1, 0).count = 9;
+    assert(saved.save(filename, 7, 42));
+
+    Accumulator loaded(3, 2);
+    assert(loaded.load(filename, 7, 42));
+    assert(loaded.at(1, 0).sum == Vector3T<double>(0.25, 1.5, 3.0));
+    assert(loaded.at(1, 0).mean == 0.7 && loaded.at(1, 0).m2 == 0.01 && loaded.at(1, 0).count == 9);
+    assert(loaded.at(0, 1).count == 0);
+    assert(loaded.totalSamples() == 9 && loaded.minSamples() == 0);
+
+    // A checkpoint of another seed, scene or image size is not taken
+    Accumulator other(3, 2);
+    assert(!other.load(filename, 8, 42));
+    assert(!other.load(filename, 7, 43));
+    Accumulator wrong_size(2, 3);
+    assert(!wrong_size.load(filename, 7, 42));
+    assert(other.at(1, 0).count == 0);
+    std::remove(filename.c_str());
+}
+
+// Passes continue every pixel's sample sequence, so the split into passes does not change the image
+void testPassesMatchSingleRender() {
+    Scene scene = makeTestScene();
+    Color background(0.2, 0.3, 0.5);
+    Framebuffer single = makeCamera(10, 0, "", false).render(scene, background, RENDER_PHONG);
+    Framebuffer passes = makeCamera(10, 3, "", false).render(scene, background, RENDER_PHONG);
+    assertSameImage(single, passes);
+}
+
+// Resuming from a checkpoint of the first samples adds up to the uninterrupted render
+void testResume() {
+    const std::string filename = "checkpoint_test_resume.bin";
+    Scene scene = makeTestScene();
+    Color background(0.2, 0.3, 0.5);
+    Framebuffer single = makeCamera(10, 0, "", false).render(scene, background, RENDER_PHONG);
+
+    std::remove(filename.c_str());
+    Framebuffer first = makeCamera(4, 2, filename, false).render(scene, background, RENDER_PHONG);
+    assert(first.getSampleCounts()[0] == 4);
+    Framebuffer resumed = makeCamera(10, 2, filename, true).render(scene, background, RENDER_PHONG);
+    assertSameImage(single, resumed);
+    std::remove(filename.c_str());
+}
+
+// A checkpoint taken with other estimator settings is not resumed: the render starts over and gives
+// the image of the new settings alone
+void testResumeWithOtherSettings() {
+    const std::string filename = "checkpoint_test_settings.bin";
+    Color background(0.2, 0.3, 0.5);
+    for (int change = 0; change < 5; ++change) {
+        Scene scene = makeTestScene();
+        std::remove(filename.c_str());
+        makeCamera(4, 2, filename, false).render(scene, background, RENDER_PHONG);
+
+        Camera fresh = makeCamera(10, 2, "", false);
+        Camera resumed = makeCamera(10, 2, filename, true);
+        RenderMode mode = RENDER_PHONG;
+        switch (change) {
+            case 0: scene.set_shadow_rays(3); break;
+            case 1: scene.set_light_sampling(LIGHT_SAMPLING_TREE, 1); break;
+            case 2: scene.set_mis_heuristic(MIS_BALANCE); mode = RENDER_PBR; break;
+            case 3: fresh.roulette_depth = resumed.roulette_depth = 1; break;
+            default: fresh.max_depth = resumed.max_depth = 2; break;
+        }
+        assertSameImage(fresh.render(scene, background, mode), resumed.render(scene, background, mode));
+    }
+    std::remove(filename.c_str());
+}
+
+int main() {
+    std::cout << "Running checkpoint tests...\n";
+    testRoundTrip();
+    std::cout << "Checkpoint round trip test passed!\n";
+    testPassesMatchSingleRender();
+    std::cout << "Progressive passes test passed!\n";
+    testResume();
+    std::cout << "Resume test passed!\n";
+    testResumeWithOtherSettings();
+    std::cout << "Resume with other settings test passed!\n";
+    return 0;
+}
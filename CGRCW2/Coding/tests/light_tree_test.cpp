@@ -0,0 +1,114 @@
+#include "scene.h"
+#include "light_tree.h"
+
+#include <cassert>
+#include <cmath>
+#include <iostream>
+
+void makeLights(std::vector<Point3D>& positions, std::vector<double>& powers, int count) {
+    seed_random(3);
+    for (int i = 0; i < count; ++i) {
+        positions.push_back(Point3D(random_double(-10, 10), random_double(0, 5), random_double(-10, 10)));
+        powers.push_back(i % 7 == 0 ? 0.0 : random_double(0.1, 2));
+    }
+}
+
+// The pick probabilities form a distribution, and sample() reports the same probability as pdf()
+void testDistribution() {
+    std::vector<Point3D> positions;
+    std::vector<double> powers;
+    makeLights(positions, powers, 37);
+    LightTree tree;
+    tree.build(positions, powers);
+
+    Point3D p(1, 0.5, -2);
+    double sum = 0;
+    for (int i = 0; i < 37; ++i) {
+        double pdf = tree.pdf(p, i);
+        assert(powers[i] > 0 ? pdf > 0 : pdf == 0);
+        sum += pdf;
+    }
+    assert(std::fabs(sum - 1) < 1e-12);
+
+    for (int k = 0; k < 1000; ++k) {
+        double pdf;
+        int light = tree.sample(p, random_double(), pdf);
+        assert(light >= 0 && light < 37);
+        assert(std::fabs(pdf - tree.pdf(p, light)) < 1e-12);
+    }
+}
+
+// Dividing by the pick probability estimates the sum over all lights without bias
+void testUnbiased() {
+    std::vector<Point3D> positions;
+    std::vector<double> powers;
+    makeLights(positions, powers, 200);
+    LightTree tree;
+    tree.build(positions, powers);
+
+    Point3D p(-3, 1, 4);
+    double exact = 0;
+    for (size_t i = 0; i < positions.size(); ++i) {
+        exact += powers[i] / getLengthSquared(positions[i] - p);
+    }
+    const int samples = 200000;
+    double estimate = 0;
+    for (int k = 0; k < samples; ++k) {
+        double pdf;
+        int light = tree.sample(p, random_double(), pdf);
+        estimate += powers[light] / getLengthSquared(positions[light] - p) / pdf;
+    }
+    estimate /= samples;
+    assert(std::fabs(estimate - exact) < 0.01 * exact);
+}
+
+// Without any power there is nothing to pick
+void testNoPower() {
+    LightTree tree;
+    std::vector<Point3D> positions = {Point3D(0, 1, 0), Point3D(2, 1, 0)};
+    std::vector<double> powers = {0, 0};
+    tree.build(positions, powers);
+    double pdf;
+    assert(tree.sample(Point3D(0, 0, 0), 0.5, pdf) == -1 && pdf == 0);
+
+    LightTree empty;
+    assert(empty.empty() && empty.sample(Point3D(0, 0, 0), 0.5, pdf) == -1);
+}
+
+// The scene builds its light tree once, in build_bvh() or set_light_sampling(), over every light added
+// before, in either order; the selection densities then add up to the lights picked per hit point
+void testSceneBuildsTreeOnce() {
+    std::vector<Point3D> positions;
+    std::vector<double> powers;
+    makeLights(positions, powers, 37);
+    for (int order = 0; order < 2; ++order) {
+        Scene scene;
+        if (order == 0) scene.set_light_sampling(LIGHT_SAMPLING_TREE, 2);
+        for (size_t i = 0; i < positions.size(); ++i) {
+            scene.add(std::make_shared<PointLight>(positions[i], Color(powers[i], powers[i], powers[i])));
+        }
+        if (order == 0) {
+            scene.build_bvh();
+        } else {
+            scene.set_light_sampling(LIGHT_SAMPLING_TREE, 2);
+        }
+        double total = 0;
+        for (int i = 0; i < scene.getLightCount(); ++i) {
+            total += scene.lightSelectionDensity(Point3D(1, 0, 2), i);
+        }
+        assert(std::fabs(total - 2) < 1e-9);
+    }
+}
+
+int main() {
+    std::cout << "Running light tree tests...\n";
+    testDistribution();
+    std::cout << "Light tree distribution test passed!\n";
+    testUnbiased();
+    std::cout << "Light tree unbiased estimate test passed!\n";
+    testNoPower();
+    std::cout << "Light tree no power test passed!\n";
+    testSceneBuildsTreeOnce();
+    std::cout << "Scene light tree test passed!\n";
+    return 0;
+}
@@ -0,0 +1,157 @@
+#include "scene_reader.h"
+
+#include <cassert>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+void writeFile(const std::string& filename, const std::string& contents) {
+    std::ofstream file(filename, std::ios::binary);
+    file.write(contents.data(), contents.size());
+}
+
+template <typename T>
+void appendBinary(std::string& out, T value, bool big_endian) {
+    char bytes[sizeof(T)];
+    std::memcpy(bytes, &value, sizeof(T));
+    if (big_endian) std::reverse(bytes, bytes + sizeof(T));  // The tests run on little-endian hosts
+    out.append(bytes, sizeof(T));
+}
+
+// A unit square as one quad plus a triangle above it, in every OBJ face index form
+void testLoadOBJ() {
+    writeFile("mesh_test.obj",
+        "# comment\n"
+        "v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\n"
+        "vt 0 0\nvn 0 0 1\n"
+        "f 1/1/1 2/1/1 3//1 4\n"
+        "v 0.5 0.5 1\n"
+        "f -5 -4 -1\n");
+    MeshData mesh = loadOBJ("mesh_test.obj");
+    assert(mesh.vertices.size() == 15);
+    std::vector<std::uint32_t> expected = {0, 1, 2, 0, 2, 3, 0, 1, 4};
+    assert(mesh.indices == expected);
+    std::remove("mesh_test.obj");
+
+    writeFile("mesh_test.obj", "v 0 0 0\nv 1 0 0\nf 1 2 3\n");
+    bool threw = false;
+    try {
+        loadOBJ("mesh_test.obj");
+    } catch (std::runtime_error& e) {
+        threw = true;
+    }
+    assert(threw);
+    std::remove("mesh_test.obj");
+}
+
+// The same square and triangle as binary PLY, with an extra vertex property and face list to skip
+void testLoadPLY(bool big_endian) {
+    std::string ply = std::string("ply\nformat ") + (big_endian ? "binary_big_endian" : "binary_little_endian") + " 1.0\n"
+        "element vertex 5\nproperty float x\nproperty float y\nproperty float z\nproperty uchar red\n"
+        "element face 2\nproperty list uchar int vertex_indices\nproperty list uchar float texcoord\n"
+        "end_header\n";
+    float positions[5][3] = {{0, 0, 0}, {1, 0, 0}, {1, 1, 0}, {0, 1, 0}, {0.5f, 0.5f, 1}};
+    for (auto& p : positions) {
+        for (float value : p) appendBinary(ply, value, big_endian);
+        appendBinary<unsigned char>(ply, 255, big_endian);
+    }
+    int faces[2][4] = {{0, 1, 2, 3}, {0, 1, 4, -1}};
+    for (int f = 0; f < 2; ++f) {
+        unsigned char count = f == 0 ? 4 : 3;
+        appendBinary(ply, count, big_endian);
+        for (int i = 0; i < count; ++i) appendBinary(ply, faces[f][i], big_endian);
+        appendBinary<unsigned char>(ply, 2, big_endian);
+        appendBinary(ply, 0.25f, big_endian);
+        appendBinary(ply, 0.75f, big_endian);
+    }
+    writeFile("mesh_test.ply", ply);
+
+    MeshData mesh = loadPLY("mesh_test.ply");
+    assert(mesh.vertices.size() == 15);
+    assert(mesh.vertices[12] == 0.5f && mesh.vertices[14] == 1.0f);
+    std::vector<std::uint32_t> expected = {0, 1, 2, 0, 2, 3, 0, 1, 4};
+    assert(mesh.indices == expected);
+    std::remove("mesh_test.ply");
+}
+
+// A bumpy height field, as one mesh and as separate triangles
+void makeGrid(int n, MeshData& mesh, Scene& triangles, std::shared_ptr<Material> material) {
+    for (int i = 0; i <= n; ++i) {
+        for (int j = 0; j <= n; ++j) {
+            mesh.vertices.push_back(i * 0.25f);
+            mesh.vertices.push_back(((i * 7 + j * 3) % 5) * 0.125f);   // Exact in float, so both versions see the same vertices
+            mesh.vertices.push_back(j * 0.25f);
+        }
+    }
+    for (int i = 0; i < n; ++i) {
+        for (int j = 0; j < n; ++j) {
+            std::uint32_t a = i * (n + 1) + j, b = (i + 1) * (n + 1) + j;
+            std::uint32_t quad[6] = {a, a + 1, b + 1, a, b + 1, b};
+            mesh.indices.insert(mesh.indices.end(), quad, quad + 6);
+        }
+    }
+    for (size_t t = 0; t < mesh.indices.size(); t += 3) {
+        Point3D v[3];
+        for (int k = 0; k < 3; ++k) {
+            const float* p = &mesh.vertices[3 * mesh.indices[t + k]];
+            v[k] = Point3D(p[0], p[1], p[2]);
+        }
+        triangles.add(std::make_shared<Triangle>(v[0], v[1], v[2], material));
+    }
+}
+
+void testMeshMatchesTriangles() {
+    auto material = std::make_shared<Lambertian>(Color(0.5, 0.5, 0.5));
+    MeshData data;
+    Scene triangles;
+    makeGrid(40, data, triangles, material);
+    triangles.build_bvh();
+    TriangleMesh mesh(data.vertices, data.indices, material);
+    assert(mesh.triangleCount() == 2 * 40 * 40);
+
+    int hits = 0;
+    for (int i = 0; i < 20000; ++i) {
+        Ray ray(Point3D(random_double(-1, 11), random_double(1, 3), random_double(-1, 11)), Vector3D::random(-1, 1));
+        Hit_record expected{}, actual{};  // Value-initialized, the compiler cannot tell that t is only read after a hit
+        bool expected_hit = triangles.hit(ray, Interval(0.001, infinity), expected);
+        bool actual_hit = mesh.hit(ray, Interval(0.001, infinity), actual);
+        assert(expected_hit == actual_hit);
+        assert(mesh.occluded(ray, Interval(0.001, infinity)) == actual_hit);
+        if (actual_hit) {
+            assert(fabs(expected.t - actual.t) < 1e-4);
+            assert(getLength(expected.p - actual.p) < 1e-4);
+            assert(dotProduct(actual.normal, ray.getDirection()) <= 0);
+            ++hits;
+        }
+    }
+    assert(hits > 1000);
+}
+
+void testSceneMeshEntry() {
+    writeFile("mesh_test.obj", "v 0 0 -2\nv 1 0 -2\nv 0 1 -2\nf 1 2 3\n");
+    nlohmann::json scene_json = {
+        {"scene", {{"shapes", {{{"type", "mesh"}, {"file", "mesh_test.obj"}}}}}}
+    };
+    SceneReader reader(scene_json);
+    Scene scene = reader.buildScene();
+    assert(scene.getShapes().size() == 1);
+    Hit_record record;
+    assert(scene.hit(Ray(Point3D(0.2, 0.2, 0), Vector3D(0, 0, -1)), Interval(0.001, infinity), record));
+    assert(fabs(record.t - 2) < 1e-6);
+    std::remove("mesh_test.obj");
+}
+
+int main() {
+    std::cout << "Running mesh tests...\n";
+    seed_random(3);
+    testLoadOBJ();
+    std::cout << "OBJ loader test passed!\n";
+    testLoadPLY(false);
+    testLoadPLY(true);
+    std::cout << "PLY loader test passed!\n";
+    testMeshMatchesTriangles();
+    std::cout << "Mesh vs. triangles test passed!\n";
+    testSceneMeshEntry();
+    std::cout << "Scene mesh entry test passed!\n";
+    return 0;
+}
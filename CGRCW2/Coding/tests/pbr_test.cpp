@@ -0,0 +1,155 @@
+#include "integrator.h"
+#include "wavefront.h"
+
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+bool near(double a, double b, double tolerance) {
+    return std::fabs(a - b) <= tolerance * std::fabs(b);
+}
+
+bool near(const Color& a, const Color& b, double tolerance) {
+    return near(a.x, b.x, tolerance) && near(a.y, b.y, tolerance) && near(a.z, b.z, tolerance);
+}
+
+// Sampling a material and integrating its eval over uniform directions estimate the same reflected
+// fraction of light, and pdf integrates to the share of the non-delta lobes
+void testSamplingMatchesEval(const Material& material, double delta_share) {
+    seed_random(11);
+    Vector3D normal(0, 1, 0);
+    Vector3D wo = normalize(Vector3D(0.4, 0.8, 0.2));
+    const int count = 400000;
+
+    Color sampled(0, 0, 0);
+    int delta = 0;
+    for (int i = 0; i < count; ++i) {
+        BSDFSample sample;
+        if (!material.sample(wo, normal, true, sample)) continue;
+        if (sample.pdf == 0) {
+            ++delta;
+        } else {
+            assert(dotProduct(sample.wi, normal) > 0);
+            sampled += sample.weight;
+        }
+    }
+
+    Color integrated(0, 0, 0);
+    double pdf_integral = 0;
+    for (int i = 0; i < count; ++i) {
+        Vector3D wi = random_in_hemisphere(normal);
+        integrated += material.eval(wo, wi, normal) * (dotProduct(wi, normal) * 2 * pi);
+        pdf_integral += material.pdf(wo, wi, normal) * 2 * pi;
+    }
+
+    assert(near(sampled / count, integrated / count, 0.02));
+    assert(near(pdf_integral / count, 1 - delta_share, 0.02));
+    assert(std::fabs(static_cast<double>(delta) / count - delta_share) < 0.005);
+}
+
+// Light samples plus the lights BSDF samples run into, each weighted by MIS, add up to the light a
+// Lambertian surface reflects from spheres of light above it: albedo / pi * pi * intensity / d^2 * cos.
+// So does either strategy alone
+void testDirectLightingAddsUp(LightSampling sampling, MISHeuristic heuristic) {
+    seed_random(5);
+    Scene scene;
+    double albedo = 0.5;
+    scene.add(std::make_shared<Sphere>(Point3D(0, -1000, 0), 1000, std::make_shared<Lambertian>(Color(albedo, albedo, albedo))));
+    scene.add(std::make_shared<PointLight>(Point3D(0, 2, 0), Color(3, 3, 3), 0.5));
+    scene.add(std::make_shared<PointLight>(Point3D(1.5, 2, 0.5), Color(1, 2, 3), 0.3));
+    scene.set_light_sampling(sampling, 1);
+    scene.set_mis_heuristic(heuristic);
+
+    Hit_record rec;
+    assert(scene.hit(Ray(Point3D(0, 1, 0), Vector3D(0, -1, 0)), Interval(0.001, infinity), rec));
+    Vector3D wo(0, 1, 0);
+    const Material& material = scene.getMaterial(rec.material);
+
+    const int count = 400000;
+    Color sum(0, 0, 0);
+    for (int i = 0; i < count; ++i) {
+        for (int slot = 0; slot < scene.getShadowLightCount(); ++slot) {
+            Scene::DirectLightSample light_sample;
+            if (scene.sampleDirectLight(rec, wo, slot, light_sample)) sum += light_sample.contribution;
+        }
+        BSDFSample bsdf_sample;
+        Color emitted;
+        if (material.sample(wo, rec.normal, rec.front_face, bsdf_sample) &&
+            scene.lightAlongRay(Ray(rec.p, bsdf_sample.wi), infinity, bsdf_sample.pdf, emitted)) {
+            sum += bsdf_sample.weight * emitted;
+        }
+    }
+
+    double cos_second = 2 / std::sqrt(6.5);
+    Color expected = albedo * (Color(3, 3, 3) / 4 + Color(1, 2, 3) * (cos_second / 6.5));
+    assert(near(sum / count, expected, 0.01));
+}
+
+// A light of radius 0 is found by light samples alone, and one sample is exact
+void testPointLight() {
+    seed_random(2);
+    Scene scene;
+    scene.add(std::make_shared<Sphere>(Point3D(0, -1000, 0), 1000, std::make_shared<Lambertian>(Color(0.5, 0.5, 0.5))));
+    scene.add(std::make_shared<PointLight>(Point3D(0, 2, 0), Color(3, 3, 3), 0));
+    Hit_record rec;
+    assert(scene.hit(Ray(Point3D(0, 1, 0), Vector3D(0, -1, 0)), Interval(0.001, infinity), rec));
+
+    Scene::DirectLightSample sample;
+    assert(scene.sampleDirectLight(rec, Vector3D(0, 1, 0), 0, sample));
+    assert(near(sample.contribution.x, 0.5 * 3 / 4, 1e-5) && near(sample.distance, 2, 1e-5));
+    Color emitted;
+    assert(!scene.lightAlongRay(Ray(rec.p, Vector3D(0, 1, 0)), infinity, 1, emitted));
+}
+
+// A path that runs out of bounces still gets the light its BSDF sample runs into, which completes the
+// MIS weights of its light samples. So with one bounce, a surface under a large light reflects the full
+// albedo * intensity / d^2 in both integrators, and nothing reaches it from further bounces here
+void testBounceCapKeepsDirectLight(MISHeuristic heuristic) {
+    Scene scene;
+    scene.add(std::make_shared<Sphere>(Point3D(0, -1000, 0), 1000, std::make_shared<Lambertian>(Color(0.5, 0.5, 0.5))));
+    scene.add(std::make_shared<PointLight>(Point3D(0, 2, 0), Color(3, 3, 3), 1.0));
+    scene.set_mis_heuristic(heuristic);
+    scene.build_bvh();
+
+    const int count = 200000;
+    std::vector<Ray> rays(count, Ray(Point3D(1.5, 0.5, 0), Vector3D(-1.5, -0.5, 0)));
+    std::vector<Sampler> samplers;
+    for (int k = 0; k < count; ++k) {
+        start_sample(9, k, 0);
+        samplers.push_back(thread_sampler());
+    }
+    std::vector<Color> recursive_colors, wavefront_colors;
+    RecursiveIntegrator(scene, Color(0, 0, 0), RENDER_PBR, 1).trace(rays, samplers, recursive_colors);
+    WavefrontIntegrator(scene, Color(0, 0, 0), RENDER_PBR, 1).trace(rays, samplers, wavefront_colors);
+
+    Color recursive_mean(0, 0, 0), wavefront_mean(0, 0, 0);
+    for (int k = 0; k < count; ++k) {
+        recursive_mean += recursive_colors[k] / count;
+        wavefront_mean += wavefront_colors[k] / count;
+    }
+    Color expected = Color(0.5, 0.5, 0.5) * (3.0 / 4);
+    assert(near(recursive_mean, expected, 0.01));
+    assert(near(wavefront_mean, recursive_mean, 1e-6));
+}
+
+int main() {
+    std::cout << "Running pbr tests...\n";
+    testSamplingMatchesEval(Lambertian(Color(0.8, 0.5, 0.2)), 0);
+    testSamplingMatchesEval(Blinn_Phong(Color(0.2, 0.7, 0.2), Color(1, 1, 1), 0.8, 0.3, 20), 0);
+    testSamplingMatchesEval(Blinn_Phong(Color(0.5, 0.5, 0.5), Color(1, 1, 1), 0.6, 0.4, 50, true, 0.4), 0.4);
+    std::cout << "BSDF sampling test passed!\n";
+    testDirectLightingAddsUp(LIGHT_SAMPLING_ALL, MIS_POWER);
+    testDirectLightingAddsUp(LIGHT_SAMPLING_ALL, MIS_BALANCE);
+    testDirectLightingAddsUp(LIGHT_SAMPLING_TREE, MIS_POWER);
+    testDirectLightingAddsUp(LIGHT_SAMPLING_ALL, MIS_LIGHT);
+    testDirectLightingAddsUp(LIGHT_SAMPLING_ALL, MIS_BSDF);
+    std::cout << "Direct lighting MIS test passed!\n";
+    testPointLight();
+    std::cout << "Point light test passed!\n";
+    testBounceCapKeepsDirectLight(MIS_POWER);
+    testBounceCapKeepsDirectLight(MIS_BALANCE);
+    testBounceCapKeepsDirectLight(MIS_BSDF);
+    std::cout << "Bounce cap test passed!\n";
+    return 0;
+}
@@ -35,25 +35,25 @@ void testGetCameraHeight() {
 void testGetCameraPosition() {
     nlohmann::json json = {{"camera", {{"position", {1.0, 2.0, 3.0}}}}};
     SceneReader reader(json);
-    std::vector<double> cameraPosition = reader.getCameraPosition();
+    Triplet cameraPosition = reader.getCameraPosition();
     assert(cameraPosition[0] == 1.0);
     assert(cameraPosition[1] == 2.0);
     assert(cameraPosition[2] == 3.0);
 }
 
 void testGetCameraLookAt() {
-    nlohmann::json json = {{"camera", {{"lookat", {1.0, 2.0, 3.0}}}}};
+    nlohmann::json json = {{"camera", {{"lookAt", {1.0, 2.0, 3.0}}}}};
     SceneReader reader(json);
-    std::vector<double> cameraLookAt = reader.getCameraLookAt();
+    Triplet cameraLookAt = reader.getCameraLookAt();
     assert(cameraLookAt[0] == 1.0);
     assert(cameraLookAt[1] == 2.0);
     assert(cameraLookAt[2] == 3.0);
 }
 
 void testGetCameraUp() {
-    nlohmann::json json = {{"camera", {{"up", {1.0, 2.0, 3.0}}}}};
+    nlohmann::json json = {{"camera", {{"upVector", {1.0, 2.0, 3.0}}}}};
     SceneReader reader(json);
-    std::vector<double> cameraUp = reader.getCameraUp();
+    Triplet cameraUp = reader.getCameraUp();
     assert(cameraUp[0] == 1.0);
     assert(cameraUp[1] == 2.0);
     assert(cameraUp[2] == 3.0);
@@ -76,7 +76,7 @@ void testGetCameraExposure() {
 void testGetSceneBackgroundColor() {
     nlohmann::json json = {{"scene", {{"backgroundcolor", {0.5, 0.75, 0.35}}}}};
     SceneReader reader(json);
-    std::vector<double> backgroundColor = reader.getSceneBackgroundColor();
+    Triplet backgroundColor = reader.getSceneBackgroundColor();
     assert(backgroundColor[0] == 0.5);
     assert(backgroundColor[1] == 0.75);
     assert(backgroundColor[2] == 0.35);
@@ -84,48 +84,42 @@ void testGetSceneBackgroundColor() {
 
 void testGetShapes() {
     nlohmann::json json = {
-        {"shapes", {
+        {"scene", {{"shapes", {
             {{"type", "sphere"}, {"center", {0.0, 0.0, 0.0}}, {"radius", 1.0}},
             {{"type", "cylinder"}, {"center", {1.0, 2.0, 3.0}}, {"axis", {4.0, 5.0, 6.0}}, {"radius", 2.0}, {"height", 3.0}}
-        }}
+        }}}}
     };
     SceneReader reader(json);
-    std::vector<nlohmann::json> shapes = reader.getShapes();
+    Scene scene = reader.buildScene();
+    const std::vector<std::shared_ptr<Shape>>& shapes = scene.getShapes();
     assert(shapes.size() == 2);
-    assert(shapes[0]["type"] == "sphere");
-    assert(shapes[0]["center"][0] == 0.0);
-    assert(shapes[0]["center"][1] == 0.0);
-    assert(shapes[0]["center"][2] == 0.0);
-    assert(shapes[0]["radius"] == 1.0);
-    assert(shapes[1]["type"] == "cylinder");
-    assert(shapes[1]["center"][0] == 1.0);
-    assert(shapes[1]["center"][1] == 2.0);
-    assert(shapes[1]["center"][2] == 3.0);
-    assert(shapes[1]["axis"][0] == 4.0);
-    assert(shapes[1]["axis"][1] == 5.0);
-    assert(shapes[1]["axis"][2] == 6.0);
-    assert(shapes[1]["radius"] == 2.0);
-    assert(shapes[1]["height"] == 3.0);
+    assert(shapes[0]->is_sphere());
+    assert(shapes[0]->getCenter() == Point3D(0.0, 0.0, 0.0));
+    assert(shapes[0]->getRadius() == 1.0);
+    assert(shapes[1]->is_cylinder());
+    assert(shapes[1]->getCenter() == Point3D(1.0, 2.0, 3.0));
+    assert(dynamic_cast<Cylinder*>(shapes[1].get())->getAxis() == Vector3D(4.0, 5.0, 6.0));
+    assert(shapes[1]->getRadius() == 2.0);
+    assert(shapes[1]->getHeight() == 3.0);
 }
 
 void testModifyScene() {
     nlohmann::json json = {
         {"camera", {{"type", "pinhole"}, {"width", 800}, {"height", 600}, {"fov", 90.0}}},
-        {"scene", {{"backgroundcolor", {0.0, 0.0, 0.0}}}},
-        {"shapes", {
+        {"scene", {{"backgroundcolor", {0.0, 0.0, 0.0}}, {"shapes", {
             {{"type", "sphere"}, {"center", {0.0, 0.0, 0.0}}, {"radius", 1.0}},
             {{"type", "cylinder"}, {"center", {1.0, 2.0, 3.0}}, {"axis", {4.0, 5.0, 6.0}}, {"radius", 2.0}, {"height", 3.0}}
-        }}
+        }}}}
     };
     SceneReader reader(json);
     Scene scene;
     reader.modifyScene(scene);
-    assert(scene.shapes.size() == 2);
-    Sphere* sphere = dynamic_cast<Sphere*>(scene.shapes[0].get());
+    assert(scene.getShapes().size() == 2);
+    Sphere* sphere = dynamic_cast<Sphere*>(scene.getShapes()[0].get());
     assert(sphere != nullptr);
     assert(sphere->getCenter() == Point3D(0.0, 0.0, 0.0));
     assert(sphere->getRadius() == 1.0);
-    Cylinder* cylinder = dynamic_cast<Cylinder*>(scene.shapes[1].get());
+    Cylinder* cylinder = dynamic_cast<Cylinder*>(scene.getShapes()[1].get());
     assert(cylinder != nullptr);
     assert(cylinder->getCenter() == Point3D(1.0, 2.0, 3.0));
     assert(cylinder->getAxis() == Vector3D(4.0, 5.0, 6.0));
@@ -136,20 +130,19 @@ void testModifyScene() {
 void testBuildScene() {
     nlohmann::json json = {
         {"camera", {{"type", "pinhole"}, {"width", 800}, {"height", 600}, {"fov", 90.0}}},
-        {"scene", {{"backgroundcolor", {0.0, 0.0, 0.0}}}},
-        {"shapes", {
+        {"scene", {{"backgroundcolor", {0.0, 0.0, 0.0}}, {"shapes", {
             {{"type", "sphere"}, {"center", {0.0, 0.0, 0.0}}, {"radius", 1.0}},
             {{"type", "cylinder"}, {"center", {1.0, 2.0, 3.0}}, {"axis", {4.0, 5.0, 6.0}}, {"radius", 2.0}, {"height", 3.0}}
-        }}
+        }}}}
     };
     SceneReader reader(json);
     Scene scene = reader.buildScene();
-    assert(scene.shapes.size() == 2);
-    Sphere* sphere = dynamic_cast<Sphere*>(scene.shapes[0].get());
+    assert(scene.getShapes().size() == 2);
+    Sphere* sphere = dynamic_cast<Sphere*>(scene.getShapes()[0].get());
     assert(sphere != nullptr);
     assert(sphere->getCenter() == Point3D(0.0, 0.0, 0.0));
     assert(sphere->getRadius() == 1.0);
-    Cylinder* cylinder = dynamic_cast<Cylinder*>(scene.shapes[1].get());
+    Cylinder* cylinder = dynamic_cast<Cylinder*>(scene.getShapes()[1].get());
     assert(cylinder != nullptr);
     assert(cylinder->getCenter() == Point3D(1.0, 2.0, 3.0));
     assert(cylinder->getAxis() == Vector3D(4.0, 5.0, 6.0));
@@ -203,7 +196,7 @@ void testGetCameraHeightNotNumber() {
 void testGetCameraPositionNoCamera() {
     nlohmann::json json = {};
     SceneReader reader(json);
-    std::vector<double> cameraPosition = reader.getCameraPosition();
+    Triplet cameraPosition = reader.getCameraPosition();
     assert(cameraPosition[0] == 0.0);
     assert(cameraPosition[1] == 0.0);
     assert(cameraPosition[2] == 0.0);
@@ -212,7 +205,7 @@ void testGetCameraPositionNoCamera() {
 void testGetCameraPositionNotArray() {
     nlohmann::json json = {{"camera", {{"position", "not an array"}}}};
     SceneReader reader(json);
-    std::vector<double> cameraPosition = reader.getCameraPosition();
+    Triplet cameraPosition = reader.getCameraPosition();
     assert(cameraPosition[0] == 0.0);
     assert(cameraPosition[1] == 0.0);
     assert(cameraPosition[2] == 0.0);
@@ -221,16 +214,16 @@ void testGetCameraPositionNotArray() {
 void testGetCameraLookAtNoCamera() {
     nlohmann::json json = {};
     SceneReader reader(json);
-    std::vector<double> cameraLookAt = reader.getCameraLookAt();
+    Triplet cameraLookAt = reader.getCameraLookAt();
     assert(cameraLookAt[0] == 0.0);
     assert(cameraLookAt[1] == 0.0);
     assert(cameraLookAt[2] == -1.0); // Default lookAt is {0.0, 0.0, -1.0}
 }
 
 void testGetCameraLookAtNotArray() {
-    nlohmann::json json = {{"camera", {{"lookat", "not an array"}}}};
+    nlohmann::json json = {{"camera", {{"lookAt", "not an array"}}}};
     SceneReader reader(json);
-    std::vector<double> cameraLookAt = reader.getCameraLookAt();
+    Triplet cameraLookAt = reader.getCameraLookAt();
     assert(cameraLookAt[0] == 0.0);
     assert(cameraLookAt[1] == 0.0);
     assert(cameraLookAt[2] == -1.0); // Default lookAt is {0.0, 0.0, -1.0}
@@ -239,16 +232,16 @@ void testGetCameraLookAtNotArray() {
 void testGetCameraUpNoCamera() {
     nlohmann::json json = {};
     SceneReader reader(json);
-    std::vector<double> cameraUp = reader.getCameraUp();
+    Triplet cameraUp = reader.getCameraUp();
     assert(cameraUp[0] == 0.0);
     assert(cameraUp[1] == 1.0); // Default up is {0.0, 1.0, 0.0}
     assert(cameraUp[2] == 0.0);
 }
 
 void testGetCameraUpNotArray() {
-    nlohmann::json json = {{"camera", {{"up", "not an array"}}}};
+    nlohmann::json json = {{"camera", {{"upVector", "not an array"}}}};
     SceneReader reader(json);
-    std::vector<double> cameraUp = reader.getCameraUp();
+    Triplet cameraUp = reader.getCameraUp();
     assert(cameraUp[0] == 0.0);
     assert(cameraUp[1] == 1.0); // Default up is {0.0, 1.0, 0.0}
     assert(cameraUp[2] == 0.0);
@@ -271,7 +264,7 @@ void testGetCameraExposureNotNumber() {
 void testGetSceneBackgroundColorNoScene() {
     nlohmann::json json = {{"rendermode", "binary"}};
     SceneReader reader(json);
-    std::vector<double> backgroundColor = reader.getSceneBackgroundColor();
+    Triplet backgroundColor = reader.getSceneBackgroundColor();
     assert(backgroundColor[0] == 0);
     assert(backgroundColor[1] == 0);
     assert(backgroundColor[2] == 0);
@@ -280,7 +273,7 @@ void testGetSceneBackgroundColorNoScene() {
 void testGetSceneBackgroundColorNotArray() {
     nlohmann::json json = {{"scene", {{"backgroundcolor", "not an array"}}}};
     SceneReader reader(json);
-    std::vector<double> backgroundColor = reader.getSceneBackgroundColor();
+    Triplet backgroundColor = reader.getSceneBackgroundColor();
     assert(backgroundColor[0] == 0);
     assert(backgroundColor[1] == 0);
     assert(backgroundColor[2] == 0);
@@ -289,15 +282,13 @@ void testGetSceneBackgroundColorNotArray() {
 void testGetShapesNoShapes() {
     nlohmann::json json = {{"rendermode", "binary"}};
     SceneReader reader(json);
-    std::vector<nlohmann::json> shapes = reader.getShapes();
-    assert(shapes.empty());
+    assert(reader.buildScene().getShapes().empty());
 }
 
 void testGetShapesNotArray() {
-    nlohmann::json json = {{"shapes", "not an array"}};
+    nlohmann::json json = {{"scene", {{"shapes", "not an array"}}}};
     SceneReader reader(json);
-    std::vector<nlohmann::json> expected = {};
-    assert(reader.getShapes() == expected);
+    assert(reader.buildScene().getShapes().empty());
 }
 
 void testGetCameraFovNoCamera() {
@@ -354,6 +345,8 @@ int main() {
     testGetShapes();
     std::cout << "testGetShapes passed.\n";
     testModifyScene();
+    std::cout << "testModifyScene passed.\n";
+    testBuildScene();
     std::cout << "testBuildScene passed.\n";
     testFileNotFound();
     std::cout << "testFileNotFound passed.\n";
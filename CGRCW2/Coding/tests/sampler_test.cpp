@@ -0,0 +1,64 @@
+#include "math_utils.h"
+
+#include <cassert>
+#include <iostream>
+#include <thread>
+
+void testSameKeySameSequence() {
+    Sampler a(42, 1234, 7);
+    Sampler b(42, 1234, 7);
+    for (int i = 0; i < 1000; ++i) {
+        assert(a.next_uint64() == b.next_uint64());
+    }
+    assert(a.getDimension() == 1000);
+}
+
+void testDifferentKeysDiffer() {
+    Sampler base(42, 1234, 7);
+    Sampler other_seed(43, 1234, 7);
+    Sampler other_pixel(42, 1235, 7);
+    Sampler other_sample(42, 1234, 8);
+    std::uint64_t first = base.next_uint64();
+    assert(first != other_seed.next_uint64());
+    assert(first != other_pixel.next_uint64());
+    assert(first != other_sample.next_uint64());
+}
+
+void testDoubleRangeAndMean() {
+    Sampler sampler(1, 2, 3);
+    double sum = 0;
+    const int count = 100000;
+    for (int i = 0; i < count; ++i) {
+        double x = sampler.next_double();
+        assert(x >= 0.0 && x < 1.0);
+        sum += x;
+    }
+    assert(fabs(sum / count - 0.5) < 0.01);
+}
+
+void testThreadStreamsAreIndependent() {
+    // The same pixel sample must produce the same values on any thread
+    start_sample(5, 10, 0);
+    double expected = random_double();
+
+    double on_other_thread = -1;
+    std::thread worker([&]() {
+        start_sample(5, 10, 0);
+        on_other_thread = random_double();
+    });
+    worker.join();
+    assert(on_other_thread == expected);
+}
+
+int main() {
+    std::cout << "Running sampler tests...\n";
+    testSameKeySameSequence();
+    std::cout << "Same key test passed!\n";
+    testDifferentKeysDiffer();
+    std::cout << "Different keys test passed!\n";
+    testDoubleRangeAndMean();
+    std::cout << "Double range test passed!\n";
+    testThreadStreamsAreIndependent();
+    std::cout << "Thread stream test passed!\n";
+    return 0;
+}
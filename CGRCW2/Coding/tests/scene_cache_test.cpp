@@ -0,0 +1,76 @@
+#include "scene_cache.h"
+#include "test_scenes.h"
+
+#include <cassert>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+Framebuffer render(const Scene& scene) {
+    return makeTestCamera(4).render(scene, Color(0.2, 0.3, 0.5), RENDER_PHONG);
+}
+
+// A scene read back from its cache, BVHs included, renders exactly like the original
+void testRoundTrip() {
+    const std::string filename = "scene_cache_test.rtscene";
+    Scene original = makeTestScene();
+    SceneDescription settings;
+    settings.width.value = 320;
+    settings.width.state = SceneField<int>::SET;
+    settings.rendermode.state = SceneField<std::string>::WRONG_TYPE;
+    settings.rendermode.found_type = "number";
+    settings.content_hash = 1234;
+    assert(SceneCache::save(filename, 99, settings, original));
+
+    Scene loaded;
+    SceneDescription loaded_settings;
+    assert(SceneCache::load(filename, 99, loaded_settings, loaded, true));
+    assert(loaded.getShapes().size() == original.getShapes().size());
+    assert(loaded.getLightCount() == 2 && loaded.getLights()[1]->getRadius() == 0.25);
+    assert(loaded.getBVH().getNodes().size() == original.getBVH().getNodes().size());
+    assert(loaded_settings.width.value == 320 && loaded_settings.width.state == SceneField<int>::SET);
+    assert(loaded_settings.rendermode.state == SceneField<std::string>::WRONG_TYPE);
+    assert(std::string(loaded_settings.rendermode.found_type) == "number");
+    assert(loaded_settings.content_hash == 1234);
+    assertSameImage(render(original), render(loaded));
+
+    // Without the stored BVH the scene can still be built as usual
+    Scene unaccelerated;
+    assert(SceneCache::load(filename, 99, loaded_settings, unaccelerated, false));
+    assert(!unaccelerated.has_bvh());
+    std::remove(filename.c_str());
+}
+
+// The cache of another scene file, or a damaged one, is not used
+void testRejected() {
+    const std::string filename = "scene_cache_test_rejected.rtscene";
+    Scene original = makeTestScene();
+    assert(SceneCache::save(filename, 7, SceneDescription(), original));
+
+    Scene scene;
+    SceneDescription settings;
+    assert(!SceneCache::load(filename, 8, settings, scene, true));
+    assert(!SceneCache::load("scene_cache_test_missing.rtscene", 7, settings, scene, true));
+
+    // Point the first shape at a material that does not exist
+    std::fstream file(filename, std::ios::in | std::ios::out | std::ios::binary);
+    std::uint64_t shapes_offset;
+    file.seekg(32 + 16 * 4);
+    file.read(reinterpret_cast<char*>(&shapes_offset), sizeof(shapes_offset));
+    std::uint32_t bad_material = 1000;
+    file.seekp(shapes_offset + 4);
+    file.write(reinterpret_cast<const char*>(&bad_material), sizeof(bad_material));
+    file.close();
+    assert(!SceneCache::load(filename, 7, settings, scene, true));
+    assert(scene.getShapes().empty() && scene.getLightCount() == 0);
+    std::remove(filename.c_str());
+}
+
+int main() {
+    std::cout << "Running scene cache tests...\n";
+    testRoundTrip();
+    std::cout << "Scene cache round trip test passed!\n";
+    testRejected();
+    std::cout << "Scene cache rejection test passed!\n";
+    return 0;
+}
@@ -0,0 +1,138 @@
+#include "scene_reader.h"
+
+#include <cassert>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+const char* scene_text = R"({
+    "nbounces": 4,
+    "rendermode": "phong",
+    "camera": {"type": "pinhole", "width": 40, "height": 20, "position": [1, 2, 3, 9], "lookAt": [0, 0, -1],
+               "upVector": [0, "y", 0], "fov": 45.5, "exposure": 0.2, "extra": {"ignored": [1, 2]}},
+    "scene": {
+        "backgroundcolor": [0.1, 0.2, 0.3],
+        "lightsources": [
+            {"type": "pointlight", "position": [0, 5, 0], "intensity": [1, 1, 1]},
+            {"type": "pointlight", "position": [0, 5, 0]},
+            {"type": "pointlight", "position": [1, 5, 0], "intensity": [1, 1, 1], "radius": 0.5},
+            {"type": "pointlight", "position": [2, 5, 0], "intensity": [1, 1, 1], "radius": -1},
+            {"type": "pointlight", "position": [3, 5, 0], "intensity": [1, 1, 1], "radius": "wide"}
+        ],
+        "shapes": [
+            {"type": "sphere", "center": [0, 0, -2], "radius": 0.5, "material": {}},
+            {"type": "triangle", "v0": [0, 0, 0], "v1": [1, 0, 0], "v2": [0, 1, 0], "material": {
+                "ks": 0.1, "kd": 0.9, "specularexponent": 10, "diffusecolor": [1, 0, 0], "specularcolor": [1, 1, 1],
+                "isreflective": false, "reflectivity": 1.0, "isrefractive": false, "refractiveindex": 1.0}},
+            {"type": "sphere", "center": [0, 0, -2], "radius": "big", "material": null},
+            {"type": "cone", "material": null}
+        ]
+    }
+})";
+
+void testSettings() {
+    SceneDescription description;
+    SceneParser::parse(std::string(scene_text), "", description);
+    assert(description.nbounces.value == 4);
+    assert(description.rendermode.value == "phong");
+    assert(description.width.value == 40 && description.height.value == 20);
+    assert(description.fov.value == 45.5);
+
+    // Components past the third are ignored; a non-number makes the whole vector the wrong type
+    assert(description.position.state == SceneField<Triplet>::SET);
+    assert(description.position.value == (Triplet{{1, 2, 3}}));
+    assert(description.up_vector.state == SceneField<Triplet>::WRONG_TYPE);
+    assert(description.adaptive.state == SceneField<bool>::MISSING);
+}
+
+// Lights and shapes are built while parsing; broken entries are skipped
+void testObjects() {
+    SceneDescription description;
+    SceneParser::parse(std::string(scene_text), "", description);
+    // The radius is optional, a negative one is replaced by 0 (a hard shadow light)
+    assert(description.lights.size() == 3);
+    assert(description.lights[0]->getRadius() == default_light_radius);
+    assert(description.lights[1]->getRadius() == 0.5);
+    assert(description.lights[2]->getRadius() == 0);
+    assert(description.shapes.size() == 2);
+    assert(description.shape_entries == 4);
+
+    SceneReader reader(nlohmann::json::parse(scene_text));
+    Scene scene = reader.buildScene();
+    assert(scene.getShapes().size() == 2);
+    Triplet background = reader.getSceneBackgroundColor();
+    assert(background[2] == 0.3);
+}
+
+// The content hash depends on the values, not on the formatting of the file
+void testContentHash() {
+    std::string compact;
+    for (const char* c = scene_text; *c; ++c) {
+        if (*c != ' ' && *c != '\n') compact += *c;
+    }
+    compact.replace(compact.find("45.5"), 4, "4.55e1");
+    std::istringstream stream(scene_text);
+    SceneDescription from_stream, from_compact, changed;
+    SceneParser::parse(stream, "", from_stream);
+    SceneParser::parse(compact, "", from_compact);
+    assert(from_stream.content_hash == from_compact.content_hash);
+
+    std::string modified = compact;
+    modified.replace(modified.find("4.55e1"), 6, "45.6");
+    SceneParser::parse(modified, "", changed);
+    assert(changed.content_hash != from_compact.content_hash);
+}
+
+// Shapes that parse but cannot be intersected are dropped as buildScene() adds them to the scene
+void testDegenerateGeometry() {
+    const char* text = R"({"scene": {"lightsources": [], "shapes": [
+        {"type": "sphere", "center": [0, 0, -2], "radius": 0, "material": {}},
+        {"type": "sphere", "center": [0, 0, -2], "radius": 0.5, "material": {}},
+        {"type": "triangle", "v0": [0, 0, 0], "v1": [1, 1, 1], "v2": [2, 2, 2], "material": {}},
+        {"type": "cylinder", "center": [0, 0, -2], "axis": [0, 0, 0], "radius": 0.5, "height": 1, "material": {}},
+        {"type": "cylinder", "center": [0, 0, -2], "axis": [0, 2, 0], "radius": 0.5, "height": 1, "material": {}}
+    ]}})";
+    SceneReader reader(nlohmann::json::parse(text));
+    Scene scene = reader.buildScene();
+    assert(scene.getShapes().size() == 2);
+    assert(scene.getShapes()[0]->is_sphere() && scene.getShapes()[1]->is_cylinder());
+    std::vector<int> counts = scene.getPrimitiveCounts();
+    assert(counts[PRIMITIVE_SPHERE] == 1 && counts[PRIMITIVE_TRIANGLE] == 0 && counts[PRIMITIVE_CYLINDER] == 1);
+
+    // The cylinder record holds the unit axis, so the top cap is found through it
+    Hit_record record;
+    assert(scene.hit(Ray(Point3D(0, 5, -2), Vector3D(0, -1, 0)), Interval(0.001, infinity), record));
+    assert(std::fabs(record.t - 4) < 1e-4);
+
+    // Shapes added to the scene directly are checked the same way
+    auto material = std::make_shared<Lambertian>(Color(0.5, 0.5, 0.5));
+    assert(!scene.add(std::make_shared<Sphere>(Point3D(0, 0, 0), 0, material)));
+    assert(scene.add(std::make_shared<Sphere>(Point3D(0, 0, 0), 1, material)));
+    assert(scene.getShapes().size() == 3 && scene.getPrimitiveCounts()[PRIMITIVE_SPHERE] == 2);
+}
+
+void testSyntaxError() {
+    SceneDescription description;
+    bool thrown = false;
+    try {
+        SceneParser::parse(std::string("{\"nbounces\": "), "", description);
+    } catch (std::runtime_error&) {
+        thrown = true;
+    }
+    assert(thrown);
+}
+
+int main() {
+    std::cout << "Running scene parser tests...\n";
+    testSettings();
+    std::cout << "Settings test passed!\n";
+    testObjects();
+    std::cout << "Lights and shapes test passed!\n";
+    testContentHash();
+    std::cout << "Content hash test passed!\n";
+    testDegenerateGeometry();
+    std::cout << "Degenerate geometry test passed!\n";
+    testSyntaxError();
+    std::cout << "Syntax error test passed!\n";
+    return 0;
+}
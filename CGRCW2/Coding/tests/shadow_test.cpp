@@ -0,0 +1,122 @@
+#include "scene.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include <limits>
+
+// Rounding allowed in the comparisons, wider in float builds
+const double tolerance = std::max(1e-9, 8.0 * std::numeric_limits<real>::epsilon());
+
+bool nearlyEqual(const Color& a, const Color& b) {
+    return std::fabs(a.x - b.x) < tolerance && std::fabs(a.y - b.y) < tolerance && std::fabs(a.z - b.z) < tolerance;
+}
+
+// Hit record of an upward facing point on the floor, whose material is the first one of every test scene
+Hit_record floorHit(const Point3D& p) {
+    Hit_record record;
+    record.p = p;
+    record.normal = Vector3D(0, 1, 0);
+    record.front_face = true;
+    record.material = 0;
+    return record;
+}
+
+// Lit and shadowed shading of light at the center of the light, what every shadow ray outcome is averaged from
+void shadeBothWays(const Hit_record& record, const Material& material, const PointLight& light, Color& lit, Color& dark) {
+    Vector3D to_light = light.getPosition() - record.p;
+    Vector3D view(0, 1, 0);
+    lit = material.shade(record, normalize(to_light), view, light.getIntensity(), getLength(to_light));
+    dark = material.shade(record, normalize(to_light), view, light.getIntensity(), -1);
+}
+
+// The points of the lattice lie on the light's sphere, one in each band of equal area
+void testLattice() {
+    PointLight light(Point3D(1, 2, 3), Color(1, 1, 1), 0.5);
+    const int count = 16;
+    int per_band[count] = {0};
+    for (int i = 0; i < count; ++i) {
+        Vector3D offset = light.samplePoint(i, count, 0.37, 0.81) - light.getPosition();
+        assert(std::fabs(getLength(offset) - 0.5) < std::max(1e-12, 8.0 * std::numeric_limits<real>::epsilon()));
+        double z = offset.z / 0.5;
+        per_band[std::min(count - 1, static_cast<int>((1 - z) / 2 * count))]++;
+    }
+    for (int band = 0; band < count; ++band) {
+        assert(per_band[band] == 1);
+    }
+}
+
+// An unblocked light adds its shading once, whatever the number of shadow rays
+void testAveraging() {
+    auto material = std::make_shared<Lambertian>(Color(0.6, 0.5, 0.4));
+    Hit_record record = floorHit(Point3D(0.3, 0, 0.2));
+    Ray view_ray(Point3D(0.3, 1, 0.2), Vector3D(0, -1, 0));
+    auto light = std::make_shared<PointLight>(Point3D(0, 2, 0), Color(3, 3, 3), 0.2);
+    Color lit, dark;
+    shadeBothWays(record, *material, *light, lit, dark);
+
+    for (int rays : {1, 10, 64}) {
+        Scene scene;
+        assert(scene.addMaterial(material) == 0);
+        scene.add(light);
+        scene.set_shadow_rays(rays);
+        seed_random(5);
+        assert(nearlyEqual(scene.calculateLightingForHitPoint(view_ray, record), lit));
+    }
+}
+
+// A light of radius 0 casts one ray without drawing random numbers; one of nonzero radius is half hidden by
+// an occluder whose edge runs right under its center
+void testHardAndSoft() {
+    auto material = std::make_shared<Lambertian>(Color(0.6, 0.5, 0.4));
+    Hit_record record = floorHit(Point3D(0, 0, 0));
+    Ray view_ray(Point3D(0, 1, 0), Vector3D(0, -1, 0));
+
+    Scene scene;
+    // Covers x < 0 at height 1, between the floor point and the light
+    scene.add(std::make_shared<Triangle>(Point3D(0, 1, -50), Point3D(0, 1, 50), Point3D(-50, 1, 0), material));
+    scene.add(std::make_shared<PointLight>(Point3D(0, 2, 0), Color(3, 3, 3), 0));
+    scene.add(std::make_shared<PointLight>(Point3D(0, 2, 0), Color(3, 3, 3), 0.5));
+    scene.set_shadow_rays(64);
+    assert(scene.shadowRayCount(0) == 1);
+    assert(scene.shadowRayCount(1) == 64);
+
+    seed_random(9);
+    Scene::ShadowSamples hard = scene.shadowSamples(0);
+    double next = random_double();
+    seed_random(9);
+    assert(hard.count == 1 && random_double() == next);
+
+    // The center of the hard light sits right on the edge, so compare the soft light alone
+    Scene soft_scene;
+    soft_scene.add(std::make_shared<Triangle>(Point3D(0, 1, -50), Point3D(0, 1, 50), Point3D(-50, 1, 0), material));
+    auto soft_light = std::make_shared<PointLight>(Point3D(0, 2, 0), Color(3, 3, 3), 0.5);
+    soft_scene.add(soft_light);
+    soft_scene.set_shadow_rays(64);
+    Color lit, dark;
+    shadeBothWays(record, *material, *soft_light, lit, dark);
+    seed_random(11);
+    Color shaded = soft_scene.calculateLightingForHitPoint(view_ray, record);
+    double visibility = (shaded.x - dark.x) / (lit.x - dark.x);
+    assert(std::fabs(visibility - 0.5) < 0.05);
+
+    // Fully behind the occluder, the hard light is shadowed with its single ray
+    Scene hard_scene;
+    hard_scene.add(std::make_shared<Triangle>(Point3D(1, 1, -50), Point3D(1, 1, 50), Point3D(-50, 1, 0), material));
+    auto hard_light = std::make_shared<PointLight>(Point3D(0, 2, 0), Color(3, 3, 3), 0);
+    hard_scene.add(hard_light);
+    shadeBothWays(record, *material, *hard_light, lit, dark);
+    assert(nearlyEqual(hard_scene.calculateLightingForHitPoint(view_ray, record), dark));
+}
+
+int main() {
+    std::cout << "Running shadow tests...\n";
+    testLattice();
+    std::cout << "Shadow lattice test passed!\n";
+    testAveraging();
+    std::cout << "Shadow averaging test passed!\n";
+    testHardAndSoft();
+    std::cout << "Hard and soft shadow test passed!\n";
+    return 0;
+}
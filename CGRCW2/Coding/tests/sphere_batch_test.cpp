@@ -0,0 +1,105 @@
+#include "test_scenes.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include <limits>
+
+// Hit distances from two kernels agree up to rounding in the build's precision, relative to the distance
+bool sameDistance(double a, double b) {
+    return std::fabs(a - b) <= 64 * std::numeric_limits<real>::epsilon() * std::max(1.0, std::fabs(a));
+}
+
+void testPackedMatchesShapes(bool use_bvh) {
+    Scene reference = makeRandomSphereScene(501);
+    Scene packed = reference;
+    packed.pack_spheres();
+    assert(packed.getSphereBatch().size() == 501);
+    if (use_bvh) {
+        reference.build_bvh();
+        packed.build_bvh();
+    }
+
+    int hits = 0;
+    for (int i = 0; i < 20000; ++i) {
+        Ray ray(Vector3D::random(-15, 15), normalize(Vector3D::random(-1, 1)));
+        Interval ray_t(0.001, random_double(1, 30));
+        Hit_record expected, actual;
+        bool expected_hit = reference.hit(ray, ray_t, expected);
+        assert(packed.hit(ray, ray_t, actual) == expected_hit);
+        if (expected_hit) {
+            assert(sameDistance(expected.t, actual.t));
+            ++hits;
+        }
+        assert(packed.occluded(ray, ray_t) == reference.occluded(ray, ray_t));
+    }
+    assert(hits > 0);
+}
+
+// Rays that just graze a sphere, where the float roots of SpherePrimitive::hit can miss a sphere the
+// kernel hits in double: the scene still reports a hit, no further than the kernel's
+void testGrazingRays(bool use_bvh) {
+    Scene packed = makeRandomSphereScene(200);
+    packed.pack_spheres();
+    if (use_bvh) packed.build_bvh();
+    const SphereBatch& batch = packed.getSphereBatch();
+
+    int hits = 0;
+    for (int i = 0; i < 20000; ++i) {
+        const Shape& sphere = *packed.getShapes()[batch.shape_index(i % batch.size())];
+        Vector3D direction = normalize(Vector3D::random(-1, 1));
+        Vector3D side = normalize(crossProduct(direction, Vector3D::random(-1, 1)));
+        Point3D tangent = sphere.getCenter() + side * (sphere.getRadius() * (1 - random_double(0, 1e-6)));
+        Ray ray(tangent - direction * random_double(5, 30), direction);
+
+        Interval kernel_t(0.001, infinity);
+        int index = -1;
+        Hit_record rec;
+        bool scene_hit = packed.hit(ray, Interval(0.001, infinity), rec);
+        if (batch.hit(ray, 0, batch.size(), kernel_t, index)) {
+            assert(scene_hit);
+            // Rounding in the discriminant moves a grazing root by about sqrt(epsilon) times the distance
+            double radius = packed.getShapes()[batch.shape_index(index)]->getRadius();
+            assert(rec.t <= kernel_t.max + 4 * std::sqrt(std::numeric_limits<real>::epsilon()) * (kernel_t.max + radius));
+            ++hits;
+        }
+    }
+    assert(hits > 0);
+}
+
+void testScalarKernelMatchesSimd() {
+    SphereBatch batch;
+    for (int i = 0; i < 37; ++i) {
+        batch.add(Vector3D::random(-5, 5), random_double(0.2, 1.0), i, true);
+    }
+    for (int i = 0; i < 5000; ++i) {
+        Ray ray(Vector3D::random(-8, 8), Vector3D::random(-1, 1));
+        int first = static_cast<int>(random_double(0, 30));
+        int count = 1 + static_cast<int>(random_double(0, 37 - first - 1));
+        Interval scalar_t(0.001, infinity), simd_t(0.001, infinity);
+        int scalar_index = -1, simd_index = -1;
+        bool scalar_hit = batch.hit_scalar(ray, first, count, scalar_t, scalar_index);
+        assert(batch.hit(ray, first, count, simd_t, simd_index) == scalar_hit);
+        if (scalar_hit) {
+            assert(scalar_index == simd_index);
+            assert(sameDistance(scalar_t.max, simd_t.max));
+            assert(scalar_index >= first && scalar_index < first + count);
+        }
+    }
+}
+
+int main() {
+    std::cout << "Running sphere batch tests (" << SphereBatch().kernel_name() << " kernel)...\n";
+    seed_random(3);
+    testScalarKernelMatchesSimd();
+    std::cout << "Scalar vs. SIMD kernel test passed!\n";
+    testPackedMatchesShapes(false);
+    std::cout << "Packed spheres, linear scan test passed!\n";
+    testPackedMatchesShapes(true);
+    std::cout << "Packed spheres, BVH test passed!\n";
+    testGrazingRays(false);
+    testGrazingRays(true);
+    std::cout << "Grazing rays test passed!\n";
+    return 0;
+}
@@ -0,0 +1,73 @@
+#ifndef TEST_SCENES_H
+#define TEST_SCENES_H
+
+#include "camera.h"
+
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Scenes, camera and image comparison shared by the tests
+
+// Spheres with every material kind above a ground plane, a cylinder, a triangle and a small mesh for the
+// other shape kinds, lit by a point light and a spherical one. Four materials, shared between the shapes
+Scene makeTestScene() {
+    Scene scene;
+    std::shared_ptr<Material> materials[] = {
+        std::make_shared<Lambertian>(Color(0.8, 0.3, 0.3)),
+        std::make_shared<Blinn_Phong>(Color(0.2, 0.7, 0.2), Color(1, 1, 1), 0.8, 0.3, 20),
+        std::make_shared<Blinn_Phong>(Color(0.5, 0.5, 0.5), Color(1, 1, 1), 1.0, 0.2, 500, true, 0.8),
+        std::make_shared<Blinn_Phong>(Color(0.5, 0.5, 0.5), Color(1, 1, 1), 1.0, 0.2, 500, false, 0.0, true, 1.5)
+    };
+    scene.add(std::make_shared<Sphere>(Point3D(0, -100.5, -1), 100, materials[0]));
+    for (int i = 0; i < 4; ++i) {
+        scene.add(std::make_shared<Sphere>(Point3D(-1.5 + i, 0, -1.5), 0.45, materials[i]));
+    }
+    scene.add(std::make_shared<Cylinder>(Point3D(1.2, -0.5, -2.5), Vector3D(0, 1, 0), 0.3, 1.0, materials[1]));
+    scene.add(std::make_shared<Triangle>(Point3D(-2, -0.5, -3), Point3D(2, -0.5, -3), Point3D(0, 2, -3), materials[2]));
+    std::vector<float> vertices = {-0.3f, 0.6f, -2.0f, 0.3f, 0.6f, -2.0f, 0.0f, 1.1f, -2.0f, 0.6f, 1.1f, -2.0f};
+    std::vector<std::uint32_t> indices = {0, 1, 2, 1, 3, 2};
+    scene.add(std::make_shared<TriangleMesh>(vertices, indices, materials[0]));
+    scene.add(std::make_shared<PointLight>(Point3D(0, 2, 0), Color(4, 4, 4)));
+    scene.add(std::make_shared<PointLight>(Point3D(-2, 1, -1), Color(2, 2, 3), 0.25));
+    scene.build_bvh();
+    return scene;
+}
+
+// count random spheres in a 20x20x20 box over a triangle floor, every fourth one refractive so it casts
+// no shadow. Draws from the calling thread's random stream; the BVH is left to the caller
+Scene makeRandomSphereScene(int count) {
+    Scene scene;
+    std::shared_ptr<Material> matte = std::make_shared<Lambertian>(Color(0.5, 0.5, 0.5));
+    std::shared_ptr<Material> glass = std::make_shared<Blinn_Phong>(Color(1, 1, 1), Color(1, 1, 1), 0.0, 0.0, 1, false, 0.0, true, 1.5);
+    for (int i = 0; i < count; ++i) {
+        scene.add(std::make_shared<Sphere>(Vector3D::random(-10, 10), random_double(0.1, 1.0), i % 4 == 0 ? glass : matte));
+    }
+    scene.add(std::make_shared<Triangle>(Point3D(-20, -11, -20), Point3D(20, -11, -20), Point3D(0, -11, 20), matte));
+    return scene;
+}
+
+// Small camera looking at makeTestScene(), rendering with two threads in tiles of 8 pixels
+Camera makeTestCamera(int samples_per_pixel) {
+    Camera camera;
+    camera.image_width = 32;
+    camera.aspect_ratio = 2.0;
+    camera.samples_per_pixel = samples_per_pixel;
+    camera.max_depth = 5;
+    camera.lookfrom = Point3D(0, 0.5, 1);
+    camera.lookat = Point3D(0, 0, -1.5);
+    camera.num_threads = 2;
+    camera.tile_size = 8;
+    return camera;
+}
+
+// The two images took the same samples per pixel and agree exactly
+void assertSameImage(const Framebuffer& a, const Framebuffer& b) {
+    assert(a.getSampleCounts() == b.getSampleCounts());
+    for (size_t p = 0; p < a.getPixels().size(); ++p) {
+        assert(a.getPixels()[p] == b.getPixels()[p]);
+    }
+}
+
+#endif // TEST_SCENES_H
@@ -0,0 +1,75 @@
+// Checks the Vector3D operations against their component formulas. Build it with -DRT_SIMD_VECTOR
+// (and optionally -DRT_FLOAT) to test the SIMD layout; without it, it checks the scalar one.
+#include "math_utils.h"
+#include "vector.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include <limits>
+
+// The scalar code may fuse multiply-adds, so allow a few roundings
+bool close(double a, double b) {
+    return std::fabs(a - b) <= 8 * std::numeric_limits<real>::epsilon() * std::max(1.0, std::fabs(b));
+}
+
+bool close(const Vector3D& v, double x, double y, double z) {
+    return close(v.x, x) && close(v.y, y) && close(v.z, z);
+}
+
+void testOperations() {
+    seed_random(17);
+    for (int i = 0; i < 1000; ++i) {
+        Vector3D a = Vector3D::random(-4, 4);
+        Vector3D b = Vector3D::random(0.5, 4);
+        real s = static_cast<real>(random_double(0.5, 2));
+        double ax = a.x, ay = a.y, az = a.z, bx = b.x, by = b.y, bz = b.z;
+
+        assert(close(a + b, ax + bx, ay + by, az + bz));
+        assert(close(a - b, ax - bx, ay - by, az - bz));
+        assert(close(a * b, ax * bx, ay * by, az * bz));
+        assert(close(a / b, ax / bx, ay / by, az / bz));
+        assert(close(a * s, ax * s, ay * s, az * s));
+        assert(close(s * a, ax * s, ay * s, az * s));
+        assert(close(a / s, ax / s, ay / s, az / s));
+        assert(close(crossProduct(a, b), ay * bz - az * by, az * bx - ax * bz, ax * by - ay * bx));
+        assert(close(dotProduct(a, b), ax * bx + ay * by + az * bz));
+        double length = std::sqrt(ax * ax + ay * ay + az * az);
+        assert(close(getLength(a), length));
+        assert(close(normalize(a), ax / length, ay / length, az / length));
+
+        Vector3D c = a;
+        c += b;
+        c -= b;
+        c *= s;
+        c /= s;
+        assert(close(c, ax, ay, az));
+    }
+}
+
+// Negation flips the sign of zero, and equality ignores the padding lane of the SIMD layout
+void testSignsAndEquality() {
+    Vector3D zero;
+    Vector3D negated = -zero;
+    assert(std::signbit(negated.x) && std::signbit(negated.y) && std::signbit(negated.z));
+
+    Vector3D a(1, 2, 3);
+    Vector3D b = (a * Vector3D(2, 2, 2)) / Vector3D(2, 2, 2);
+    assert(a == b && !(a != b));
+    assert(a != Vector3D(1, 2, 4));
+
+    // Writing a component through its name is seen by the vector operations
+    Vector3D c(1, 2, 3);
+    c.y = 5;
+    assert(dotProduct(c, Vector3D(0, 1, 0)) == 5);
+}
+
+int main() {
+    std::cout << "Running vector tests (" << vector_kernel_name() << ")...\n";
+    testOperations();
+    std::cout << "Vector operations test passed!\n";
+    testSignsAndEquality();
+    std::cout << "Vector signs and equality test passed!\n";
+    return 0;
+}
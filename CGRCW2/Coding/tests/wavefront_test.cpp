@@ -0,0 +1,105 @@
+#include "test_scenes.h"
+
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+#include <limits>
+
+Camera makeCamera(bool wavefront, bool adaptive) {
+    Camera camera = makeTestCamera(6);
+    camera.adaptive = adaptive;
+    camera.min_samples = 4;
+    camera.max_samples = 32;
+    camera.wavefront = wavefront;
+    camera.roulette_depth = 2;      // Roulette draws must happen at the same points of both integrators
+    return camera;
+}
+
+// Both integrators draw the same random numbers for every sample, so the images must agree up to rounding
+void testIntegratorsAgree(RenderMode render_mode, bool adaptive) {
+    const double tolerance = std::max(1e-9, 8.0 * std::numeric_limits<real>::epsilon());
+    Scene scene = makeTestScene();
+    Color background(0.2, 0.3, 0.5);
+    Framebuffer recursive = makeCamera(false, adaptive).render(scene, background, render_mode);
+    Framebuffer wavefront = makeCamera(true, adaptive).render(scene, background, render_mode);
+
+    assert(recursive.getSampleCounts() == wavefront.getSampleCounts());
+    for (size_t p = 0; p < recursive.getPixels().size(); ++p) {
+        Color difference = recursive.getPixels()[p] - wavefront.getPixels()[p];
+        assert(fabs(difference.x) < tolerance && fabs(difference.y) < tolerance && fabs(difference.z) < tolerance);
+    }
+}
+
+// Roulette ends paths but scales up the survivors, so on average the throughput is unchanged
+void testRouletteKeepsThroughput() {
+    start_sample(3, 0, 0);
+    const int count = 200000;
+    Color sum(0, 0, 0);
+    int ended = 0;
+    for (int i = 0; i < count; ++i) {
+        Color throughput(0.3, 0.1, 0.05);
+        if (survives_roulette(throughput, 4, 3)) {
+            sum += throughput;
+        } else {
+            ++ended;
+        }
+    }
+    assert(fabs(sum.x / count - 0.3) < 0.01 && fabs(sum.y / count - 0.1) < 0.004 && fabs(sum.z / count - 0.05) < 0.002);
+    assert(ended > count / 2);
+
+    // Before roulette_depth bounces, with full throughput or with the roulette off, nothing changes
+    Color throughput(0.3, 0.1, 0.05);
+    assert(survives_roulette(throughput, 2, 3) && throughput == Color(0.3, 0.1, 0.05));
+    assert(survives_roulette(throughput, 4, 0) && throughput == Color(0.3, 0.1, 0.05));
+    Color bright(1.5, 0.2, 0.2);
+    assert(survives_roulette(bright, 4, 3) && bright == Color(1.5, 0.2, 0.2));
+}
+
+// The image with roulette converges to the one without: compare the average brightness of many samples
+void testRouletteKeepsImageMean(RenderMode render_mode) {
+    Scene scene = makeTestScene();
+    Color background(0.2, 0.3, 0.5);
+    double mean[2] = {0, 0};
+    for (int roulette_depth = 0; roulette_depth < 2; ++roulette_depth) {
+        Camera camera = makeCamera(false, false);
+        camera.samples_per_pixel = 64;
+        camera.max_depth = 8;
+        camera.roulette_depth = roulette_depth;
+        Framebuffer image = camera.render(scene, background, render_mode);
+        for (const Color& pixel : image.getPixels()) {
+            mean[roulette_depth] += luminance(pixel) / image.getPixels().size();
+        }
+    }
+    assert(fabs(mean[1] - mean[0]) < 0.02 * mean[0]);
+}
+
+// Shapes sharing a material share its entry in the material table, and a hit reports its shape's entry
+void testMaterialTable() {
+    Scene scene = makeTestScene();
+    assert(scene.getMaterialCount() == 4);
+    Hit_record rec;
+    assert(scene.hit(Ray(Point3D(5, 5, 5), Vector3D(0, -1, 0)), Interval(0.001, infinity), rec));
+    const Shape& ground = *scene.getShapes()[0];
+    assert(rec.material == ground.getMaterialId() && &scene.getMaterial(rec.material) == ground.getMaterial().get());
+}
+
+int main() {
+    std::cout << "Running wavefront integrator tests...\n";
+    RenderMode modes[] = {RENDER_BINARY, RENDER_NORMAL, RENDER_DIFFUSE, RENDER_PHONG, RENDER_PBR};
+    for (RenderMode mode : modes) {
+        testIntegratorsAgree(mode, false);
+        std::cout << "Recursive vs. wavefront (" << renderModeName(mode) << ") test passed!\n";
+    }
+    testIntegratorsAgree(RENDER_PHONG, true);
+    std::cout << "Recursive vs. wavefront (phong, adaptive) test passed!\n";
+    testIntegratorsAgree(RENDER_PBR, true);
+    std::cout << "Recursive vs. wavefront (pbr, adaptive) test passed!\n";
+    testRouletteKeepsThroughput();
+    testRouletteKeepsImageMean(RENDER_DIFFUSE);
+    testRouletteKeepsImageMean(RENDER_PHONG);
+    testRouletteKeepsImageMean(RENDER_PBR);
+    std::cout << "Russian roulette test passed!\n";
+    testMaterialTable();
+    std::cout << "Material table test passed!\n";
+    return 0;
+}
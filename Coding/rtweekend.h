@@ -2,6 +2,7 @@
 #define RTWEEKEND_H
 
 #include <cmath>
+#include <cstdint>
 #include <cstdlib>
 #include <limits>
 #include <memory>
@@ -23,9 +24,23 @@ inline double degrees_to_radians(double degrees) {
     return degrees * pi /180.0;
 }
 
+//Per-thread SplitMix64 state, so threads never share or race on the generator
+inline std::uint64_t& random_state() {
+    static thread_local std::uint64_t state = 0;
+    return state;
+}
+
+inline void seed_random(std::uint64_t seed) {
+    random_state() = seed;
+}
+
 inline double random_double() {
-    //Random real in {0, 1}.
-    return rand() / (RAND_MAX + 1.0);
+    //Random real in [0, 1), with all 53 bits of a double.
+    std::uint64_t z = (random_state() += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    z ^= z >> 31;
+    return (z >> 11) * (1.0 / 9007199254740992.0);
 }
 
 inline double random_double(double min, double max) {